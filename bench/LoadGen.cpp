@@ -0,0 +1,436 @@
+/*
+ * Loopback load generator for CppWebServer.
+ *
+ * Runs closed-loop clients (each thread sends a request, waits for the full
+ * response, repeats) against a running server for a fixed time, over HTTP
+ * and/or HTTPS, with and without keep-alive. Reports requests/sec, bytes/sec
+ * and latency percentiles; without keep-alive the latency includes connect
+ * (and the TLS handshake).
+ *
+ *   ./bench/LoadGen [--host 127.0.0.1] [--http-port 8080] [--https-port 8443]
+ *                   [--threads 4] [--duration 5] [--keepalive on|off|both]
+ *                   [--path /index.html]... [--docroot ../public] [--json out.json]
+ *                   [--tls-resume on|off]
+ *
+ * Without --path, every regular file under --docroot (default ../public)
+ * is requested in turn. A port of 0 skips that scheme. With --tls-resume on,
+ * each HTTPS client offers its previous session when it reconnects, so the
+ * non-keep-alive run measures resumed instead of full handshakes.
+ */
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::string host = "127.0.0.1";
+        int httpPort = 8080;
+        int httpsPort = 8443;
+        int threads = 4;
+        int durationSec = 5;
+        std::string keepAlive = "both";
+        std::vector<std::string> paths;
+        std::string docRoot = "../public";
+        std::string jsonPath;
+        bool tlsResume = false;
+    };
+
+    struct RunResult
+    {
+        std::string name;
+        bool tls;
+        bool keepAlive;
+        double seconds;
+        uint64_t requests = 0;
+        uint64_t errors = 0;   // connect/handshake/read failures
+        uint64_t non2xx = 0;   // complete responses with a status outside 200-299
+        uint64_t bytes = 0;    // response bytes, headers included
+        uint64_t connections = 0;
+        uint64_t resumed = 0; // TLS connections that resumed a session
+        std::vector<uint32_t> latencyUs;
+    };
+
+    /*
+     * One client connection, plain or TLS, with a receive buffer that may
+     * hold bytes past the current response.
+     */
+    struct Client
+    {
+        int fd = -1;
+        SSL *ssl = nullptr;
+        SSL_SESSION *session = nullptr; // offered on the next connect when resuming
+        bool resume = false;
+        std::string in;
+
+        ~Client()
+        {
+            disconnect();
+            SSL_SESSION_free(session);
+        }
+
+        void disconnect()
+        {
+            if (ssl)
+            {
+                if (resume)
+                {
+                    // Without close_notify OpenSSL marks the session unresumable.
+                    // TLS 1.3 tickets arrive after the handshake, so the session is taken last
+                    SSL_shutdown(ssl);
+                    SSL_SESSION *latest = SSL_get1_session(ssl);
+                    if (latest && SSL_SESSION_is_resumable(latest))
+                        std::swap(session, latest);
+                    SSL_SESSION_free(latest);
+                }
+                SSL_free(ssl);
+                ssl = nullptr;
+            }
+            if (fd >= 0)
+            {
+                close(fd);
+                fd = -1;
+            }
+            in.clear();
+        }
+
+        bool connectTo(const sockaddr_in &addr, SSL_CTX *ctx, const std::string &host)
+        {
+            fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0)
+                return false;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) < 0)
+            {
+                disconnect();
+                return false;
+            }
+            if (!ctx)
+                return true;
+
+            ssl = SSL_new(ctx);
+            SSL_set_fd(ssl, fd);
+            SSL_set_tlsext_host_name(ssl, host.c_str());
+            if (resume && session)
+                SSL_set_session(ssl, session);
+            if (SSL_connect(ssl) != 1)
+            {
+                ERR_clear_error();
+                disconnect();
+                return false;
+            }
+            return true;
+        }
+
+        bool sendAll(const std::string &data)
+        {
+            size_t done = 0;
+            while (done < data.size())
+            {
+                ssize_t n;
+                if (ssl)
+                    n = SSL_write(ssl, data.data() + done, static_cast<int>(data.size() - done));
+                else
+                    n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+                if (n <= 0)
+                {
+                    if (!ssl && n < 0 && errno == EINTR)
+                        continue;
+                    return false;
+                }
+                done += static_cast<size_t>(n);
+            }
+            return true;
+        }
+
+        bool receiveMore()
+        {
+            char buf[16384];
+            ssize_t n;
+            do
+            {
+                n = ssl ? SSL_read(ssl, buf, sizeof(buf)) : recv(fd, buf, sizeof(buf), 0);
+            } while (!ssl && n < 0 && errno == EINTR);
+            if (n <= 0)
+                return false;
+            in.append(buf, static_cast<size_t>(n));
+            return true;
+        }
+
+        /*
+         * Reads one complete response (headers plus Content-Length bytes).
+         * Sets `status`, `closing` (server sent Connection: close) and the
+         * total response size.
+         */
+        bool readResponse(int &status, bool &closing, size_t &size)
+        {
+            size_t headerEnd;
+            while ((headerEnd = in.find("\r\n\r\n")) == std::string::npos)
+                if (!receiveMore())
+                    return false;
+
+            std::string head = in.substr(0, headerEnd);
+            std::transform(head.begin(), head.end(), head.begin(), ::tolower);
+            if (head.compare(0, 9, "http/1.1 ") != 0 && head.compare(0, 9, "http/1.0 ") != 0)
+                return false;
+            status = std::atoi(head.c_str() + 9);
+            closing = head.find("\r\nconnection: close") != std::string::npos;
+
+            size_t contentLength = 0;
+            size_t pos = head.find("\r\ncontent-length:");
+            if (pos != std::string::npos)
+                contentLength = std::strtoull(head.c_str() + pos + 17, nullptr, 10);
+
+            size = headerEnd + 4 + contentLength;
+            while (in.size() < size)
+                if (!receiveMore())
+                    return false;
+            in.erase(0, size);
+            return true;
+        }
+    };
+
+    void clientLoop(const Options &opt, const sockaddr_in &addr, SSL_CTX *ctx, bool keepAlive,
+                    std::chrono::steady_clock::time_point deadline, size_t firstPath, RunResult &result)
+    {
+        using clock = std::chrono::steady_clock;
+        Client client;
+        client.resume = opt.tlsResume;
+        size_t next = firstPath;
+        result.latencyUs.reserve(1 << 16);
+
+        while (clock::now() < deadline)
+        {
+            const std::string &path = opt.paths[next++ % opt.paths.size()];
+            std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + opt.host + "\r\n" +
+                                  (keepAlive ? "" : "Connection: close\r\n") + "\r\n";
+
+            auto start = clock::now();
+            if (client.fd < 0)
+            {
+                if (!client.connectTo(addr, ctx, opt.host))
+                {
+                    result.errors++;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    continue;
+                }
+                result.connections++;
+                if (client.ssl && SSL_session_reused(client.ssl))
+                    result.resumed++;
+            }
+
+            int status = 0;
+            bool closing = false;
+            size_t size = 0;
+            if (!client.sendAll(request) || !client.readResponse(status, closing, size))
+            {
+                result.errors++;
+                client.disconnect();
+                continue;
+            }
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count();
+
+            result.requests++;
+            result.bytes += size;
+            result.latencyUs.push_back(static_cast<uint32_t>(std::min<int64_t>(micros, UINT32_MAX)));
+            if (status < 200 || status > 299)
+                result.non2xx++;
+            if (!keepAlive || closing)
+                client.disconnect();
+        }
+    }
+
+    RunResult runOnce(const Options &opt, bool tls, bool keepAlive, SSL_CTX *ctx)
+    {
+        RunResult total;
+        total.name = std::string(tls ? "https" : "http") + (keepAlive ? "/keepalive" : "/close");
+        if (tls && opt.tlsResume)
+            total.name += "+resume";
+        total.tls = tls;
+        total.keepAlive = keepAlive;
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(tls ? opt.httpsPort : opt.httpPort));
+        if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1)
+        {
+            hostent *he = gethostbyname(opt.host.c_str());
+            if (!he)
+            {
+                std::fprintf(stderr, "cannot resolve %s\n", opt.host.c_str());
+                std::exit(1);
+            }
+            std::memcpy(&addr.sin_addr, he->h_addr_list[0], sizeof(addr.sin_addr));
+        }
+
+        std::vector<RunResult> perThread(static_cast<size_t>(opt.threads));
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::seconds(opt.durationSec);
+        for (int i = 0; i < opt.threads; ++i)
+            threads.emplace_back(clientLoop, std::cref(opt), std::cref(addr), tls ? ctx : nullptr, keepAlive, deadline,
+                                 static_cast<size_t>(i), std::ref(perThread[static_cast<size_t>(i)]));
+        for (auto &t : threads)
+            t.join();
+        total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (RunResult &r : perThread)
+        {
+            total.requests += r.requests;
+            total.errors += r.errors;
+            total.non2xx += r.non2xx;
+            total.bytes += r.bytes;
+            total.connections += r.connections;
+            total.resumed += r.resumed;
+            total.latencyUs.insert(total.latencyUs.end(), r.latencyUs.begin(), r.latencyUs.end());
+        }
+        std::sort(total.latencyUs.begin(), total.latencyUs.end());
+        return total;
+    }
+
+    uint32_t percentile(const std::vector<uint32_t> &sorted, double q)
+    {
+        if (sorted.empty())
+            return 0;
+        size_t index = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    void writeJson(const Options &opt, const std::vector<RunResult> &runs)
+    {
+        FILE *out = std::fopen(opt.jsonPath.c_str(), "w");
+        if (!out)
+        {
+            std::perror(opt.jsonPath.c_str());
+            return;
+        }
+        std::fprintf(out, "{\n  \"suite\": \"LoadGen\",\n  \"timestamp\": %lld,\n  \"host\": \"%s\",\n"
+                          "  \"threads\": %d,\n  \"durationSec\": %d,\n  \"paths\": %zu,\n  \"runs\": [\n",
+                     static_cast<long long>(std::time(nullptr)), opt.host.c_str(), opt.threads, opt.durationSec, opt.paths.size());
+        for (size_t i = 0; i < runs.size(); ++i)
+        {
+            const RunResult &r = runs[i];
+            std::fprintf(out,
+                         "    {\"name\": \"%s\", \"tls\": %s, \"keepAlive\": %s, \"seconds\": %.3f, \"requests\": %llu, "
+                         "\"errors\": %llu, \"non2xx\": %llu, \"connections\": %llu, \"resumed\": %llu, \"bytes\": %llu, "
+                         "\"requestsPerSec\": %.1f, \"bytesPerSec\": %.0f, "
+                         "\"latencyUs\": {\"p50\": %u, \"p90\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u}}%s\n",
+                         r.name.c_str(), r.tls ? "true" : "false", r.keepAlive ? "true" : "false", r.seconds,
+                         static_cast<unsigned long long>(r.requests), static_cast<unsigned long long>(r.errors),
+                         static_cast<unsigned long long>(r.non2xx), static_cast<unsigned long long>(r.connections),
+                         static_cast<unsigned long long>(r.resumed),
+                         static_cast<unsigned long long>(r.bytes), r.requests / r.seconds, r.bytes / r.seconds,
+                         percentile(r.latencyUs, 0.5), percentile(r.latencyUs, 0.9), percentile(r.latencyUs, 0.99),
+                         percentile(r.latencyUs, 0.999), r.latencyUs.empty() ? 0 : r.latencyUs.back(),
+                         i + 1 < runs.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+        std::fclose(out);
+    }
+
+    [[noreturn]] void usage(const char *argv0)
+    {
+        std::fprintf(stderr,
+                     "usage: %s [--host H] [--http-port P] [--https-port P] [--threads N] [--duration S]\n"
+                     "          [--keepalive on|off|both] [--path /p]... [--docroot DIR] [--json FILE]\n"
+                     "          [--tls-resume on|off]\n",
+                     argv0);
+        std::exit(2);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        std::string value = argv[++i];
+        if (arg == "--host")
+            opt.host = value;
+        else if (arg == "--http-port")
+            opt.httpPort = std::atoi(value.c_str());
+        else if (arg == "--https-port")
+            opt.httpsPort = std::atoi(value.c_str());
+        else if (arg == "--threads")
+            opt.threads = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--duration")
+            opt.durationSec = std::max(1, std::atoi(value.c_str()));
+        else if (arg == "--keepalive" && (value == "on" || value == "off" || value == "both"))
+            opt.keepAlive = value;
+        else if (arg == "--path")
+            opt.paths.push_back(value);
+        else if (arg == "--docroot")
+            opt.docRoot = value;
+        else if (arg == "--json")
+            opt.jsonPath = value;
+        else if (arg == "--tls-resume" && (value == "on" || value == "off"))
+            opt.tlsResume = value == "on";
+        else
+            usage(argv[0]);
+    }
+
+    if (opt.paths.empty())
+    {
+        std::error_code ec;
+        for (auto it = std::filesystem::recursive_directory_iterator(opt.docRoot, ec);
+             !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+        {
+            if (it->is_regular_file())
+                opt.paths.push_back("/" + std::filesystem::relative(it->path(), opt.docRoot).generic_string());
+        }
+        std::sort(opt.paths.begin(), opt.paths.end());
+        if (opt.paths.empty())
+            opt.paths.push_back("/");
+    }
+
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr); // the server uses a self-signed certificate
+
+    std::vector<RunResult> runs;
+    std::printf("%-20s %10s %7s %7s %11s %9s %9s %9s %9s %9s %9s\n", "run", "requests", "errors", "non2xx",
+                "req/s", "MB/s", "p50(us)", "p90(us)", "p99(us)", "p999(us)", "max(us)");
+    for (bool tls : {false, true})
+    {
+        if ((tls ? opt.httpsPort : opt.httpPort) == 0)
+            continue;
+        for (bool keepAlive : {true, false})
+        {
+            if ((keepAlive && opt.keepAlive == "off") || (!keepAlive && opt.keepAlive == "on"))
+                continue;
+            RunResult r = runOnce(opt, tls, keepAlive, ctx);
+            std::printf("%-20s %10llu %7llu %7llu %11.1f %9.2f %9u %9u %9u %9u %9u\n", r.name.c_str(),
+                        static_cast<unsigned long long>(r.requests), static_cast<unsigned long long>(r.errors),
+                        static_cast<unsigned long long>(r.non2xx), r.requests / r.seconds, r.bytes / r.seconds / 1e6,
+                        percentile(r.latencyUs, 0.5), percentile(r.latencyUs, 0.9), percentile(r.latencyUs, 0.99),
+                        percentile(r.latencyUs, 0.999), r.latencyUs.empty() ? 0 : r.latencyUs.back());
+            runs.push_back(std::move(r));
+        }
+    }
+
+    SSL_CTX_free(ctx);
+    if (!opt.jsonPath.empty())
+        writeJson(opt, runs);
+    return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * Microbenchmarks for the per-request hot spots: request parsing on canned
+ * buffers, getMimeType, isAcceptable (memoized and parsing), Config::load, response building
+ * with sendResponse/sendErrorResponse (built and flushed to a socketpair) and a whole
+ * keep-alive GET of a cached file through driveConnection(), which should not allocate.
+ * Before timing, a HEAD 404 pipelined with a GET is checked to come back as
+ * two bare responses; the run fails if the 404 carries a body.
+ *
+ * Each benchmark doubles its iteration count until a run takes at least
+ * 200 ms, then reports ns and heap allocations per operation.
+ *
+ *   ./bench/MicroBench [--filter <substring>] [--json <file>]
+ */
+#include "../include/HttpParser.hpp"
+#include "../include/FileServer.hpp"
+#include "../include/ContentNegotiation.hpp"
+#include "../include/Config.hpp"
+#include "../include/HttpResponse.hpp"
+#include "../include/Connection.hpp"
+#include "../include/ConnectionManager.hpp"
+#include "../include/Exception.hpp"
+#include "RequestSamples.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <functional>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <vector>
+
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace
+{
+    constexpr double MIN_RUN_NS = 200e6;
+
+    struct Result
+    {
+        std::string name;
+        uint64_t iterations;
+        double nsPerOp;
+        double allocsPerOp;
+    };
+
+    volatile size_t sink = 0;
+
+    Result measure(const std::string &name, const std::function<void()> &op)
+    {
+        for (uint64_t iterations = 16;; iterations *= 2)
+        {
+            uint64_t allocsBefore = allocations.load();
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; ++i)
+                op();
+            double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (elapsed >= MIN_RUN_NS)
+            {
+                double allocs = double(allocations.load() - allocsBefore) / iterations;
+                return {name, iterations, elapsed / iterations, allocs};
+            }
+        }
+    }
+
+    void writeJson(const std::string &path, const std::vector<Result> &results)
+    {
+        FILE *out = std::fopen(path.c_str(), "w");
+        if (!out)
+        {
+            std::perror(path.c_str());
+            return;
+        }
+        std::fprintf(out, "{\n  \"suite\": \"MicroBench\",\n  \"timestamp\": %lld,\n  \"benchmarks\": [\n",
+                     static_cast<long long>(std::time(nullptr)));
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result &r = results[i];
+            std::fprintf(out, "    {\"name\": \"%s\", \"iterations\": %llu, \"nsPerOp\": %.2f, \"allocsPerOp\": %.2f}%s\n",
+                         r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.allocsPerOp,
+                         i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+        std::fclose(out);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string filter, jsonPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+            filter = argv[++i];
+        else if (!std::strcmp(argv[i], "--json") && i + 1 < argc)
+            jsonPath = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--filter <substring>] [--json <file>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<std::pair<std::string, std::function<void()>>> benches;
+
+    // Request parsing (HttpParser replaced the old receiveRequest parser)
+    std::vector<Sample> requests = samples();
+    HttpParser parser;
+    HttpRequest req;
+    for (const Sample &sample : requests)
+    {
+        benches.emplace_back(std::string("parse/") + sample.name, [&parser, &req, &sample]()
+                             {
+                                 parser.reset();
+                                 parser.parse(sample.request, req);
+                                 sink = sink + req.headers.size(); });
+    }
+
+    const std::string html = "../public/index.html", jpeg = "../public/images/photo.JPEG", unknown = "../public/archive.tar.zst";
+    benches.emplace_back("getMimeType/html", [&]()
+                         { sink = sink + getMimeType(html).size(); });
+    benches.emplace_back("getMimeType/jpeg-upper", [&]()
+                         { sink = sink + getMimeType(jpeg).size(); });
+    benches.emplace_back("getMimeType/unknown", [&]()
+                         { sink = sink + getMimeType(unknown).size(); });
+
+    const std::string any = "*/*", mimeHtml = "text/html", mimePng = "image/png";
+    const std::string browserAccept = "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8";
+    const std::string narrowAccept = "application/json, text/plain;q=0.5";
+    benches.emplace_back("isAcceptable/any", [&]()
+                         { sink = sink + isAcceptable(any, mimeHtml); });
+    benches.emplace_back("isAcceptable/browser", [&]()
+                         { sink = sink + isAcceptable(browserAccept, mimePng); });
+    benches.emplace_back("isAcceptable/miss", [&]()
+                         { sink = sink + isAcceptable(narrowAccept, mimePng); });
+    // What a request pays when its Accept header is not memoized yet
+    benches.emplace_back("AcceptList::parse/browser", [&]()
+                         { sink = sink + AcceptList::parse(browserAccept).quality(mimePng); });
+
+    // Config::load reads a real file, like at startup
+    char configPath[] = "/tmp/microbench-config-XXXXXX";
+    int configFd = mkstemp(configPath);
+    if (configFd < 0)
+    {
+        std::perror("mkstemp");
+        return 1;
+    }
+    const char configJson[] = "{\n  \"port\": 8080,\n  \"sslPort\": 8443,\n  \"docRoot\": \"../public\",\n"
+                              "  \"maxThreads\": 4,\n  \"keepAliveTimeout\": 5,\n  \"fileCacheMB\": 64,\n"
+                              "  \"cacheControl\": {\n    \"text/html\": \"no-cache\",\n    \"image/*\": \"max-age=86400\"\n  }\n}\n";
+    if (write(configFd, configJson, sizeof(configJson) - 1) != static_cast<ssize_t>(sizeof(configJson) - 1))
+    {
+        std::perror("write");
+        return 1;
+    }
+    close(configFd);
+    const std::string configFile = configPath;
+    benches.emplace_back("Config::load", [&]()
+                         { sink = sink + Config::load(configFile).port; });
+
+    // Responses are flushed into a socketpair whose other end is drained
+    // after each build: head assembly plus one gathered write, with the
+    // connection's output buffer reused as it is in the server
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0)
+    {
+        std::perror("socketpair");
+        return 1;
+    }
+    Connection conn(pair[0]);
+    conn.keepAlive = true;
+    char drain[65536];
+    auto flushAndDrain = [&]()
+    {
+        flushOutput(conn);
+        sink = sink + static_cast<size_t>(read(pair[1], drain, sizeof(drain)));
+    };
+    const std::string smallBody(1024, 'x');
+    const std::string notFound = "<html><body><h1>404 Not Found</h1></body></html>";
+    benches.emplace_back("sendResponse/1KB", [&]()
+                         {
+                             sendResponse(conn, smallBody, "text/html");
+                             flushAndDrain(); });
+    benches.emplace_back("sendErrorResponse/404", [&]()
+                         {
+                             sendErrorResponse(conn, 404, "Not Found", notFound);
+                             flushAndDrain(); });
+
+    // A full request on a keep-alive connection: read from the socket,
+    // parse, docRoot index and file cache lookups, head and borrowed body
+    // gathered into one write. Needs ../public/index.html.
+    int clientPair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, clientPair) < 0)
+    {
+        std::perror("socketpair");
+        return 1;
+    }
+    Connection client(clientPair[0]);
+    Config serverCfg = Config::load(configFile);
+    serverCfg.maxKeepAliveRequests = 1 << 30;
+    const std::string getRequest = "GET /index.html HTTP/1.1\r\nHost: localhost\r\nAccept: text/html,*/*;q=0.8\r\n"
+                                   "Accept-Encoding: gzip, deflate\r\nUser-Agent: MicroBench\r\n\r\n";
+    try
+    {
+        initFileCache(static_cast<size_t>(serverCfg.fileCacheMB) * 1024 * 1024);
+        initDocIndex(serverCfg.docRoot, static_cast<size_t>(serverCfg.maxOpenFiles));
+
+        // A HEAD 404 pipelined ahead of a GET must leave nothing behind its
+        // head, or the GET's reply would be read after the 404's body
+        const std::string headThenGet = "HEAD /microbench-missing.html HTTP/1.1\r\nHost: localhost\r\n\r\n" + getRequest;
+        if (write(clientPair[1], headThenGet.data(), headThenGet.size()) < 0)
+            std::perror("write");
+        driveConnection(client, serverCfg);
+        ssize_t got = read(clientPair[1], drain, sizeof(drain));
+        std::string_view reply(drain, got > 0 ? static_cast<size_t>(got) : 0);
+        size_t headEnd = reply.find("\r\n\r\n");
+        if (reply.compare(0, 12, "HTTP/1.1 404") != 0 || headEnd == std::string_view::npos ||
+            reply.compare(headEnd + 4, 12, "HTTP/1.1 200") != 0)
+        {
+            std::fprintf(stderr, "pipelined HEAD 404 + GET: unexpected reply\n%.*s\n", static_cast<int>(reply.size()), reply.data());
+            return 1;
+        }
+
+        benches.emplace_back("driveConnection/cached-get", [&]()
+                             {
+                                 if (write(clientPair[1], getRequest.data(), getRequest.size()) < 0)
+                                     std::perror("write");
+                                 driveConnection(client, serverCfg);
+                                 sink = sink + static_cast<size_t>(read(clientPair[1], drain, sizeof(drain))); });
+    }
+    catch (const ServerException &e)
+    {
+        std::fprintf(stderr, "skipping driveConnection/cached-get: %s\n", e.what());
+    }
+
+    std::vector<Result> results;
+    std::printf("%-28s %12s %14s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+    for (const auto &[name, op] : benches)
+    {
+        if (!filter.empty() && name.find(filter) == std::string::npos)
+            continue;
+        Result r = measure(name, op);
+        std::printf("%-28s %12llu %14.1f %12.2f\n", r.name.c_str(), static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.allocsPerOp);
+        results.push_back(r);
+    }
+
+    close(pair[1]);
+    close(clientPair[1]);
+    unlink(configPath);
+    if (!jsonPath.empty())
+        writeJson(jsonPath, results);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Microbenchmark: the incremental HttpParser against the previous
+ * istringstream/std::map based request parser, once per SIMD scan level
+ * (scalar, SSE2, AVX2) the CPU supports.
+ *
+ * Build with optimizations for meaningful numbers:
+ *   cmake -DCMAKE_BUILD_TYPE=Release .. && make ParserBench && ./bench/ParserBench
+ */
+#include "../include/HttpParser.hpp"
+#include "../include/SimdScan.hpp"
+#include "RequestSamples.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Every heap allocation made by the process is counted, so the benchmark can
+// report allocations per request alongside the timing.
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+namespace
+{
+    // The parser as it was before HttpParser: one istringstream per request,
+    // getline per line, substr per header and a std::map of std::strings.
+    struct LegacyRequest
+    {
+        std::string method;
+        std::string path;
+        std::string version;
+        std::map<std::string, std::string> headers;
+    };
+
+    bool legacyParse(const std::string &raw, LegacyRequest &req)
+    {
+        if (raw.find("\r\n\r\n") == std::string::npos)
+            return false;
+
+        std::istringstream stream(raw);
+        std::string line;
+        if (!std::getline(stream, line) || line.back() != '\r')
+            return false;
+        {
+            std::istringstream rl(line);
+            rl >> req.method >> req.path >> req.version;
+        }
+        while (std::getline(stream, line) && line != "\r" && !line.empty())
+        {
+            if (line.back() == '\r')
+                line.pop_back();
+            size_t pos = line.find(':');
+            if (pos != std::string::npos)
+            {
+                std::string name = line.substr(0, pos);
+                std::string value = line.substr(pos + 1);
+                if (!value.empty() && value[0] == ' ')
+                    value.erase(0, 1);
+                req.headers[name] = value;
+            }
+        }
+        return true;
+    }
+
+    template <typename Fn>
+    void run(const char *label, const char *sample, int iterations, Fn &&fn)
+    {
+        uint64_t allocsBefore = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            fn();
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        double allocsPerRequest = double(allocations.load() - allocsBefore) / iterations;
+        std::printf("%-17s %-10s %10.1f ns/req %8.1f allocs/req\n", label, sample, elapsed / iterations, allocsPerRequest);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 200000;
+    volatile size_t sink = 0;
+
+    for (const auto &sample : samples())
+    {
+        run("legacy", sample.name, iterations, [&]()
+            {
+                LegacyRequest req;
+                legacyParse(sample.request, req);
+                sink = sink + req.headers.size(); });
+
+        for (ScanLevel level : {ScanLevel::Scalar, ScanLevel::SSE2, ScanLevel::AVX2})
+        {
+            setScanLevel(level);
+            if (activeScanLevel() != level)
+                continue; // not supported by this CPU
+
+            std::string whole = std::string("incr-") + scanLevelName(level);
+            std::string split = whole + "/512B";
+
+            HttpParser parser;
+            HttpRequest req;
+            run(whole.c_str(), sample.name, iterations, [&]()
+                {
+                    parser.reset();
+                    parser.parse(sample.request, req);
+                    sink = sink + req.headers.size(); });
+
+            // The same request arriving in 512-byte reads, as from a slow client
+            run(split.c_str(), sample.name, iterations / 4, [&]()
+                {
+                    parser.reset();
+                    std::string_view all(sample.request);
+                    for (size_t n = 512;; n += 512)
+                    {
+                        if (parser.parse(all.substr(0, std::min(n, all.size())), req))
+                            break;
+                    }
+                    sink = sink + req.headers.size(); });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef REQUEST_SAMPLES_HPP
+#define REQUEST_SAMPLES_HPP
+
+#include <string>
+#include <vector>
+
+/*
+ * Canned request buffers shared by the benchmarks: a minimal curl request,
+ * a typical browser request and one carrying a 6 KB cookie.
+ */
+struct Sample
+{
+    const char *name;
+    std::string request;
+};
+
+inline std::vector<Sample> samples()
+{
+    std::vector<Sample> list;
+    list.push_back({"curl", "GET /index.html HTTP/1.1\r\n"
+                            "Host: localhost:8080\r\n"
+                            "User-Agent: curl/8.4.0\r\n"
+                            "Accept: */*\r\n\r\n"});
+    list.push_back({"browser", "GET /style.css HTTP/1.1\r\n"
+                               "Host: localhost:8080\r\n"
+                               "Connection: keep-alive\r\n"
+                               "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+                               "Accept: text/css,*/*;q=0.1\r\n"
+                               "Sec-Fetch-Site: same-origin\r\n"
+                               "Sec-Fetch-Mode: no-cors\r\n"
+                               "Sec-Fetch-Dest: style\r\n"
+                               "Referer: http://localhost:8080/\r\n"
+                               "Accept-Encoding: gzip, deflate, br\r\n"
+                               "Accept-Language: en-US,en;q=0.9\r\n\r\n"});
+    std::string cookie = "Cookie: ";
+    while (cookie.size() < 6000)
+        cookie += "session_" + std::to_string(cookie.size()) + "=abcdef0123456789abcdef0123456789; ";
+    list.push_back({"cookie-6k", "GET /index.html HTTP/1.1\r\n"
+                                 "Host: localhost:8080\r\n"
+                                 "Accept: text/html\r\n" +
+                                     cookie + "\r\n\r\n"});
+    return list;
+}
+
+#endif // REQUEST_SAMPLES_HPP
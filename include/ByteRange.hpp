@@ -0,0 +1,49 @@
+#ifndef BYTERANGE_HPP
+#define BYTERANGE_HPP
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+// A Range header asking for more pieces than this is ignored and the whole file is sent
+constexpr size_t MAX_RANGES = 16;
+
+/*
+ * An inclusive byte range [first, last] of a representation,
+ * already resolved against its size.
+ */
+struct ByteRange
+{
+    uint64_t first;
+    uint64_t last;
+
+    uint64_t length() const { return last - first + 1; }
+};
+
+/*
+ * Outcome of applying a Range header to a representation.
+ *  - Ignore:        no usable "bytes=" header (missing, malformed, another
+ *                   unit or too many ranges); send the full 200 response.
+ *  - Partial:       `ranges` holds at least one range to send with 206.
+ *  - Unsatisfiable: well formed, but no range overlaps the file; send 416.
+ */
+enum class RangeResult
+{
+    Ignore,
+    Partial,
+    Unsatisfiable
+};
+
+/*
+ * Parses a Range header value ("bytes=0-99,200-", "bytes=-500", ...) for a
+ * representation of `size` bytes.
+ *  - Open-ended and suffix ranges are resolved, ends past the file are clamped
+ *    and ranges that start beyond it are dropped.
+ *  - The remaining ranges are sorted and overlapping or adjacent ones merged,
+ *    so the response never repeats bytes.
+ * `ranges` may live in a request arena; it only grows with push_back.
+ */
+RangeResult parseRangeHeader(std::string_view header, uint64_t size, std::pmr::vector<ByteRange> &ranges);
+
+#endif // BYTERANGE_HPP
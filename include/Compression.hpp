@@ -0,0 +1,30 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "../include/ContentNegotiation.hpp"
+
+/*
+ * Sets the zlib compression level (1-9, 0 disables compression) and the
+ * smallest body, in bytes, that is worth compressing.
+ * Must be called before serving requests.
+ */
+void initCompression(int level, size_t minSize);
+
+/*
+ * Whether a body of type `mime` and `size` bytes should be sent compressed
+ * to clients that accept it: text types, JavaScript, JSON, XML and SVG bodies of
+ * at least the configured minimum size, and only while compression is enabled.
+ */
+bool shouldCompress(std::string_view mime, size_t size);
+
+/*
+ * Compresses `size` bytes at `data` into `out` as a gzip stream or as a
+ * zlib stream (the HTTP "deflate" coding).
+ * Returns false if zlib fails; `out` is then unspecified.
+ */
+bool compressBody(const char *data, size_t size, ContentEncoding encoding, std::string &out);
+
+#endif // COMPRESSION_HPP
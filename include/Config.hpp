@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include <utility>
+#include <vector>
+#include "../include/Logger.hpp"
 #include <stdexcept>
 
 struct Config
@@ -9,6 +12,31 @@ struct Config
     int sslPort;
     std::string docRoot;
     int maxThreads;
+    int keepAliveTimeout;     // seconds an idle keep-alive connection is kept open
+    int maxKeepAliveRequests; // requests served on one connection before it is closed
+    int receiveBuffers;       // 16 KiB receive buffers preallocated at startup; the pool grows past this on demand
+    int fileCacheMB;          // in-memory file cache budget in MiB (0 disables it)
+    int docIndex;             // 1 serves file metadata from an inotify-maintained index of docRoot, 0 stats per request
+    int maxOpenFiles;         // descriptors the index keeps open for files too large to cache
+    std::string mimeTypesFile; // mime.types style file extending the built-in MIME table; empty uses only the built-in one
+    int gzipLevel;            // zlib level 1-9 for compressible responses (0 disables compression)
+    int gzipMinSize;          // bodies smaller than this many bytes are sent uncompressed
+    // Cache-Control values keyed by URL path prefix ("/static/") or MIME type ("text/html", "image/*")
+    std::vector<std::pair<std::string, std::string>> cacheControl;
+    std::string logFile; // file the log is appended to; empty logs to stdout
+    LogLevel logLevel;   // runtime minimum level ("debug", "info", "warn", "error")
+    std::string metricsPath; // request path of the Prometheus metrics; empty disables it
+    int listenBacklog;       // pending-connection queue length of each listening socket
+    int listenerShards;      // SO_REUSEPORT listeners (and event loops) per port; 1 = single listener, 0 = one per core
+    std::string ioBackend;   // "epoll", or "io_uring" to serve plain HTTP from io_uring loops (falls back to epoll if unavailable)
+    int tlsSessionCacheSize;   // TLS sessions kept for ID/stateful-ticket resumption (0 disables the cache)
+    int tlsSessionTimeout;     // seconds a TLS session stays resumable
+    int tlsTicketKeyRotation;  // seconds between session ticket key changes (0 disables stateless tickets)
+    int tlsHandshakeTimeout;   // seconds a client gets to finish the TLS handshake, however active it is
+    int maxPendingHandshakes;  // unfinished TLS handshakes before accepting on sslPort pauses
+    int tlsKernelOffload;      // 1 lets OpenSSL move TLS encryption into the kernel (kTLS) when supported, 0 never
+    int http2;                 // 1 offers HTTP/2 ("h2") through ALPN on sslPort, 0 serves HTTP/1.1 only
+    int http2MaxStreams;       // responses in progress at once on one HTTP/2 connection
 
     /*
      * Static function to load configuration from a file.
@@ -27,5 +55,11 @@ struct Config
     static std::string trim(const std::string &str);
 
     static std::string extractString(const std::string json, const std::string key);
+    static std::string extractString(const std::string json, const std::string key, const std::string &defaultValue);
     static int extractInt(const std::string json, const std::string key, int defaultValue = -1);
+    /*
+     * Reads a flat object of string values, e.g. "cacheControl": { "/static/": "max-age=60" },
+     * as (key, value) pairs in file order. A missing key yields an empty list.
+     */
+    static std::vector<std::pair<std::string, std::string>> extractStringMap(const std::string json, const std::string key);
 };
@@ -0,0 +1,288 @@
+#ifndef CONNECTION_HPP
+#define CONNECTION_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h> // for off_t
+#include <sys/uio.h>   // for iovec
+#include <openssl/ssl.h>
+#include "../include/HttpParser.hpp"
+#include "../include/MemoryPool.hpp"
+
+// Size of a receive buffer; larger than MAX_REQ_SIZE so an over-long
+// request head always reaches the parser, which rejects it.
+constexpr size_t RECEIVE_BUFFER_SIZE = 16384;
+// Most in-memory chunks gathered into one sendmsg() or TLS record.
+constexpr size_t MAX_GATHER = 64;
+
+class Http2Session;
+class HpackEncoder;
+
+/*
+ * Where a client connection currently is in its lifecycle.
+ *  - Handshaking: TLS handshake still in progress (HTTPS only).
+ *  - Reading:     waiting for a complete request to arrive.
+ *  - Writing:     responses are queued and being flushed to the socket;
+ *                afterwards a keep-alive connection goes back to Reading.
+ *  - Closed:      the connection is finished and can be released.
+ */
+enum class ConnState
+{
+    Handshaking,
+    Reading,
+    Writing,
+    Closed
+};
+
+/*
+ * Result of a non-blocking I/O step.
+ *  - Done:       the step finished (handshake completed, output fully flushed,
+ *                or the receive buffer reached its limit).
+ *  - WouldBlock: the socket has no more data / no more room; wait for epoll.
+ *  - Closed:     the peer closed the connection or an unrecoverable error occurred.
+ */
+enum class IoStatus
+{
+    Done,
+    WouldBlock,
+    Closed
+};
+
+/*
+ * An open file descriptor shared by the output chunks that stream from it.
+ * Closes the descriptor when the last chunk is done with it.
+ */
+struct FileHandle
+{
+    explicit FileHandle(int fd) : fd(fd) {}
+    ~FileHandle();
+
+    FileHandle(const FileHandle &) = delete;
+    FileHandle &operator=(const FileHandle &) = delete;
+
+    int fd;
+};
+
+/*
+ * One piece of a queued response, sent in queue order:
+ *  - in-memory bytes (status line, headers, generated bodies),
+ *  - `length` bytes at `data` owned by someone else (e.g. a file cache entry)
+ *    and kept alive by `owner`, sent without copying, or
+ *  - `length` bytes of `file` starting at `offset`, which never pass through
+ *    user space on plain HTTP (sendfile) or kTLS (SSL_sendfile) and are read
+ *    in bounded pieces for other TLS connections.
+ */
+struct OutputChunk
+{
+    std::string bytes;
+    std::shared_ptr<const void> owner;
+    const char *data = nullptr;
+    std::shared_ptr<FileHandle> file;
+    off_t offset = 0;
+    size_t length = 0;
+};
+
+/*
+ * The response chunks waiting for the socket, oldest first.
+ * Chunks sit in a vector consumed from the front; unlike std::deque it
+ * keeps its storage when it drains, so a keep-alive connection queues its
+ * responses without allocating once it has seen its largest one.
+ * push_back() may move the chunks, so references into the queue do not
+ * survive it.
+ */
+class OutputQueue
+{
+public:
+    bool empty() const { return head == chunks.size(); }
+    size_t size() const { return chunks.size() - head; }
+
+    OutputChunk &front() { return chunks[head]; }
+    OutputChunk &back() { return chunks.back(); }
+    OutputChunk &operator[](size_t i) { return chunks[head + i]; }
+
+    void push_back(OutputChunk &&chunk) { chunks.push_back(std::move(chunk)); }
+    void pop_front();
+
+private:
+    std::vector<OutputChunk> chunks;
+    size_t head = 0; // first chunk not sent yet
+};
+
+/*
+ * Bytes received but not yet consumed by the parser, held in a block of
+ * RECEIVE_BUFFER_SIZE bytes from the shared receive pool. The block is
+ * taken on the first read and given back as soon as everything in it has
+ * been consumed, so an idle keep-alive connection holds no receive memory.
+ */
+class ReceiveBuffer
+{
+public:
+    std::string_view view() const { return std::string_view(block.data(), length); }
+    size_t size() const { return length; }
+    bool full() const { return length == RECEIVE_BUFFER_SIZE; }
+
+    /*
+     * Returns the free space after the buffered bytes (taking a block if
+     * none is held); commit() then counts what was written there.
+     */
+    char *space();
+    void commit(size_t n) { length += n; }
+
+    /*
+     * Drops the first `n` bytes and gives the block back once it is empty.
+     */
+    void consume(size_t n);
+
+private:
+    PooledBuffer block;
+    size_t length = 0;
+};
+
+/*
+ * File bytes read ahead for a TLS connection that encrypts in user space:
+ * one pread() of up to FILE_READ_BLOCK bytes feeds several SSL_write()
+ * records. The block comes from a shared pool on first use and goes back
+ * once the output queue drains, so memory per connection stays bounded
+ * whatever the file size.
+ */
+struct FileReadBuffer
+{
+    PooledBuffer data;
+    std::shared_ptr<FileHandle> file; // file the bytes came from, held so its fd cannot be reused meanwhile
+    off_t offset = 0;
+    size_t length = 0;
+};
+
+/*
+ * A single non-blocking client socket owned by the event loop.
+ * Holds the receive buffer, the pending response chunks and, for HTTPS,
+ * the SSL object. The destructor shuts down TLS and closes the socket.
+ * A Connection with fd -1 is detached: an HTTP/2 session uses one to
+ * collect a stream's response, and it is never flushed.
+ */
+struct Connection
+{
+    Connection(int fd, SSL *ssl = nullptr);
+    ~Connection();
+
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    int fd;
+    SSL *ssl;
+    bool kernelTls = false; // the kernel encrypts this connection's writes (kTLS), so SSL_sendfile works
+    ConnState state;
+    ReceiveBuffer in;    // bytes received but not yet consumed by the parser
+    HttpParser parser;   // resumable parse state of the request at the front of `in`
+    OutputQueue out;     // response chunks waiting for the socket
+    size_t outSent = 0;          // how much of the front bytes chunk has already been written
+    std::string spareBytes;      // emptied bytes chunk, reused for the next response head
+    FileReadBuffer readBuffer;   // user-space TLS only: file block being encrypted
+    bool closeAfterWrite = false;
+
+    bool keepAlive = false;    // whether the response being built keeps the connection open
+    int status = 0;            // status code of the response being built (for metrics)
+    int requestsServed = 0;    // requests answered on this connection so far
+    std::atomic<int64_t> lastActive; // steady-clock milliseconds of the last activity
+    int64_t acceptedAtNs;            // monotonicNanos() at accept, for handshake timing
+    std::atomic<bool> handshakePending; // TLS handshake not finished yet; read by the idle sweep
+    uint32_t readyEvents = 0;           // epoll events the job now servicing the connection was queued for
+
+    std::shared_ptr<Http2Session> http2; // set once ALPN picked "h2": `in` and `out` then carry HTTP/2 frames
+    HpackEncoder *hpack = nullptr;       // detached stream connections: ResponseHead HPACK-encodes into `headerBlock`
+    std::string headerBlock;
+};
+
+/*
+ * TLS handshakes accepted but not finished yet, over all event loops.
+ * A Connection counts from construction until its handshake completes or
+ * it is destroyed.
+ */
+int pendingHandshakes();
+
+/*
+ * The pools behind ReceiveBuffer (RECEIVE_BUFFER_SIZE blocks) and
+ * FileReadBuffer (FILE_READ_BLOCK blocks), shared by all connections.
+ */
+BufferPool &receiveBufferPool();
+BufferPool &fileReadBufferPool();
+
+/*
+ * Milliseconds on the monotonic clock, used for connection idle tracking.
+ */
+int64_t monotonicMillis();
+
+/*
+ * Drives a pending TLS handshake with SSL_accept().
+ * Once it completes, clears `handshakePending` and records whether OpenSSL
+ * moved the write side to kTLS.
+ * Returns Done once the handshake is complete, WouldBlock on
+ * SSL_ERROR_WANT_READ/WANT_WRITE and Closed on failure.
+ */
+IoStatus continueHandshake(Connection &conn);
+
+/*
+ * Reads everything the socket currently has into `conn.in`, straight into
+ * its pooled block. Stops early (returning Done) once the block is full
+ * so a client cannot make us buffer unbounded data.
+ */
+IoStatus readAvailable(Connection &conn);
+
+/*
+ * Writes as much of `conn.out` as the socket accepts.
+ * Consecutive in-memory chunks (headers, borrowed bodies) are gathered into
+ * one sendmsg() on plain HTTP and into full records on HTTPS.
+ * File chunks go out with sendfile() on plain HTTP, with SSL_sendfile() on
+ * kTLS connections and through `readBuffer` (pread() then SSL_write()) on
+ * other HTTPS connections. It stops at the first write the socket refuses,
+ * so a slow reader holds at most one read block, never more of the file.
+ * Returns Done when everything has been sent.
+ */
+IoStatus flushOutput(Connection &conn);
+
+/*
+ * Fills `iov` (MAX_GATHER entries) with the run of in-memory chunks at the
+ * front of `conn.out`, up to the next file chunk, and returns how many
+ * entries it used; `fileFollows` tells whether a non-empty file chunk ends
+ * the run. This is what flushOutput() hands to one sendmsg().
+ */
+size_t gatherOutput(Connection &conn, struct iovec *iov, bool &fileFollows);
+
+/*
+ * Drops the first `sent` bytes of the in-memory chunks at the front of the
+ * queue once they have been written. An emptied bytes chunk hands its
+ * buffer back to `spareBytes`.
+ */
+void consumeOutput(Connection &conn, size_t sent);
+
+/*
+ * Returns the in-memory chunk at the end of the output queue for appending
+ * to, starting one (on the connection's recycled buffer) if the queue ends
+ * with borrowed memory or a file. Response heads are written straight
+ * into it.
+ */
+std::string &outputBuffer(Connection &conn);
+
+/*
+ * Appends bytes to the connection's output queue.
+ * Nothing is written here; the event loop flushes the queue.
+ */
+void queueOutput(Connection &conn, std::string_view data);
+
+/*
+ * Appends `length` bytes at `data` to the output queue without copying them.
+ * `owner` keeps the memory alive until the chunk has been sent.
+ */
+void queueBorrowed(Connection &conn, std::shared_ptr<const void> owner, const char *data, size_t length);
+
+/*
+ * Appends `length` bytes of `file`, starting at `offset`, to the output queue.
+ * The file stays open until the chunk has been sent.
+ */
+void queueFile(Connection &conn, std::shared_ptr<FileHandle> file, off_t offset, size_t length);
+
+#endif // CONNECTION_HPP
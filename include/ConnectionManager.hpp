@@ -2,28 +2,39 @@
 #define CONNECTIONMANAGER_HPP
 
 #include "../include/Config.hpp"
-#include <openssl/ssl.h>
-#include <openssl/err.h>
+#include "../include/Connection.hpp"
+#include "../include/HttpParser.hpp"
 
 /*
- * Handles a single client connection.
- * Intended to run in its own detached thread.
- *  1. Reads and parses the incoming HTTP request via receiveRequest().
- *  2. Logs the request line and headers.
- *  3. Serves the requested static file or sends an error response.
- *  4. Closes the client socket when finished.
+ * Handles a single parsed request on a client connection.
+ *  1. Logs the request line and headers.
+ *  2. Queues the requested static file or an error response on `conn`.
+ * Nothing is written to the socket here; the event loop flushes `conn.out`.
  */
-void handleClient(int client_fd, const std::string docRoot);
+void handleClient(Connection &conn, const HttpRequest &req, const std::string &docRoot);
 
-void handleClientSSL(int *ssl, const std::string docRoot);
+/*
+ * Parses and answers every complete request already buffered in `conn.in`,
+ * appending the responses to `conn.out` in request order (pipelining).
+ * Stops after a response that closes the connection. Moves `conn.state` to
+ * Writing once anything was answered; reads and writes nothing itself.
+ */
+void processRequests(Connection &conn, const Config &cfg);
 
 /*
- * Spawn a detached thread to handle a client connection.
- *
- * Creates a new std::thread that runs handleClient on the given socket
- * and detaches it so the main loop can immediately continue accepting new clients.
+ * Advances the connection's state machine as far as the socket allows
+ * without blocking. Called by the event loop whenever epoll reports activity:
+ *  1. Handshaking: continues the TLS handshake. If ALPN picked "h2", the
+ *                  connection gets an Http2Session, which queues its SETTINGS.
+ *  2. Reading:     reads available bytes and runs handleClient() for every
+ *                  complete request in the buffer, in order (400 on parse errors).
+ *                  On HTTP/2 the session consumes the frames instead and
+ *                  runs handleClient() once per stream.
+ *  3. Writing:     flushes the queued responses; keep-alive connections then
+ *                  return to Reading, others are closed. HTTP/2 connections
+ *                  first queue more DATA while the flow-control windows allow.
+ * Sets `conn.state` to ConnState::Closed when the connection should be released.
  */
-void spawnClientThreadHTTP(int client_fd, const std::string &docRoot);
+void driveConnection(Connection &conn, const Config &cfg);
 
-void spawnClientThreadHTTPS(int client_fd, SSL_CTX *sslCtx, const std::string &docRoot);
 #endif // CONNECTIONMANAGER_HPP
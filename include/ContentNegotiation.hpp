@@ -1,27 +1,75 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
-/**
- * @brief Splits a given string by commas and trims whitespace.
- *
- * @param s The input string to be split and trimmed.
- *
- * @details
- * This function processes the input string by:
- * 1. Using `std::istringstream` to treat the string as a stream.
- * 2. Calling `std::getline()` to extract tokens separated by commas.
- * 3. Removing leading and trailing spaces, tabs (`\t`), carriage returns (`\r`), and newlines (`\n`).
- * 4. Discarding tokens that consist only of whitespace.
- * 5. Storing the cleaned tokens in a vector.
- *
- * Example:
- * ```
- * std::string input = "  foo , bar  , baz\t";
- * splitAndTrim(input);
- * // Result: ["foo", "bar", "baz"]
- * ```
+/*
+ * A parsed Accept header: its media ranges with q-values, most specific
+ * first (a type with parameters, a type, a type wildcard, then the full
+ * wildcard).
+ *  - A representation's quality is the q of the most specific range that
+ *    matches it, so a q=0 range excludes what it matches unless a more
+ *    specific range accepts it. With no matching range it is 0.
+ *  - A range with parameters other than q only matches a type carrying
+ *    the same parameters.
+ *  - A missing header, or one without a single valid range, accepts
+ *    everything with q=1.
  */
-static std::vector<std::string> splitAndTrim(const std::string s);
+class AcceptList
+{
+public:
+    static AcceptList parse(std::string_view header);
 
-bool isAcceptable(const std::string &acceptHeader, const std::string &mimeType);
+    // Quality of `mimeType` in thousandths: 0 (refused) to 1000
+    int quality(std::string_view mimeType) const;
+
+    bool acceptsAll() const { return ranges.empty(); }
+
+private:
+    struct MediaRange
+    {
+        std::string type;    // lowercase "type/subtype", "type/*" or "*/*"
+        std::string params;  // lowercase parameters before q, e.g. "level=1"
+        int q;               // 0-1000
+        int specificity;     // 0 "*/*", 1 "type/*", 2 "type/subtype", 3 with parameters
+    };
+    std::vector<MediaRange> ranges;
+};
+
+/*
+ * The parsed form of `header`, memoized: each thread keeps the last few
+ * distinct headers it parsed, so the handful of Accept strings browsers
+ * send are parsed once per worker and then matched without allocating.
+ * The reference is valid until this thread's next call.
+ */
+const AcceptList &acceptListFor(std::string_view header);
+
+/*
+ * Whether `mimeType` has a non-zero quality under `acceptHeader`.
+ */
+bool isAcceptable(std::string_view acceptHeader, std::string_view mimeType);
+
+/*
+ * Content codings the server can apply to a response body.
+ */
+enum class ContentEncoding
+{
+    Identity,
+    Gzip,
+    Deflate
+};
+
+/*
+ * Picks the response coding from an Accept-Encoding header value.
+ *  - Honours q-values ("gzip;q=0" refuses gzip) and the "*" wildcard.
+ *  - Prefers gzip over deflate when both are equally acceptable.
+ *  - Falls back to Identity when the header is empty or names neither.
+ * Works on the header in place; nothing is allocated.
+ */
+ContentEncoding chooseEncoding(std::string_view acceptEncoding);
+
+/*
+ * Value of the Content-Encoding header for `encoding` ("gzip", "deflate"),
+ * or an empty string for Identity.
+ */
+const char *encodingName(ContentEncoding encoding);
@@ -0,0 +1,153 @@
+#ifndef DOCINDEX_HPP
+#define DOCINDEX_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "../include/Connection.hpp"
+
+/*
+ * How a file's body is opened when it is served.
+ *  - CacheContent:   small enough for the file cache; opened once when the
+ *                    cache loads it.
+ *  - KeepOpen:       too large to cache; the index holds a descriptor that
+ *                    every response streams from, so no open() per request.
+ *  - OpenPerRequest: too large to cache and past the open-descriptor budget.
+ */
+enum class HandlePolicy
+{
+    CacheContent,
+    KeepOpen,
+    OpenPerRequest
+};
+
+/*
+ * Metadata of one regular file under the document root.
+ */
+struct DocEntry
+{
+    std::string fullPath; // docRoot + URL path
+    std::string_view mime; // from `mimeOf`, which returns static storage
+    struct stat st;
+    HandlePolicy policy;
+    std::shared_ptr<FileHandle> handle; // set for KeepOpen
+};
+
+/*
+ * In-memory index of every regular file under the document root, keyed by
+ * normalized URL path ("/css/site.css").
+ *  - build() walks the tree once at startup; lookups then answer existence,
+ *    404s, HEAD and conditional requests from memory, without a stat().
+ *  - startWatching() keeps it current: an inotify watch on every directory
+ *    feeds a background thread that re-stats changed files, adds and drops
+ *    entries and whole subtrees, and rebuilds everything if the kernel's
+ *    event queue overflowed.
+ *  - Directory symlinks are not followed; file symlinks are indexed with
+ *    their target's metadata, but changes to a target outside the tree are
+ *    not seen.
+ *  - Readers take a shared lock; after startup only the watcher thread
+ *    writes.
+ */
+class DocIndex
+{
+public:
+    struct Stats
+    {
+        size_t files;
+        size_t directories;
+        uint64_t bytes;
+        size_t openHandles;
+        double buildSeconds; // duration of the last full build
+        uint64_t updates;    // entries changed by inotify events
+        uint64_t rebuilds;   // full rebuilds after a queue overflow
+    };
+
+    /*
+     * `mimeOf` maps a file path to its Content-Type. Files larger than
+     * `maxCachedSize` (too big for the file cache) get a KeepOpen
+     * descriptor while fewer than `maxOpenFiles` are open.
+     */
+    DocIndex(std::string docRoot, std::function<std::string_view(std::string_view)> mimeOf, size_t maxCachedSize,
+             size_t maxOpenFiles);
+    ~DocIndex();
+
+    DocIndex(const DocIndex &) = delete;
+    DocIndex &operator=(const DocIndex &) = delete;
+
+    /*
+     * Indexes the whole tree, replacing any previous contents.
+     * Throws FileException if docRoot cannot be read.
+     */
+    void build();
+
+    /*
+     * Creates the inotify instance, builds the index with every directory
+     * watched and starts the watcher thread. Returns false without building
+     * if inotify is unavailable; build() then gives a startup snapshot.
+     */
+    bool startWatching();
+
+    /*
+     * Returns the entry for a normalized URL path, or nullptr.
+     * A path ending in '/' means the index.html in that directory.
+     * Entries are immutable; an update publishes a new one.
+     */
+    std::shared_ptr<const DocEntry> lookup(std::string_view urlPath) const;
+
+    Stats stats() const;
+
+private:
+    using Map = std::unordered_map<std::string, std::shared_ptr<const DocEntry>>;
+
+    void scan(const std::string &urlDir, Map &into, size_t &directories);
+    std::shared_ptr<const DocEntry> makeEntry(const std::string &urlPath, const struct stat &st, const DocEntry *previous);
+    void refresh(const std::string &urlPath);
+    void addTree(const std::string &urlDir);
+    void removeTree(const std::string &urlDir);
+    void watchLoop();
+
+    std::string docRoot;
+    std::function<std::string_view(std::string_view)> mimeOf;
+    size_t maxCachedSize;
+    size_t maxOpenFiles;
+
+    // Descriptors held by entries; each entry gives its own back when destroyed
+    std::atomic<size_t> openHandles{0};
+
+    mutable std::shared_mutex mutex;
+    Map entries;
+
+    // Watcher thread only (and build() before it starts)
+    int inotifyFd = -1;
+    std::unordered_map<int, std::string> watches; // watch descriptor -> URL directory ending in '/'
+    std::thread watcher;
+    std::atomic<bool> stopping{false};
+
+    std::atomic<size_t> directories{0};
+    std::atomic<double> buildSeconds{0};
+    std::atomic<uint64_t> updates{0};
+    std::atomic<uint64_t> rebuilds{0};
+};
+
+/*
+ * Normalizes a request target into a URL path that can only name something
+ * under the document root:
+ *  - drops the query string and fragment,
+ *  - decodes %XX escapes,
+ *  - collapses repeated slashes and resolves "." and ".." segments
+ *    without ever climbing above "/".
+ * Returns false for malformed escapes, NUL bytes or a path not starting
+ * with '/'. Scratch space comes from `out`'s allocator, so a request arena
+ * serves the whole call.
+ */
+bool normalizeUrlPath(std::string_view target, std::pmr::string &out);
+
+#endif // DOCINDEX_HPP
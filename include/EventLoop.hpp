@@ -0,0 +1,76 @@
+#ifndef EVENTLOOP_HPP
+#define EVENTLOOP_HPP
+
+#include "../include/Config.hpp"
+#include "../include/Connection.hpp"
+#include "../include/ThreadPool.hpp"
+#include <openssl/ssl.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/*
+ * Edge-triggered epoll reactor that owns every listening and client socket.
+ *  - Listening sockets are non-blocking; each readiness edge accepts until
+ *    the accept queue is drained.
+ *  - Every accepted socket becomes a Connection whose state machine
+ *    (TLS handshake, request read, response write) is advanced by
+ *    driveConnection() whenever epoll reports activity.
+ *  - Client sockets are registered EPOLLONESHOT: a ready connection is
+ *    submitted to the worker pool as one job and re-armed by that job, so
+ *    exactly one worker touches a connection at a time.
+ *  - TLS handshakes run on the same non-blocking sockets and are resumed
+ *    on SSL_ERROR_WANT_READ/WANT_WRITE like any other I/O, so a client
+ *    stuck in its handshake holds memory, not a thread.
+ *  - Once per second the loop shuts down connections that have been idle
+ *    longer than Config::keepAliveTimeout, and handshakes older than
+ *    Config::tlsHandshakeTimeout; the resulting hang-up event lets the
+ *    owning job close them through the normal path.
+ *  - While Config::maxPendingHandshakes handshakes are unfinished, TLS
+ *    listeners stop accepting and new clients wait in the kernel backlog.
+ *  - No thread is created per connection: an idle client costs one
+ *    Connection object and one epoll registration.
+ *  - With Config::listenerShards > 1 main() runs one loop per shard, each
+ *    on its own thread with its own SO_REUSEPORT listeners; the loops share
+ *    the worker pool but no connection state.
+ */
+class EventLoop
+{
+public:
+    EventLoop(const Config &cfg, SSL_CTX *sslCtx, ThreadPool &pool);
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    /*
+     * Registers a bound and listening socket with the loop.
+     * Connections accepted on a `tls` listener start with a TLS handshake.
+     */
+    void addListener(int listenFd, bool tls);
+
+    /*
+     * Runs the reactor forever. Throws SocketException if epoll itself fails.
+     */
+    void run();
+
+private:
+    void acceptClients(int listenFd, bool tls);
+    void serviceConnection(Connection &conn, uint32_t events);
+    void rearm(Connection &conn);
+    void closeConnection(int fd);
+    void closeIdleConnections();
+
+    const Config &cfg;
+    SSL_CTX *sslCtx;
+    ThreadPool &pool;
+    int epollFd;
+    std::unordered_map<int, bool> listeners; // listening fd -> is TLS
+    bool tlsAcceptPaused = false;            // reactor thread only: the handshake cap was hit
+
+    // Written by the reactor (accept) and by workers (close)
+    std::mutex connectionsMutex;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+};
+
+#endif // EVENTLOOP_HPP
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string>
 #include <stdexcept>
 
@@ -48,6 +49,29 @@ public:
         : ServerException("File Parse Error: " + msg) {}
 };
 
+/*
+ * Thrown when an HPACK header block cannot be decoded.
+ */
+class HpackException : public ServerException
+{
+public:
+    explicit HpackException(const std::string &msg)
+        : ServerException("HPACK Error: " + msg) {}
+};
+
+/*
+ * Thrown when an HTTP/2 peer breaks the protocol; `errorCode` is the
+ * RFC 9113 error code its GOAWAY carries.
+ */
+class Http2Exception : public ServerException
+{
+public:
+    Http2Exception(uint32_t errorCode, const std::string &msg)
+        : ServerException("HTTP/2 Error: " + msg), errorCode(errorCode) {}
+
+    uint32_t errorCode;
+};
+
 class SSLException : public ServerException
 {
 public:
@@ -0,0 +1,141 @@
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+#include "../include/ContentNegotiation.hpp"
+
+/*
+ * One file held in memory by the FileCache.
+ * Entries are immutable once published; a changed file gets a new entry,
+ * so anything derived from `content` is computed once per file version.
+ */
+struct CachedFile
+{
+    std::string content;
+    std::string_view mime; // static storage, see getMimeType()
+    size_t size;
+    int64_t mtimeNs; // modification time in nanoseconds since the epoch
+    ino_t inode;
+
+    /*
+     * Returns `content` compressed with `encoding` (Gzip or Deflate).
+     * The first caller compresses and the result is kept with the entry;
+     * concurrent callers for the same coding wait for it instead of
+     * compressing twice.
+     * Returns nullptr if compression failed or did not make the body smaller.
+     * Variants are not charged to the cache budget; each is smaller than
+     * `content`, so an entry costs at most three times its size.
+     */
+    std::shared_ptr<const std::string> compressed(ContentEncoding encoding) const;
+
+private:
+    mutable std::mutex variantMutex;
+    mutable std::shared_ptr<const std::string> variants[2]; // gzip, deflate
+    mutable bool variantBuilt[2] = {false, false};
+};
+
+/*
+ * Byte-budgeted, sharded LRU cache of static file contents.
+ *  - Keys are full filesystem paths; each key hashes to one of SHARD_COUNT
+ *    shards with its own mutex, LRU list and share of the byte budget, so
+ *    concurrent lookups of different files rarely contend.
+ *  - Callers pass the result of a fresh stat(): an entry whose size, mtime
+ *    or inode differ is treated as stale and reloaded.
+ *  - Entries are handed out as shared_ptr, so an evicted entry stays valid
+ *    for responses that are still being sent.
+ */
+class FileCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t bytes;
+        size_t entries;
+        size_t capacity;
+    };
+
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr size_t MAX_ENTRY_SIZE = 1024 * 1024; // larger files are streamed, not cached
+
+    explicit FileCache(size_t capacityBytes);
+
+    /*
+     * Whether a file of this size can be cached at all.
+     */
+    bool cacheable(size_t size) const;
+
+    /*
+     * Largest cacheable file size.
+     */
+    size_t maxEntrySize() const;
+
+    /*
+     * Returns the cached contents of `fullPath`, loading them from disk on a
+     * miss or when `st` shows the cached copy is stale. `mime` is stored with
+     * a newly loaded entry.
+     * Returns nullptr if the file cannot be read or is not cacheable.
+     */
+    std::shared_ptr<const CachedFile> get(const std::string &fullPath, const struct stat &st, std::string_view mime);
+
+    /*
+     * Like get(), but never touches the disk: returns the entry only if it
+     * is already cached and still matches `st`, otherwise nullptr.
+     */
+    std::shared_ptr<const CachedFile> find(const std::string &fullPath, const struct stat &st);
+
+    /*
+     * Like find(), but counts a miss when it returns nullptr, for callers
+     * that read the file themselves and publish it with put().
+     */
+    std::shared_ptr<const CachedFile> probe(const std::string &fullPath, const struct stat &st);
+
+    /*
+     * Publishes `content`, read by the caller, as the cached copy of
+     * `fullPath`. `st` must come from fstat() on the descriptor it was read
+     * from; content of a different size is dropped.
+     */
+    void put(const std::string &fullPath, const struct stat &st, std::string_view mime, std::string content);
+
+    Stats stats() const;
+
+private:
+    struct Shard
+    {
+        std::mutex mutex;
+        // Most recently used entries at the front
+        std::list<std::pair<std::string, std::shared_ptr<const CachedFile>>> lru;
+        std::unordered_map<std::string, decltype(lru)::iterator> index;
+        size_t bytes = 0;
+    };
+
+    Shard &shardFor(const std::string &fullPath);
+    std::shared_ptr<const CachedFile> lookup(Shard &shard, const std::string &fullPath, const struct stat &st);
+    void insert(Shard &shard, const std::string &fullPath, std::shared_ptr<const CachedFile> entry);
+
+    size_t capacity;
+    size_t shardCapacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+};
+
+/*
+ * Modification time of a stat() result in nanoseconds since the epoch.
+ */
+int64_t mtimeNanos(const struct stat &st);
+
+#endif // FILECACHE_HPP
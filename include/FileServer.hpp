@@ -2,49 +2,150 @@
 #define FILESERVER_HPP
 
 #include <string>
-#include <openssl/ssl.h>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include "../include/Connection.hpp"
+#include "../include/FileCache.hpp"
+#include "../include/DocIndex.hpp"
+#include "../include/MimeTypes.hpp"
 
 /*
- * Determines the Content-Type header value based on the file extension in `path`.
- *  - Finds the last '.' in the filename.
- *  - Converts the extension to lowercase.
- *  - Looks up and returns a matching MIME type (e.g., "html" → "text/html").
- *  - Defaults to "application/octet-stream" if the extension is unknown.
+ * A request path resolved under the document root by peekFile().
+ *  - entry:   the file's DocEntry: full path (a directory maps to its
+ *             index.html), Content-Type, metadata and, for large files the
+ *             index keeps open, the descriptor. It is shared with the
+ *             docRoot index, so resolving a path copies nothing; without the
+ *             index it is made from a stat() taken during the lookup.
+ *             serveStaticFile() uses its metadata to revalidate the file
+ *             cache without touching the disk again.
+ *  - indexed: `entry` comes from the inotify-maintained index.
  */
-std::string getMimeType(const std::string &path);
+struct StaticFile
+{
+    std::shared_ptr<const DocEntry> entry;
+    bool indexed = false;
+};
 
 /*
- * Serves a static file over HTTP:
- *  - Constructs the full file path using the document root and request path.
- *  - If the path is "/", defaults to serving "index.html".
- *  - Opens the file in binary mode; on failure sends a 404 response.
- *  - Reads the entire file into memory, determines its MIME type,
- *    and sends it using sendResponse().
+ * Creates the shared in-memory file cache with a budget of `capacityBytes`.
+ * A budget of 0 disables caching. Must be called before serving requests.
  */
-void serveStaticFile(int fd, const std::string &path, const std::string &docRoot);
+void initFileCache(size_t capacityBytes);
 
-void serveStaticFileSSL(SSL *ssl, const std::string &path, const std::string &docRoot);
+/*
+ * Hit/miss/eviction counters and occupancy of the file cache.
+ */
+FileCache::Stats fileCacheStats();
+
+/*
+ * Loads file cache misses off the request path. An I/O backend that can
+ * read files asynchronously (the io_uring loop) installs one for its thread
+ * with setCacheFiller(); serveStaticFile() on that thread then streams a
+ * missed file from its descriptor and hands it to fill() instead of
+ * reading it into the cache before answering. Until the copy lands, such
+ * responses carry the stat-based ETag of an uncached file.
+ */
+class CacheFiller
+{
+public:
+    virtual ~CacheFiller() = default;
+
+    /*
+     * Starts reading `file` (the descriptor being streamed, `st` its
+     * fstat()) and publishes it with storeInFileCache() when done. May
+     * decline, e.g. while the same path is already being read.
+     */
+    virtual void fill(std::shared_ptr<FileHandle> file, const std::string &fullPath, const struct stat &st, std::string_view mime) = 0;
+};
+
+/*
+ * Installs `filler` for the calling thread; nullptr restores inline loads.
+ */
+void setCacheFiller(CacheFiller *filler);
 
 /*
- * Sends a complete HTTP/1.1 response over the socket FD:
- *  - Builds the status line ("HTTP/1.1 200 OK") and headers:
- *      Content-Type, Content-Length, Connection: close
- *  - Appends the message body.
- *  - Writes the full response, looping until all bytes are sent.
+ * Publishes the contents a CacheFiller read, see FileCache::put().
  */
-void sendResponse(int fd, const std::string &body, const std::string &contentType = "text/plain");
+void storeInFileCache(const std::string &fullPath, const struct stat &st, std::string_view mime, std::string content);
 
-void sendResponseSSL(SSL *ssl, const std::string &body, const std::string &contentType);
+/*
+ * Builds the in-memory index of `docRoot` that peekFile() answers from and
+ * starts watching it with inotify; large files keep up to `maxOpenFiles`
+ * descriptors open. Call after initFileCache(). Logs the startup time.
+ * Throws FileException if docRoot cannot be read.
+ */
+void initDocIndex(const std::string &docRoot, size_t maxOpenFiles);
 
 /*
- * Write the entire contents of `data` to the socket `fd`.
- * Loops on write() until all bytes are sent or an error occurs.
+ * Size, build time and update counters of the docRoot index (zero when
+ * it is disabled).
  */
-void sendRaw(int fd, const std::string &data);
+DocIndex::Stats docIndexStats();
 
-void sendRaw(SSL *ssl, const std::string &data);
+/*
+ * Installs the Cache-Control rules from the config: (path prefix or MIME
+ * type, header value) pairs. Must be called before serving requests.
+ */
+void initCacheControl(const std::vector<std::pair<std::string, std::string>> &rules);
 
-// return (found, content, mime)
-bool peekFile(const std::string &path, const std::string &docRoot, std::string &content, std::string &mime);
+/*
+ * Answers a conditional GET/HEAD for a file found by peekFile():
+ *  - If-None-Match is compared (weakly) against the file's ETag;
+ *    otherwise If-Modified-Since against its mtime.
+ *  - When the client's copy is current, queues a bodiless 304 with the
+ *    validators and returns true.
+ * Costs no file read: the ETag comes from the stat() or the cache entry.
+ */
+bool sendNotModified(Connection &conn, const HttpRequest &req, const StaticFile &file);
+
+/*
+ * Serves a static file found by peekFile() on the connection (HTTP or HTTPS)
+ * in answer to a GET or HEAD `req` (HEAD gets the same headers, no body):
+ *  - Files that fit the file cache are served from RAM: the cached entry is
+ *    revalidated against `file.st` and queued without copying. A miss is
+ *    loaded first, or streamed and handed to the thread's CacheFiller.
+ *  - Compressible cached files are sent gzip/deflate encoded when the
+ *    request's Accept-Encoding allows it; the compressed body is kept with
+ *    the cache entry, and such responses carry Vary: Accept-Encoding.
+ *  - Other files are opened once; Content-Length comes from fstat() on that
+ *    descriptor and the body is streamed with sendfile() on plain HTTP.
+ *  - A GET with a Range header (and a matching If-Range, if any) gets a 206
+ *    with the requested bytes, as multipart/byteranges for several ranges,
+ *    or a 416 if none overlaps the file. Ranges stream from the file at
+ *    their offsets (or from the cache entry) and are never compressed.
+ *  - Every response carries a strong ETag (content hash of the cache entry,
+ *    or inode-size-mtime), Last-Modified and any matching Cache-Control rule.
+ *  - Queues a 404 response if the file disappeared in the meantime.
+ */
+void serveStaticFile(Connection &conn, const HttpRequest &req, const StaticFile &file);
+
+/*
+ * Queues a complete HTTP/1.1 response on the connection:
+ *  - Writes the head through ResponseHead: status line ("HTTP/1.1 200 OK"),
+ *      Server, Date, Content-Type, Content-Length, Connection
+ *  - Queues the body after it: copied behind the head if short, otherwise
+ *    moved into the queue and sent in the same gathered write. With
+ *    `headOnly` (a HEAD request) only the head is queued.
+ *  - The event loop flushes the bytes when the socket is writable.
+ */
+void sendResponse(Connection &conn, std::string body, const std::string &contentType = "text/plain", bool headOnly = false);
+
+/*
+ * Queue the entire contents of `data` on the connection as-is.
+ */
+void sendRaw(Connection &conn, const std::string &data);
+
+/*
+ * Looks up a static file without reading it.
+ *  - The request path is normalized first (normalizeUrlPath), so ".."
+ *    segments and escapes cannot reach outside docRoot.
+ *  - With the docRoot index the answer comes from memory; otherwise it
+ *    costs a single stat().
+ * Returns false if it does not exist or is not a regular file;
+ * otherwise fills in `file` (full path, MIME type and metadata).
+ */
+bool peekFile(std::string_view path, const std::string &docRoot, StaticFile &file);
 
 #endif // FILESERVER_HPP
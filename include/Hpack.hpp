@@ -0,0 +1,156 @@
+#ifndef HPACK_HPP
+#define HPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../include/Exception.hpp"
+
+/*
+ * HPACK header compression for HTTP/2 (RFC 7541): integer and string
+ * primitives, the Huffman code, the static table and the dynamic tables of
+ * both directions. Each HTTP/2 connection owns one decoder for its
+ * requests and one encoder for its responses; both are single-threaded.
+ */
+
+// Size of the dynamic tables both sides start with (SETTINGS_HEADER_TABLE_SIZE)
+constexpr size_t HPACK_DEFAULT_TABLE_SIZE = 4096;
+
+struct HpackField
+{
+    std::string name;
+    std::string value;
+};
+
+/*
+ * A dynamic table: the most recently added field has index 0, and the
+ * oldest fields are evicted once the size (name + value + 32 bytes per
+ * field) would exceed the limit. Evicted slots keep their string buffers,
+ * so a warmed-up table adds fields without allocating.
+ */
+class HpackTable
+{
+public:
+    explicit HpackTable(size_t maxSize) : maxSize(maxSize) {}
+
+    size_t count() const { return entries; }
+    const HpackField &operator[](size_t i) const { return ring[(head + entries - 1 - i) & (ring.size() - 1)]; }
+
+    /*
+     * Adds a field, evicting as needed. A field larger than the whole
+     * table empties it and is not added.
+     */
+    void add(std::string_view name, std::string_view value);
+
+    /*
+     * Changes the size limit, evicting the oldest fields until it holds.
+     */
+    void resize(size_t newMaxSize);
+    size_t limit() const { return maxSize; }
+
+private:
+    void evictOldest();
+
+    std::vector<HpackField> ring; // power-of-two capacity; the oldest field is at `head`
+    size_t head = 0;
+    size_t entries = 0;
+    size_t size = 0;
+    size_t maxSize;
+};
+
+/*
+ * Decodes the header blocks of one connection's requests.
+ * Throws HpackException for anything malformed (bad integers or Huffman
+ * padding, out-of-range indexes, a table size update above the limit or
+ * after the first field); HTTP/2 answers that with COMPRESSION_ERROR.
+ */
+class HpackDecoder
+{
+public:
+    /*
+     * Decodes `block` and calls `field(name, value)` for each field in
+     * order. The views are only valid during the call.
+     */
+    template <typename F>
+    void decode(std::string_view block, F &&field);
+
+private:
+    // Decodes one field representation at `pos`; returns false for a table size update
+    bool next(std::string_view block, size_t &pos, std::string_view &name, std::string_view &value);
+    std::string_view readString(std::string_view block, size_t &pos, std::string &scratch);
+
+    HpackTable table{HPACK_DEFAULT_TABLE_SIZE};
+    std::string nameScratch, valueScratch; // Huffman-decoded or copied literals
+};
+
+/*
+ * Encodes the header blocks of one connection's responses.
+ *  - A field found in the static or dynamic table is one index, usually
+ *    a single byte.
+ *  - Otherwise the name is referenced by index when possible and the
+ *    value is written Huffman-coded if that is shorter. The field is then
+ *    added to the dynamic table, unless its value is unlikely to repeat
+ *    (content-length, etag, content-range).
+ * Names are lowercased as HTTP/2 requires.
+ */
+class HpackEncoder
+{
+public:
+    /*
+     * Starts a header block in `out`, announcing a pending table size
+     * change first.
+     */
+    void begin(std::string &out);
+
+    void encode(std::string &out, std::string_view name, std::string_view value);
+    void encodeStatus(std::string &out, int status);
+
+    /*
+     * Applies the peer's SETTINGS_HEADER_TABLE_SIZE. The encoder never uses
+     * more than HPACK_DEFAULT_TABLE_SIZE, and the next block tells the peer
+     * about the change.
+     */
+    void setPeerTableSize(uint32_t peerSize);
+
+private:
+    HpackTable table{HPACK_DEFAULT_TABLE_SIZE};
+    bool sizeUpdatePending = false;
+    size_t pendingSize = HPACK_DEFAULT_TABLE_SIZE;         // limit to announce in the next block
+    size_t smallestPendingSize = HPACK_DEFAULT_TABLE_SIZE; // lowest limit since the last block
+};
+
+/*
+ * The primitives, exposed for the frame layer and benchmarks.
+ *  - hpackEncodeInteger() writes `value` with an N-bit prefix whose high
+ *    bits are `flags`.
+ *  - huffmanEncodedLength() is the size huffmanEncode() appends.
+ *  - huffmanDecode() appends the decoded bytes to `out` and throws
+ *    HpackException for invalid codes or padding.
+ */
+void hpackEncodeInteger(std::string &out, uint64_t value, int prefixBits, uint8_t flags);
+size_t huffmanEncodedLength(std::string_view text);
+void huffmanEncode(std::string &out, std::string_view text);
+void huffmanDecode(std::string_view code, std::string &out);
+
+template <typename F>
+void HpackDecoder::decode(std::string_view block, F &&field)
+{
+    size_t pos = 0;
+    bool sawField = false;
+    while (pos < block.size())
+    {
+        std::string_view name, value;
+        if (!next(block, pos, name, value))
+        {
+            if (sawField)
+                throw HpackException("table size update after a header field");
+            continue;
+        }
+        sawField = true;
+        field(name, value);
+    }
+}
+
+#endif // HPACK_HPP
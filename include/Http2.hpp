@@ -0,0 +1,153 @@
+#ifndef HTTP2_HPP
+#define HTTP2_HPP
+
+#include "../include/Config.hpp"
+#include "../include/Connection.hpp"
+#include "../include/Hpack.hpp"
+#include "../include/HttpParser.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Answers one request that arrived on an HTTP/2 stream by queueing the
+ * response on `response`, exactly as on an HTTP/1.1 connection (see
+ * handleClient()).
+ */
+using Http2RequestHandler = void (*)(Connection &response, const HttpRequest &req, const Config &cfg);
+
+/*
+ * The server side of one HTTP/2 connection (RFC 9113), layered on a TLS
+ * Connection whose ALPN negotiated "h2". Frames are read from `conn.in`
+ * and written to `conn.out`, so the event loop drives it like any other
+ * connection:
+ *  - Every request (HEADERS, plus CONTINUATION) is decoded with HPACK and
+ *    answered at once through the handler, on a detached Connection
+ *    whose ResponseHead HPACK-encodes the head. Its body chunks (cached
+ *    bytes, generated bytes or file ranges) become the stream's pending
+ *    DATA.
+ *  - Responses share the connection: each pass frames up to one
+ *    SETTINGS_MAX_FRAME_SIZE per stream in turn, within the stream and
+ *    connection flow-control windows and a budget that keeps `conn.out`
+ *    short, so small responses are not stuck behind a large file.
+ *  - File bodies are read into their frames, so a 9-byte frame header
+ *    shares its TLS record with the payload.
+ *  - At most Config::http2MaxStreams responses are in progress at once;
+ *    further streams are refused (RST_STREAM REFUSED_STREAM). After
+ *    Config::maxKeepAliveRequests streams a GOAWAY asks the client to
+ *    move to a new connection.
+ *  - Request bodies are not read: their DATA is discarded and credited
+ *    back, so a client still uploading when its response arrives can
+ *    finish.
+ *  - Protocol violations close the connection with GOAWAY; malformed
+ *    requests only reset their stream.
+ * One job drives a connection at a time, so none of this is locked.
+ */
+class Http2Session
+{
+public:
+    Http2Session(const Config &cfg, Http2RequestHandler handler);
+    ~Http2Session();
+
+    Http2Session(const Http2Session &) = delete;
+    Http2Session &operator=(const Http2Session &) = delete;
+
+    /*
+     * Queues the server preface (our SETTINGS) on `conn` and moves it to
+     * Writing.
+     */
+    void start(Connection &conn);
+
+    /*
+     * Consumes every frame buffered in `conn.in`, answering requests and
+     * control frames, then queues what DATA the windows allow. Moves
+     * `conn.state` to Writing when anything was queued and sets
+     * `conn.closeAfterWrite` once the connection is finished (GOAWAY sent
+     * or received and no response left, or a connection error).
+     */
+    void process(Connection &conn);
+
+    /*
+     * Called when `conn.out` has drained: queues the next DATA frames.
+     * Returns true if there is something to write; otherwise the
+     * connection waits for the client (e.g. a WINDOW_UPDATE).
+     */
+    bool refill(Connection &conn);
+
+private:
+    struct Stream;
+    struct FrameHeader
+    {
+        uint32_t length;
+        uint8_t type;
+        uint8_t flags;
+        uint32_t streamId;
+    };
+
+    void handleFrame(Connection &conn, const FrameHeader &frame, std::string_view payload);
+    void handleSettings(Connection &conn, const FrameHeader &frame, std::string_view payload);
+    void handleWindowUpdate(Connection &conn, const FrameHeader &frame, std::string_view payload);
+    void handleHeaderBlock(Connection &conn, uint32_t streamId, std::string_view block);
+    bool decodeRequest(std::string_view block, HttpRequest &req);
+    void respond(Connection &conn, uint32_t streamId, const HttpRequest &req);
+    void queueHeaders(Connection &conn, uint32_t streamId, std::string_view block, bool endStream);
+    bool queueData(Connection &conn);
+    bool queueDataFrame(Connection &conn, Stream &stream, size_t length);
+    void resetStream(Connection &conn, uint32_t streamId, uint32_t errorCode);
+    void goAway(Connection &conn, uint32_t errorCode);
+    Stream *findStream(uint32_t streamId);
+    void finish(Connection &conn);
+
+    const Config &cfg;
+    Http2RequestHandler handler;
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+    Connection response; // detached (fd -1): collects one stream's response from the handler
+
+    bool prefaceReceived = false;  // the client's 24-byte preface
+    bool settingsReceived = false; // its first SETTINGS, which must follow the preface
+    bool goAwaySent = false;
+    bool goAwayReceived = false;
+    uint32_t lastStreamId = 0;  // highest stream the client has opened
+    uint32_t streamsOpened = 0; // requests answered, for Config::maxKeepAliveRequests
+
+    // Header block split over HEADERS and CONTINUATION frames
+    uint32_t continuationStream = 0;
+    std::string headerFragments;
+
+    // A frame too large for the receive buffer, gathered across reads
+    FrameHeader oversizedFrame{};
+    std::string oversizedPayload;
+    size_t oversizedMissing = 0;
+
+    // Decoded request fields; the HttpRequest handed to the handler points here
+    std::string fieldText;
+
+    // Flow control of what we send, and DATA received but not credited back yet
+    int64_t connectionWindow;
+    int64_t initialStreamWindow;
+    uint32_t peerMaxFrameSize;
+    uint32_t uncreditedData = 0;
+
+    std::vector<Stream> streams; // responses with DATA left to send, in arrival order
+    size_t nextStream = 0;       // where the next round-robin pass starts
+};
+
+/*
+ * Whether ALPN selected "h2" during this connection's TLS handshake.
+ */
+bool negotiatedHttp2(const Connection &conn);
+
+struct Http2Stats
+{
+    uint64_t connections;      // connections that negotiated h2
+    uint64_t streams;          // requests answered on streams
+    uint64_t streamsReset;     // streams we reset: refused, malformed or flow-control errors
+    uint64_t connectionErrors; // connections closed with a GOAWAY error code
+    uint64_t headerBytes;      // HPACK-encoded response header block bytes
+};
+
+Http2Stats http2Stats();
+
+#endif // HTTP2_HPP
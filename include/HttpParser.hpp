@@ -1,26 +1,138 @@
 #ifndef HTTPPARSER_HPP
 #define HTTPPARSER_HPP
 
-#include <map>    // for std::map
-#include <string> // for std::string
-#include <openssl/ssl.h>
+#include <array>       // for std::array
+#include <cstdint>     // for uint32_t
+#include <string_view> // for std::string_view
 
 constexpr size_t MAX_REQ_SIZE = 8192;
+constexpr size_t MAX_HEADERS = 64;
 
-// A basic HTTP request
+// One header field; both views point into the connection's receive buffer
+struct HttpHeader
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+/*
+ * Small flat list of header fields stored inline (no heap allocation).
+ * Lookup is a linear, case-insensitive scan, which beats hashing for the
+ * dozen or so headers a real request carries.
+ */
+class HeaderList
+{
+public:
+    const HttpHeader *begin() const { return items.data(); }
+    const HttpHeader *end() const { return items.data() + count; }
+    size_t size() const { return count; }
+    bool full() const { return count == items.size(); }
+
+    void clear() { count = 0; }
+    void push(std::string_view name, std::string_view value) { items[count++] = HttpHeader{name, value}; }
+
+    /*
+     * Returns the value of header `name`, matched case-insensitively
+     * as HTTP requires, or an empty view if the header is absent.
+     */
+    std::string_view find(std::string_view name) const;
+
+private:
+    std::array<HttpHeader, MAX_HEADERS> items;
+    size_t count = 0;
+};
+
+/*
+ * A parsed HTTP request head. All fields are views into the receive buffer
+ * the request was parsed from and are only valid until that buffer changes.
+ */
 struct HttpRequest
 {
-    std::string method;
-    std::string path;
-    std::string version;
-    std::map<std::string, std::string> headers;
+    std::string_view method;
+    std::string_view path;
+    std::string_view version;
+    HeaderList headers;
 };
 
 /*
- * When the headers end, two consecutive "\r\n" sequences appear, forming an empty line. This marks the end of the headers.
- * The code continues reading from the socket until this double blank line ("\r\n\r\n") is encountered, ensuring all headers (request line and header lines) are read.
+ * Resumable state-machine parser for HTTP/1.x request heads.
+ *
+ * The parser works directly on the connection's receive buffer: it never
+ * copies bytes, never allocates, and remembers where it stopped, so a request
+ * that trickles in over many reads is scanned only once. Line endings, ':'
+ * and spaces are located with the SIMD scanner from SimdScan.hpp. Positions are kept
+ * as offsets because the buffer may be reallocated between calls; views are
+ * handed out only once the request is complete.
+ *
+ * When the headers end, two consecutive "\r\n" sequences appear, forming an empty
+ * line. This marks the end of the headers. Bare "\n" line endings are tolerated.
+ */
+class HttpParser
+{
+public:
+    /*
+     * Continues parsing the request at the front of `buffer`.
+     *  - Returns false while the request head is incomplete; call again with
+     *    the same buffer start once more bytes have arrived.
+     *  - Returns true once the empty line is seen and fills `req`; consumed()
+     *    then tells how many bytes of `buffer` belonged to this request.
+     *  - Throws HttpParseException if the request is malformed, has more than
+     *    MAX_HEADERS headers, or its head exceeds MAX_REQ_SIZE.
+     */
+    bool parse(std::string_view buffer, HttpRequest &req);
+
+    /*
+     * Size of the request head returned by the last successful parse().
+     */
+    size_t consumed() const { return pos; }
+
+    /*
+     * Forgets the current request so the next parse() starts a new one.
+     */
+    void reset();
+
+private:
+    struct Span
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+    struct HeaderSpan
+    {
+        Span name;
+        Span value;
+    };
+
+    enum class State
+    {
+        RequestLine,
+        Headers,
+        Complete
+    };
+
+    void parseRequestLine(std::string_view line, size_t lineStart);
+    void parseHeaderLine(std::string_view line, size_t lineStart);
+
+    State state = State::RequestLine;
+    size_t pos = 0;     // start of the first line not parsed yet
+    size_t scanned = 0; // bytes already searched for the next line ending
+    Span method{}, path{}, version{};
+    std::array<HeaderSpan, MAX_HEADERS> headerSpans;
+    size_t headerCount = 0;
+};
+
+/*
+ * Decides whether the connection may stay open after answering `req`:
+ *  - HTTP/1.1 defaults to keep-alive unless the Connection list has "close".
+ *  - HTTP/1.0 defaults to close unless it has "keep-alive" (and not "close").
+ * Connection is matched token by token, e.g. "close, TE" closes.
+ *  - Requests carrying a body are never kept alive, since the body is not read.
+ */
+bool wantsKeepAlive(const HttpRequest &req);
+
+/*
+ * Case-insensitive ASCII comparison, as used for header names and tokens.
  */
-HttpRequest receiveRequest(int fd);
+bool equalsIgnoreCase(std::string_view a, std::string_view b);
 
-HttpRequest receiveRequestSSL(SSL *ssl);
-#endif // HTTPPARSER_HPP
\ No newline at end of file
+#endif // HTTPPARSER_HPP
@@ -1,12 +1,64 @@
 #pragma once
+#include <cstdint>
+#include <ctime>
 #include <string>
+#include <string_view>
+#include "../include/Connection.hpp"
 
 /*
- * Send a generic HTTP error response over socket `fd`.
+ * Writes a response head straight into the connection's output buffer
+ * (see outputBuffer()), with no intermediate string per response.
+ *  - The constructor sets conn.status and writes the status line, then
+ *    "Server:" and "Date:". Status lines of the codes this server sends are
+ *    pre-rendered; others are formatted from `reason`. The Date line is
+ *    rendered once per second per thread.
+ *  - header() appends one "Name: value" line.
+ *  - end() appends the Connection line matching conn.keepAlive and the
+ *    blank line that ends the head.
+ * A body queued after end() (bytes, borrowed memory or a file) is sent
+ * together with the head by flushOutput(). Nothing else may be queued on
+ * the connection before end(): the head writes into the last chunk.
+ * On a connection collecting an HTTP/2 response (conn.hpack set) the same
+ * calls HPACK-encode ":status", lowercased fields and no Connection line
+ * into conn.headerBlock instead, and the body goes to conn.out as usual.
+ */
+class ResponseHead
+{
+public:
+    ResponseHead(Connection &conn, int status, std::string_view reason = {});
+
+    ResponseHead &header(std::string_view name, std::string_view value);
+    ResponseHead &header(std::string_view name, uint64_t value);
+    void end();
+
+private:
+    Connection &conn;
+    std::string &out;
+};
+
+/*
+ * Queue a generic HTTP error response on the connection.
  *  - status: örn. 404, 405, 500
  *  - reason: örn. "Not Found", "Method Not Allowed", "Internal Server Error"
  *  - body:   hata sayfası gövdesi, örn. basit HTML
+ *  - headOnly: HEAD isteği; Content-Length gövdeninki olur ama gövde gönderilmez
  */
-void sendErrorResponse(int fd, int status, const std::string &reason, const std::string &body = "");
+void sendErrorResponse(Connection &conn, int status, const std::string &reason, const std::string &body = "",
+                       bool headOnly = false);
+
+// Length of an IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT"
+constexpr size_t HTTP_DATE_LENGTH = 29;
 
-static void writeAll(int fd, const std::string &data);
+/*
+ * Formats `t` as an HTTP date (IMF-fixdate), e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+ * The second form writes HTTP_DATE_LENGTH characters and a NUL into `out`.
+ * Times outside years 0000-9999 are clamped to the nearest representable date.
+ */
+std::string formatHttpDate(time_t t);
+void formatHttpDate(time_t t, char *out);
+
+/*
+ * Parses an IMF-fixdate HTTP date into `t`.
+ * Returns false for anything else; callers then ignore the header that held it.
+ */
+bool parseHttpDate(std::string_view value, time_t &t);
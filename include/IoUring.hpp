@@ -0,0 +1,143 @@
+#ifndef IOURING_HPP
+#define IOURING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <linux/io_uring.h>
+
+/*
+ * A minimal io_uring instance driven through the raw system calls (no
+ * liburing):
+ *  - The submission and completion rings are mapped once. get() hands out
+ *    SQEs by writing into shared memory, submitAndWait() submits them and
+ *    waits for completions in the same io_uring_enter(), and
+ *    forEachCompletion() reaps CQEs without any system call.
+ *  - Set up with SINGLE_ISSUER and DEFER_TASKRUN where the kernel has
+ *    them (6.1+): completions are only processed while the owner waits,
+ *    so exactly one thread may use the ring.
+ *  - Optionally owns a provided-buffer ring (addBufferRing()): receives
+ *    submitted with IOSQE_BUFFER_SELECT take a buffer only once data has
+ *    arrived, so a waiting receive holds no memory.
+ * Throws SocketException if the kernel has no usable io_uring (too old,
+ * disabled by sysctl or blocked by a seccomp filter).
+ */
+class IoUring
+{
+public:
+    explicit IoUring(unsigned entries);
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    /*
+     * Binds the ring to the calling thread, which must be the only one to
+     * use it from then on. Call before the first submission.
+     */
+    void enable();
+
+    /*
+     * Returns a zeroed SQE to fill in. If the submission ring is full the
+     * pending entries are submitted first, so the first SQE of an
+     * IOSQE_IO_LINK chain must come after reserve() for the whole chain.
+     */
+    io_uring_sqe *get();
+
+    /*
+     * Makes room for `count` more SQEs, submitting the pending ones if
+     * fewer slots are free. A linked chain reserves its length up front:
+     * split across two submissions, its first part would run as a chain
+     * of its own. Throws SocketException if the room cannot be made.
+     */
+    void reserve(unsigned count);
+
+    /*
+     * Submits everything prepared since the last call and waits until at
+     * least `waitNr` completions are available or `timeoutMs` has passed,
+     * in one system call. Returns false on timeout or interruption.
+     * Throws SocketException if io_uring_enter() itself fails.
+     */
+    bool submitAndWait(unsigned waitNr, int timeoutMs);
+
+    /*
+     * Calls `handle(const io_uring_cqe &)` for every available completion,
+     * oldest first, and returns how many there were. The handler may
+     * prepare new SQEs.
+     */
+    template <typename F>
+    unsigned forEachCompletion(F &&handle);
+
+    /*
+     * Registers a provided-buffer ring of `count` buffers (a power of two)
+     * of `size` bytes each as buffer group `group`, and hands all of them
+     * to the kernel. Throws SocketException if the kernel refuses it.
+     */
+    void addBufferRing(uint16_t group, unsigned count, size_t size);
+
+    /*
+     * The memory of buffer `id` of the buffer ring, and its size.
+     */
+    char *buffer(uint16_t id) const { return buffers.get() + static_cast<size_t>(id) * bufferSize; }
+    size_t bufferLength() const { return bufferSize; }
+
+    /*
+     * Gives buffer `id`, picked by a completed receive, back to the kernel.
+     */
+    void recycleBuffer(uint16_t id);
+
+    // io_uring_enter() calls and SQEs submitted since construction
+    uint64_t enterCalls() const { return enters; }
+    uint64_t submittedEntries() const { return submitted; }
+
+private:
+    int enter(unsigned toSubmit, unsigned waitNr, unsigned flags, const void *arg, size_t argSize);
+    void flush();
+
+    int ringFd = -1;
+    unsigned features = 0;
+    bool disabled = false; // created with IORING_SETUP_R_DISABLED, waiting for enable()
+
+    void *sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void *cqRing = nullptr; // same mapping as sqRing with IORING_FEAT_SINGLE_MMAP
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned *sqHead, *sqTail, sqMask, sqEntries;
+    unsigned *cqHead, *cqTail, cqMask;
+    io_uring_cqe *cqes;
+    unsigned sqLocalTail = 0; // SQEs handed out by get(); published by flush()
+
+    io_uring_buf *bufRing = nullptr;
+    uint16_t *bufTail = nullptr;
+    size_t bufRingSize = 0;
+    unsigned bufMask = 0;
+    std::unique_ptr<char[]> buffers;
+    size_t bufferSize = 0;
+
+    uint64_t enters = 0;
+    uint64_t submitted = 0;
+};
+
+template <typename F>
+unsigned IoUring::forEachCompletion(F &&handle)
+{
+    unsigned head = *cqHead; // only this thread moves the head
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+    while (head != tail)
+    {
+        io_uring_cqe cqe = cqes[head & cqMask];
+        // Released before the handler runs, so the slot is free again if it submits
+        __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+        handle(static_cast<const io_uring_cqe &>(cqe));
+        count++;
+        if (head == tail)
+            tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    }
+    return count;
+}
+
+#endif // IOURING_HPP
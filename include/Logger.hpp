@@ -1,13 +1,83 @@
 #ifndef LOGGER_HP
 #define LOGGER_HP
 
+#include <cstdint>
 #include <string>
 
 /*
- * Thread-safe logging function.
- * Uses a mutex to ensure only one thread at a time writes to std::cout,
- * preventing interleaved or garbled output.
+ * Severity of a log message, lowest first.
+ */
+enum class LogLevel
+{
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3
+};
+
+/*
+ * Messages below this level are removed at compile time by the LOG_* macros,
+ * including the building of their message strings. Set with
+ * -DLOG_MIN_LEVEL=<0..3> (CMake option of the same name); defaults to Info.
+ */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+#endif
+
+/*
+ * Asynchronous logging.
+ *  - Each thread appends to its own lock-free single-producer ring buffer;
+ *    no lock is taken and nothing is written on the calling thread.
+ *  - A background writer drains all rings and writes each batch with a
+ *    single write() to stdout or the configured log file.
+ *  - When a ring is full the message is dropped and counted instead of
+ *    blocking the caller; the writer reports the drops in the log.
+ */
+#define LOG_AT(level, message)                                      \
+    do                                                              \
+    {                                                               \
+        if constexpr (static_cast<int>(level) >= LOG_MIN_LEVEL)     \
+        {                                                           \
+            if (logEnabled(level))                                  \
+                logAt(level, message);                              \
+        }                                                           \
+    } while (0)
+
+#define LOG_DEBUG(message) LOG_AT(LogLevel::Debug, message)
+#define LOG_INFO(message) LOG_AT(LogLevel::Info, message)
+#define LOG_WARN(message) LOG_AT(LogLevel::Warn, message)
+#define LOG_ERROR(message) LOG_AT(LogLevel::Error, message)
+
+/*
+ * Directs the log to `path` (appending; empty means stdout) and sets the
+ * runtime minimum level. Throws FileException if the file cannot be opened.
+ */
+void initLogger(const std::string &path, LogLevel level);
+
+/*
+ * Whether messages of `level` currently pass the runtime level filter.
+ */
+bool logEnabled(LogLevel level);
+
+/*
+ * Queues `message` at `level` without blocking. Prefer the LOG_* macros,
+ * which skip building the message when the level is filtered out.
+ */
+void logAt(LogLevel level, const std::string &message);
+
+/*
+ * Queues an Info message; kept for callers that predate log levels.
  */
 void log(const std::string &message);
 
-#endif // LOGGER_HP
\ No newline at end of file
+/*
+ * Parses "debug", "info", "warn" or "error" into `level`.
+ */
+bool parseLogLevel(const std::string &name, LogLevel &level);
+
+/*
+ * Messages dropped so far because a thread's ring buffer was full.
+ */
+uint64_t droppedLogMessages();
+
+#endif // LOGGER_HP
@@ -0,0 +1,170 @@
+#ifndef MEMORYPOOL_HPP
+#define MEMORYPOOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+/*
+ * Fixed-size I/O buffers carved out of large slabs and recycled through a
+ * free list instead of going back to malloc.
+ *  - A slab holds BLOCKS_PER_SLAB blocks. Slabs are never freed, so once
+ *    the pool has grown to the peak load, acquire() and release() only
+ *    push and pop a pointer.
+ *  - reserve() preallocates at startup; stats() reports how many blocks
+ *    exist and how many are in use, which is what sizing it needs.
+ *  - Thread-safe; the free list is guarded by one mutex held for a few
+ *    instructions.
+ */
+class BufferPool
+{
+public:
+    struct Stats
+    {
+        size_t blockSize;
+        size_t blocks;     // carved so far, free or in use
+        size_t inUse;      // handed out and not released yet
+        size_t peakInUse;  // high-water mark of inUse since start
+        uint64_t acquired; // acquire() calls since start
+        uint64_t slabs;    // slab allocations since start
+    };
+
+    static constexpr size_t BLOCKS_PER_SLAB = 16;
+
+    explicit BufferPool(size_t blockSize);
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    /*
+     * Returns a block of blockSize() bytes, adding a slab if none is free.
+     * The contents are unspecified.
+     */
+    char *acquire();
+
+    /*
+     * Puts a block obtained from acquire() back on the free list.
+     */
+    void release(char *block);
+
+    /*
+     * Adds slabs until at least `blocks` blocks exist.
+     */
+    void reserve(size_t blocks);
+
+    size_t blockSize() const { return size; }
+
+    Stats stats() const;
+
+private:
+    void addSlab(); // called with `mutex` held
+
+    size_t size;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<char[]>> slabs;
+    std::vector<char *> freeBlocks;
+    size_t inUse = 0;
+    size_t peakInUse = 0;
+    uint64_t acquired = 0;
+};
+
+/*
+ * Owns one block of a BufferPool and gives it back when destroyed or reset.
+ * Move-only; an empty handle holds no block.
+ */
+class PooledBuffer
+{
+public:
+    PooledBuffer() = default;
+    explicit PooledBuffer(BufferPool &pool) : pool(&pool), block(pool.acquire()) {}
+    ~PooledBuffer() { reset(); }
+
+    PooledBuffer(PooledBuffer &&other) noexcept : pool(other.pool), block(other.block) { other.block = nullptr; }
+    PooledBuffer &operator=(PooledBuffer &&other) noexcept;
+
+    PooledBuffer(const PooledBuffer &) = delete;
+    PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+    char *data() const { return block; }
+    explicit operator bool() const { return block != nullptr; }
+
+    void reset();
+
+private:
+    BufferPool *pool = nullptr;
+    char *block = nullptr;
+};
+
+/*
+ * Monotonic allocator for the temporaries of one request (entity tags,
+ * range headers, the normalized path): allocating bumps a pointer through
+ * an inline block, deallocating does nothing, and reset() rewinds it in
+ * O(1) for the next request. A request that outgrows the block continues
+ * in heap chunks, which reset() frees.
+ *
+ * Used through std::pmr containers, e.g. `std::pmr::string s(&arena)`.
+ * Each worker thread has one (requestArena()); nothing allocated from it
+ * may outlive the request, so queued output is always copied out of it.
+ */
+class RequestArena : public std::pmr::memory_resource
+{
+public:
+    struct Stats
+    {
+        uint64_t resets;    // requests served from an arena
+        size_t peakBytes;   // most bytes one request has taken
+        uint64_t overflows; // heap chunks taken because the inline block was full
+    };
+
+    static constexpr size_t INLINE_SIZE = 4096;
+
+    RequestArena() = default;
+    ~RequestArena() override;
+
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    /*
+     * Releases everything allocated since the last reset.
+     */
+    void reset();
+
+    // Bytes allocated since the last reset, padding included
+    size_t used() const { return usedBefore + offset; }
+
+private:
+    struct Chunk
+    {
+        Chunk *next;
+        size_t size; // usable bytes after the header
+    };
+
+    void *do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void *, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+
+    void freeChunks();
+
+    alignas(std::max_align_t) char inlineBlock[INLINE_SIZE];
+    char *current = inlineBlock;         // block being bumped through
+    size_t capacity = INLINE_SIZE;       // its size
+    size_t offset = 0;                   // bytes of it already handed out
+    size_t usedBefore = 0;               // bytes handed out from earlier blocks
+    Chunk *chunks = nullptr;             // heap chunks, newest first
+};
+
+/*
+ * The calling thread's request arena.
+ */
+RequestArena &requestArena();
+
+/*
+ * Totals over the arenas of all threads.
+ */
+RequestArena::Stats requestArenaStats();
+
+#endif // MEMORYPOOL_HPP
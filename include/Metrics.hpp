@@ -0,0 +1,78 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/*
+ * Latencies recorded into histograms.
+ *  - Request:      handleClient() building one response.
+ *  - Parse:        the parse() call that completed a request.
+ *  - FileRead:     loading a file into the file cache.
+ *  - Send:         one flushOutput() pass over a connection's queue.
+ *  - TlsHandshake: accept to finished TLS handshake.
+ */
+enum class Timer
+{
+    Request,
+    Parse,
+    FileRead,
+    Send,
+    TlsHandshake,
+    Count
+};
+
+/*
+ * Sets the request path that serves the metrics ("/__metrics");
+ * an empty path disables the endpoint.
+ */
+void initMetrics(const std::string &path);
+
+/*
+ * Whether `path` is the configured metrics endpoint.
+ */
+bool isMetricsPath(std::string_view path);
+
+/*
+ * Recording functions, callable from any thread.
+ * Every thread updates its own counters and histograms with plain relaxed
+ * stores: no locks, no shared cache lines and no allocation after the
+ * thread's first call. Readers sum all threads when rendering.
+ */
+void recordRequest(std::string_view method, int status);
+void recordLatency(Timer timer, int64_t nanos);
+void recordBytesSent(uint64_t bytes);
+void recordConnectionOpened();
+void recordConnectionClosed();
+void recordTlsHandshake(bool resumed);
+void recordKernelTls();
+void recordTlsHandshakeTimeout();
+
+/*
+ * Nanoseconds on the monotonic clock, for timing what is recorded.
+ */
+int64_t monotonicNanos();
+
+/*
+ * Registers a callback that appends extra metrics (in Prometheus text
+ * format) when the endpoint is rendered, e.g. thread pool or cache stats.
+ * Must be called before serving requests.
+ */
+void addMetricsCollector(std::function<void(std::string &)> collector);
+
+/*
+ * Appends one sample with its HELP and TYPE lines, for collectors.
+ */
+void writeMetric(std::string &out, const char *name, const char *type, const char *help, double value);
+
+/*
+ * Renders all metrics in the Prometheus text exposition format (0.0.4).
+ * Histograms use log-linear buckets (8 per power of two, HDR style);
+ * they are exported with power-of-two `le` bounds plus estimated
+ * p50/p90/p99/p999 gauges.
+ */
+std::string renderMetrics();
+
+#endif // METRICS_HPP
@@ -0,0 +1,34 @@
+#ifndef MIMETYPES_HPP
+#define MIMETYPES_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/*
+ * Returns the MIME type for a file path based on its extension.
+ *  - The extension is what follows the last '.' of the last path segment,
+ *    compared without regard to ASCII case.
+ *  - A table loaded with loadMimeTypes() is consulted first, then the
+ *    built-in table, a perfect hash generated at compile time.
+ *  - Defaults to "application/octet-stream" if the extension is unknown.
+ * Nothing is allocated: the view points into static storage, or into the
+ * loaded table, which lives until exit.
+ */
+std::string_view getMimeType(std::string_view path);
+
+/*
+ * Loads a mime.types style file ("type/subtype ext1 ext2 ...", '#'
+ * comments) into a perfect hash with the same layout as the built-in one.
+ * Its entries take precedence; a later line wins for a repeated extension.
+ * Must be called at most once, before any lookup, since lookups keep views
+ * into the table. Returns the number of extensions loaded.
+ * Throws FileException if the file cannot be read and FileParseException
+ * for a malformed line.
+ */
+size_t loadMimeTypes(const std::string &path);
+
+// Extensions in the built-in table.
+size_t builtinMimeTypeCount();
+
+#endif // MIMETYPES_HPP
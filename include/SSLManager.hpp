@@ -1,7 +1,9 @@
 #pragma once
 #include <openssl/ssl.h>
 #include <openssl/err.h>
+#include <cstdint>
 #include <string>
+#include "../include/TlsSessionCache.hpp"
 
 /*
  * Initialize OpenSSL library and load server certificate/key.
@@ -10,3 +12,45 @@
  * This allows for connection management and manual memory deallocation.
  */
 SSL_CTX *createServerSSLContext(const std::string &certFile, const std::string &keyFile);
+
+/*
+ * Enables TLS session resumption on `ctx` so returning clients skip the
+ * full handshake.
+ *  - Session IDs (TLS 1.2) and stateful TLS 1.3 tickets are served from a
+ *    TlsSessionCache of `cacheEntries` sessions; 0 disables the cache.
+ *  - Sessions are resumable for `timeoutSeconds`.
+ *  - With `ticketRotationSeconds` > 0, stateless tickets (TLS 1.2 and 1.3)
+ *    are encrypted with an in-memory AES-256-CBC/HMAC-SHA256 key that is
+ *    replaced every `ticketRotationSeconds`. The previous key still
+ *    decrypts, and such tickets are renewed, so a ticket stays usable for
+ *    up to two rotation periods. 0 disables stateless tickets; TLS 1.3
+ *    clients then get stateful tickets backed by the cache.
+ * Must be called once, before the first connection is accepted.
+ */
+void configureSessionResumption(SSL_CTX *ctx, size_t cacheEntries, int timeoutSeconds, int ticketRotationSeconds);
+
+/*
+ * Asks OpenSSL to hand record encryption to the kernel (kTLS) after each
+ * handshake, when both the library and the kernel support the negotiated
+ * cipher. Connections where that worked can send file bodies with
+ * SSL_sendfile(); the others keep encrypting in user space.
+ * Returns false if this OpenSSL build has no kTLS support.
+ */
+bool enableKernelTls(SSL_CTX *ctx);
+
+/*
+ * Offers HTTP/2 through ALPN: "h2" is picked when the client lists it,
+ * otherwise "http/1.1". Clients that send no ALPN get HTTP/1.1, and
+ * negotiatedHttp2() tells the two apart after the handshake.
+ */
+void enableHttp2(SSL_CTX *ctx);
+
+struct TlsResumptionStats
+{
+    TlsSessionCache::Stats sessionCache;
+    uint64_t ticketKeysGenerated;  // the first key included
+    uint64_t ticketsDecrypted;     // stateless tickets accepted
+    uint64_t ticketsUnknownKey;    // tickets whose key was retired or never ours
+};
+
+TlsResumptionStats tlsResumptionStats();
@@ -0,0 +1,38 @@
+#ifndef SIMDSCAN_HPP
+#define SIMDSCAN_HPP
+
+#include <cstddef> // for size_t
+
+/*
+ * Vectorized byte search used by the request parser for "\n", ':' and ' '.
+ *
+ * The implementation is picked once at startup from what the CPU supports:
+ * AVX2 (32 bytes per step), SSE2 (16 bytes per step, always available on
+ * x86-64) or the C library's memchr() on other architectures.
+ */
+enum class ScanLevel
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+/*
+ * Returns the offset of the first `c` in [data, data + len), or `len` if absent.
+ */
+size_t scanFor(const char *data, size_t len, char c);
+
+/*
+ * The implementation scanFor() currently uses.
+ */
+ScanLevel activeScanLevel();
+
+const char *scanLevelName(ScanLevel level);
+
+/*
+ * Forces a specific implementation (clamped to what the CPU supports).
+ * Intended for benchmarks; call before any other thread uses scanFor().
+ */
+void setScanLevel(ScanLevel level);
+
+#endif // SIMDSCAN_HPP
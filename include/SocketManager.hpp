@@ -3,7 +3,7 @@
 
 #include <cstdint> // for uint16_t
 
-constexpr int BACKLOG = 10; // Maximum number of pending connections
+constexpr int BACKLOG = 1024; // Default maximum number of pending connections (Config::listenBacklog)
 // constexpr uint16_t PORT = 8080;
 
 /*
@@ -19,17 +19,40 @@ int createTcpSocket();
 void bindSocket(int fd, uint16_t port);
 
 /*
- * Starts listening on the socket FD with backlog = BACKLOG.
+ * Starts listening on the socket FD with the given backlog
+ * (the kernel caps it at net.core.somaxconn).
  * Exits on failure.
  */
-void startListening(int fd, int port);
+void startListening(int fd, int port, int backlog = BACKLOG);
 
 /*
- * Waits for a client to connect (blocks until a connection arrives).
- * Returns the client socket FD.
- * Exits on accept() failure.
+ * Sets SO_REUSEADDR so a restarted server can bind while old connections
+ * linger in TIME_WAIT, and optionally SO_REUSEPORT so several sockets can
+ * listen on the same port. Must be called before bindSocket().
+ * Throws SocketException on failure.
  */
-int waitForClient(int server_fd);
+void setReuseOptions(int fd, bool reusePort);
+
+/*
+ * Creates, binds and starts a listening socket on `port` in one step.
+ * With `reusePort`, every call for the same port adds another socket to
+ * the port's SO_REUSEPORT group and the kernel spreads incoming
+ * connections across them by hashing the client address.
+ */
+int createListener(uint16_t port, int backlog, bool reusePort);
+
+/*
+ * Puts the socket FD into non-blocking mode.
+ * Throws SocketException on failure.
+ */
+void setNonBlocking(int fd);
+
+/*
+ * Accepts one pending connection on a non-blocking listening socket.
+ * Returns a non-blocking, close-on-exec client socket FD with TCP_NODELAY set,
+ * or -1 once the accept queue is drained (or on a non-transient error).
+ */
+int acceptClient(int server_fd);
 
 /*
  * Reads data from the client socket in a loop and echoes it back.
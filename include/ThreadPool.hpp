@@ -0,0 +1,89 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed-size worker pool with per-worker deques and work stealing.
+ *  - The number of threads is fixed at construction (Config::maxThreads),
+ *    so a connection spike grows queues, never the thread count.
+ *  - External submissions are spread round-robin over the worker deques;
+ *    jobs submitted from inside a worker go to that worker's own deque.
+ *  - A worker pops its own deque from the back (LIFO, cache-warm) and,
+ *    when empty, steals from the front of its siblings' deques (FIFO).
+ */
+class ThreadPool
+{
+public:
+    using Job = std::function<void()>;
+
+    /*
+     * Snapshot of the pool counters.
+     *  - queueDepth:    jobs currently waiting in all deques.
+     *  - maxQueueDepth: high-water mark of queueDepth since start.
+     *  - submitted / executed: totals since start.
+     *  - steals:        jobs a worker took from another worker's deque.
+     */
+    struct Stats
+    {
+        size_t threads;
+        size_t queueDepth;
+        size_t maxQueueDepth;
+        uint64_t submitted;
+        uint64_t executed;
+        uint64_t steals;
+    };
+
+    /*
+     * Starts `threadCount` workers. A non-positive count falls back to
+     * std::thread::hardware_concurrency().
+     */
+    explicit ThreadPool(int threadCount);
+
+    /*
+     * Lets the workers drain the queued jobs, then joins them.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(Job job);
+
+    Stats stats() const;
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void workerLoop(size_t index);
+    bool popLocal(size_t index, Job &job);
+    bool steal(size_t thief, Job &job);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+
+    std::atomic<size_t> nextQueue{0};
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> maxPending{0};
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> steals{0};
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+#endif // THREADPOOL_HPP
@@ -0,0 +1,84 @@
+#ifndef TLSSESSIONCACHE_HPP
+#define TLSSESSIONCACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Sharded LRU store of serialized TLS sessions, keyed by session ID.
+ *  - Used as OpenSSL's external server session cache: TLS 1.2 session-ID
+ *    resumption and TLS 1.3 stateful tickets both look sessions up here.
+ *  - Each ID hashes to one of SHARD_COUNT shards with its own mutex, LRU
+ *    list and share of the entry limit.
+ *  - Entries expire `ttlSeconds` after they were stored; expired entries
+ *    are dropped when they are looked up or reach the LRU tail.
+ *  - Values are opaque bytes (DER from i2d_SSL_SESSION), so the store
+ *    knows nothing about OpenSSL.
+ */
+class TlsSessionCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions; // dropped for space or because they expired
+        size_t entries;
+        size_t capacity;
+    };
+
+    static constexpr size_t SHARD_COUNT = 16;
+
+    TlsSessionCache(size_t capacityEntries, int ttlSeconds);
+
+    /*
+     * Stores `session` under `id`, replacing an older entry with that ID.
+     */
+    void put(std::string_view id, std::string session);
+
+    /*
+     * Copies the session stored under `id` into `session`.
+     * Returns false if there is none or it has expired.
+     */
+    bool get(std::string_view id, std::string &session);
+
+    void remove(std::string_view id);
+
+    Stats stats() const;
+
+private:
+    struct Entry
+    {
+        std::string id;
+        std::string session;
+        int64_t expiresAtNs;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        // Most recently used entries at the front
+        std::list<Entry> lru;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index; // views into Entry::id
+    };
+
+    Shard &shardFor(std::string_view id);
+
+    size_t capacity;
+    size_t shardCapacity;
+    int64_t ttlNs;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+};
+
+#endif // TLSSESSIONCACHE_HPP
@@ -0,0 +1,107 @@
+#ifndef URINGLOOP_HPP
+#define URINGLOOP_HPP
+
+#include "../include/Config.hpp"
+#include "../include/Connection.hpp"
+#include "../include/FileServer.hpp"
+#include "../include/IoUring.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+
+/*
+ * Completion-based loop for plain HTTP on io_uring, used instead of
+ * EventLoop when Config::ioBackend is "io_uring". Rather than waiting for
+ * readiness and then making one system call per read or write, it hands
+ * the kernel whole operations and collects their results. A single
+ * io_uring_enter() per iteration submits the next step of every connection
+ * and returns whatever has completed:
+ *  - One multishot accept per listener yields every new connection.
+ *  - Receives pick a buffer from a provided-buffer ring only once data
+ *    arrives; the bytes are copied into the connection's ReceiveBuffer and
+ *    the buffer goes straight back, so a waiting keep-alive connection
+ *    holds no receive memory.
+ *  - Responses leave as one sendmsg() over the gathered in-memory chunks,
+ *    linked to a pair of splices (file -> pipe -> socket) when a file body
+ *    follows, so head and body go out in one submission.
+ *  - A file cache miss is streamed while an asynchronous read fills the
+ *    cache (the loop is its thread's CacheFiller).
+ *  - Requests are parsed and answered on the loop thread itself, with no
+ *    handoff to the worker pool; Config::listenerShards runs several loops.
+ *  - Connections idle longer than Config::keepAliveTimeout are shut down,
+ *    which completes their pending receive and closes them.
+ * TLS listeners stay on EventLoop, since OpenSSL does its own socket I/O.
+ */
+class UringLoop : public CacheFiller
+{
+public:
+    struct Stats
+    {
+        uint64_t enterCalls;  // io_uring_enter() system calls
+        uint64_t submitted;   // operations submitted
+        uint64_t completions; // completions reaped
+        uint64_t cacheFills;  // file cache misses read asynchronously
+    };
+
+    /*
+     * Sets up the ring and its receive buffers.
+     * Throws SocketException if this kernel cannot run the loop (io_uring
+     * missing or disabled, or older than Linux 5.19).
+     */
+    explicit UringLoop(const Config &cfg);
+    ~UringLoop() override;
+
+    UringLoop(const UringLoop &) = delete;
+    UringLoop &operator=(const UringLoop &) = delete;
+
+    /*
+     * Adds a bound and listening plain HTTP socket. Call before run().
+     */
+    void addListener(int listenFd);
+
+    /*
+     * Runs the loop forever on the calling thread, which from then on owns
+     * the ring. Throws SocketException if io_uring itself fails.
+     */
+    void run();
+
+    void fill(std::shared_ptr<FileHandle> file, const std::string &fullPath, const struct stat &st, std::string_view mime) override;
+
+private:
+    struct Slot;
+    struct FileFill;
+
+    void handleCompletion(const io_uring_cqe &cqe);
+    void armAccept(int listenFd);
+    void onAccept(int listenFd, const io_uring_cqe &cqe);
+    void onConnectionOp(Slot &slot, unsigned op, const io_uring_cqe &cqe);
+    void advance(Slot &slot);
+    void armReceive(Slot &slot);
+    bool startWrite(Slot &slot);
+    bool queueSplice(Slot &slot, const OutputChunk &chunk, io_uring_sqe *linkedFrom);
+    void queueSpliceOut(Slot &slot, size_t length);
+    void onFileRead(FileFill *fill, int result);
+    void closeSlot(Slot &slot);
+    void closeIdleConnections();
+    void publishStats();
+
+    const Config &cfg;
+    IoUring ring;
+    std::vector<int> listeners;
+    std::vector<std::unique_ptr<Slot>> slots;                        // indexed by client fd
+    std::unordered_map<std::string, std::unique_ptr<FileFill>> fills; // cache reads in flight, by path
+    int64_t now = 0;                                                 // monotonicMillis() of the current iteration
+
+    uint64_t publishedEnters = 0, publishedSubmitted = 0;
+};
+
+/*
+ * Totals over all io_uring loops (zero when none runs).
+ */
+UringLoop::Stats uringStats();
+
+#endif // URINGLOOP_HPP
@@ -0,0 +1,102 @@
+#include "../include/ByteRange.hpp"
+#include "../include/HttpParser.hpp" // for equalsIgnoreCase
+#include <algorithm>
+#include <limits>
+
+/*
+ * Parses a run of decimal digits at the front of `s`, saturating instead of
+ * overflowing. Returns false if `s` does not start with a digit.
+ */
+static bool parseNumber(std::string_view &s, uint64_t &value)
+{
+    if (s.empty() || s.front() < '0' || s.front() > '9')
+        return false;
+    value = 0;
+    while (!s.empty() && s.front() >= '0' && s.front() <= '9')
+    {
+        uint64_t digit = static_cast<uint64_t>(s.front() - '0');
+        if (value > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+            value = std::numeric_limits<uint64_t>::max();
+        else
+            value = value * 10 + digit;
+        s.remove_prefix(1);
+    }
+    return true;
+}
+
+static std::string_view trimOws(std::string_view s)
+{
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+        s.remove_suffix(1);
+    return s;
+}
+
+RangeResult parseRangeHeader(std::string_view header, uint64_t size, std::pmr::vector<ByteRange> &ranges)
+{
+    ranges.clear();
+    header = trimOws(header);
+    if (header.size() < 6 || !equalsIgnoreCase(header.substr(0, 6), "bytes="))
+        return RangeResult::Ignore;
+    header.remove_prefix(6);
+
+    size_t specs = 0;
+    while (!header.empty())
+    {
+        size_t comma = header.find(',');
+        std::string_view spec = trimOws(header.substr(0, comma));
+        header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+        if (spec.empty())
+            continue; // "bytes=0-1,,5-6" is tolerated like empty list elements elsewhere
+        if (++specs > MAX_RANGES)
+            return RangeResult::Ignore;
+
+        uint64_t first = 0, last = 0;
+        if (spec.front() == '-')
+        {
+            // Suffix range: the final N bytes
+            spec.remove_prefix(1);
+            uint64_t suffix;
+            if (!parseNumber(spec, suffix) || !spec.empty())
+                return RangeResult::Ignore;
+            if (suffix == 0 || size == 0)
+                continue;
+            first = suffix < size ? size - suffix : 0;
+            last = size - 1;
+        }
+        else
+        {
+            if (!parseNumber(spec, first) || spec.empty() || spec.front() != '-')
+                return RangeResult::Ignore;
+            spec.remove_prefix(1);
+            last = std::numeric_limits<uint64_t>::max();
+            if (!spec.empty() && (!parseNumber(spec, last) || !spec.empty()))
+                return RangeResult::Ignore;
+            if (last < first)
+                return RangeResult::Ignore;
+            if (first >= size)
+                continue;
+            last = std::min(last, size - 1);
+        }
+        ranges.push_back({first, last});
+    }
+
+    if (specs == 0)
+        return RangeResult::Ignore;
+    if (ranges.empty())
+        return RangeResult::Unsatisfiable;
+
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange &a, const ByteRange &b)
+              { return a.first < b.first; });
+    size_t merged = 0;
+    for (size_t i = 1; i < ranges.size(); ++i)
+    {
+        if (ranges[i].first <= ranges[merged].last + 1)
+            ranges[merged].last = std::max(ranges[merged].last, ranges[i].last);
+        else
+            ranges[++merged] = ranges[i];
+    }
+    ranges.resize(merged + 1);
+    return RangeResult::Partial;
+}
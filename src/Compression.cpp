@@ -0,0 +1,47 @@
+#include "../include/Compression.hpp"
+#include <zlib.h>
+
+// Defaults match config.json; initCompression() overrides them at startup
+static int compressionLevel = 6;
+static size_t compressionMinSize = 1024;
+
+void initCompression(int level, size_t minSize)
+{
+    compressionLevel = level;
+    compressionMinSize = minSize;
+}
+
+bool shouldCompress(std::string_view mime, size_t size)
+{
+    if (compressionLevel <= 0 || size < compressionMinSize)
+        return false;
+
+    // Images other than SVG, PDFs and archives are already compressed
+    return mime.rfind("text/", 0) == 0 ||
+           mime == "application/javascript" ||
+           mime == "application/json" ||
+           mime == "application/xml" ||
+           mime == "image/svg+xml";
+}
+
+bool compressBody(const char *data, size_t size, ContentEncoding encoding, std::string &out)
+{
+    // windowBits 15 produces a zlib stream; adding 16 wraps it in a gzip header instead
+    int windowBits = encoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+
+    z_stream zs{};
+    if (deflateInit2(&zs, compressionLevel, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    // deflateBound() is large enough for a single Z_FINISH call
+    out.resize(deflateBound(&zs, static_cast<uLong>(size)));
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    zs.avail_in = static_cast<uInt>(size);
+    zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
@@ -43,6 +43,13 @@ std::string Config::extractString(const std::string json, const std::string key)
     return trim(value);
 }
 
+std::string Config::extractString(const std::string json, const std::string key, const std::string &defaultValue)
+{
+    if (json.find('"' + key + '"') == std::string::npos)
+        return defaultValue;
+    return extractString(json, key);
+}
+
 int Config::extractInt(const std::string json, const std::string key, int defaultValue)
 {
     /*
@@ -75,6 +82,67 @@ int Config::extractInt(const std::string json, const std::string key, int defaul
     return val;
 }
 
+std::vector<std::pair<std::string, std::string>> Config::extractStringMap(const std::string json, const std::string key)
+{
+    /*
+     *  Example of JSON format
+     *  {
+     *   "cacheControl": {
+     *     "/static/": "public, max-age=31536000, immutable",
+     *     "text/html": "no-cache"
+     *   }
+     *  }
+     */
+    std::vector<std::pair<std::string, std::string>> entries;
+    size_t pos = json.find('"' + key + '"');
+    if (pos == std::string::npos)
+        return entries;
+
+    pos = json.find(':', pos);
+    if (pos == std::string::npos)
+        throw FileParseException("Colon not found in JSON: " + key);
+    pos = json.find_first_not_of(" \t\n\r", pos + 1);
+    if (pos == std::string::npos || json[pos] != '{')
+        throw FileParseException("Expected an object for key: " + key);
+    pos++;
+
+    // Reads one "..." string starting at `pos` (after skipping whitespace)
+    auto readString = [&](std::string &out)
+    {
+        pos = json.find_first_not_of(" \t\n\r", pos);
+        if (pos == std::string::npos || json[pos] != '"')
+            throw FileParseException("Malformed object for key: " + key);
+        size_t end = json.find('"', pos + 1);
+        if (end == std::string::npos)
+            throw FileParseException("Unterminated string in object: " + key);
+        out = json.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+    };
+
+    while (true)
+    {
+        pos = json.find_first_not_of(" \t\n\r", pos);
+        if (pos == std::string::npos)
+            throw FileParseException("Unterminated object for key: " + key);
+        if (json[pos] == '}')
+            break;
+
+        std::string name, value;
+        readString(name);
+        pos = json.find_first_not_of(" \t\n\r", pos);
+        if (pos == std::string::npos || json[pos] != ':')
+            throw FileParseException("Colon not found in object: " + key);
+        pos++;
+        readString(value);
+        entries.emplace_back(trim(name), trim(value));
+
+        pos = json.find_first_not_of(" \t\n\r", pos);
+        if (pos != std::string::npos && json[pos] == ',')
+            pos++;
+    }
+    return entries;
+}
+
 Config Config::load(const std::string &path)
 {
     std::ifstream file(path);
@@ -96,6 +164,79 @@ Config Config::load(const std::string &path)
     if (config.docRoot.empty())
         throw FileException("docRoot is empty");
     config.maxThreads = extractInt(json, "maxThreads", 4);
+    config.keepAliveTimeout = extractInt(json, "keepAliveTimeout", 5);
+    if (config.keepAliveTimeout <= 0)
+        throw FileParseException("keepAliveTimeout must be positive");
+    config.maxKeepAliveRequests = extractInt(json, "maxKeepAliveRequests", 100);
+    if (config.maxKeepAliveRequests <= 0)
+        throw FileParseException("maxKeepAliveRequests must be positive");
+    config.receiveBuffers = extractInt(json, "receiveBuffers", 64);
+    if (config.receiveBuffers < 0)
+        throw FileParseException("receiveBuffers must not be negative");
+    config.fileCacheMB = extractInt(json, "fileCacheMB", 64);
+    if (config.fileCacheMB < 0)
+        throw FileParseException("fileCacheMB must not be negative");
+    config.docIndex = extractInt(json, "docIndex", 1);
+    if (config.docIndex != 0 && config.docIndex != 1)
+        throw FileParseException("docIndex must be 0 or 1");
+    config.maxOpenFiles = extractInt(json, "maxOpenFiles", 256);
+    if (config.maxOpenFiles < 0)
+        throw FileParseException("maxOpenFiles must not be negative");
+    config.mimeTypesFile = extractString(json, "mimeTypesFile", "");
+    config.gzipLevel = extractInt(json, "gzipLevel", 6);
+    if (config.gzipLevel < 0 || config.gzipLevel > 9)
+        throw FileParseException("gzipLevel must be between 0 and 9");
+    config.gzipMinSize = extractInt(json, "gzipMinSize", 1024);
+    if (config.gzipMinSize < 0)
+        throw FileParseException("gzipMinSize must not be negative");
+    config.logFile = extractString(json, "logFile", "");
+    std::string logLevel = extractString(json, "logLevel", "info");
+    if (!parseLogLevel(logLevel, config.logLevel))
+        throw FileParseException("logLevel must be debug, info, warn or error: " + logLevel);
+    config.metricsPath = extractString(json, "metricsPath", "/__metrics");
+    if (!config.metricsPath.empty() && config.metricsPath.front() != '/')
+        throw FileParseException("metricsPath must start with '/': " + config.metricsPath);
+    config.listenBacklog = extractInt(json, "listenBacklog", 1024);
+    if (config.listenBacklog <= 0)
+        throw FileParseException("listenBacklog must be positive");
+    config.listenerShards = extractInt(json, "listenerShards", 1);
+    if (config.listenerShards < 0)
+        throw FileParseException("listenerShards must not be negative");
+    config.ioBackend = extractString(json, "ioBackend", "epoll");
+    if (config.ioBackend != "epoll" && config.ioBackend != "io_uring")
+        throw FileParseException("ioBackend must be epoll or io_uring: " + config.ioBackend);
+    config.tlsSessionCacheSize = extractInt(json, "tlsSessionCacheSize", 20480);
+    if (config.tlsSessionCacheSize < 0)
+        throw FileParseException("tlsSessionCacheSize must not be negative");
+    config.tlsSessionTimeout = extractInt(json, "tlsSessionTimeout", 300);
+    if (config.tlsSessionTimeout <= 0)
+        throw FileParseException("tlsSessionTimeout must be positive");
+    config.tlsTicketKeyRotation = extractInt(json, "tlsTicketKeyRotation", 3600);
+    if (config.tlsTicketKeyRotation < 0)
+        throw FileParseException("tlsTicketKeyRotation must not be negative");
+    config.tlsHandshakeTimeout = extractInt(json, "tlsHandshakeTimeout", 10);
+    if (config.tlsHandshakeTimeout <= 0)
+        throw FileParseException("tlsHandshakeTimeout must be positive");
+    config.maxPendingHandshakes = extractInt(json, "maxPendingHandshakes", 1024);
+    if (config.maxPendingHandshakes <= 0)
+        throw FileParseException("maxPendingHandshakes must be positive");
+    config.tlsKernelOffload = extractInt(json, "tlsKernelOffload", 1);
+    if (config.tlsKernelOffload != 0 && config.tlsKernelOffload != 1)
+        throw FileParseException("tlsKernelOffload must be 0 or 1");
+    config.http2 = extractInt(json, "http2", 1);
+    if (config.http2 != 0 && config.http2 != 1)
+        throw FileParseException("http2 must be 0 or 1");
+    config.http2MaxStreams = extractInt(json, "http2MaxStreams", 100);
+    if (config.http2MaxStreams <= 0)
+        throw FileParseException("http2MaxStreams must be positive");
+    config.cacheControl = extractStringMap(json, "cacheControl");
+    for (const auto &[match, value] : config.cacheControl)
+    {
+        if (match.empty() || value.empty())
+            throw FileParseException("cacheControl entries need a path prefix or MIME type and a value");
+        if (value.find_first_of("\r\n") != std::string::npos)
+            throw FileParseException("cacheControl value must be a single line: " + match);
+    }
 
     return config;
 }
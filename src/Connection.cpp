@@ -0,0 +1,453 @@
+#include "../include/Connection.hpp"
+#include "../include/HttpParser.hpp"
+#include "../include/Logger.hpp"
+#include "../include/Metrics.hpp"
+#include <unistd.h>     // for read, close
+#include <sys/socket.h> // for send, sendmsg
+#include <sys/uio.h>    // for iovec
+#include <sys/sendfile.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <openssl/err.h>
+
+// SSL_write is fed at most one TLS record worth of data at a time.
+constexpr size_t SSL_WRITE_CHUNK = 16384;
+// Bytes read from a file per pread() on TLS connections without kTLS.
+constexpr size_t FILE_READ_BLOCK = 65536;
+// An emptied bytes chunk up to this capacity is kept for the next response.
+constexpr size_t MAX_SPARE_BYTES = 4096;
+// Upper bound for a single sendfile() call (Linux caps it just below 2 GiB anyway).
+constexpr size_t MAX_SENDFILE_CHUNK = size_t(1) << 30;
+// Sent chunks at the front of an OutputQueue that still drains are dropped
+// once there are this many and they make up half of it.
+constexpr size_t OUTPUT_QUEUE_COMPACT = 32;
+
+static std::atomic<int> pendingHandshakeCount{0};
+
+int pendingHandshakes()
+{
+    return pendingHandshakeCount.load(std::memory_order_relaxed);
+}
+
+FileHandle::~FileHandle()
+{
+    close(fd);
+}
+
+BufferPool &receiveBufferPool()
+{
+    static BufferPool pool(RECEIVE_BUFFER_SIZE);
+    return pool;
+}
+
+BufferPool &fileReadBufferPool()
+{
+    static BufferPool pool(FILE_READ_BLOCK);
+    return pool;
+}
+
+void OutputQueue::pop_front()
+{
+    chunks[head++] = OutputChunk(); // drop the file or memory it holds now
+    if (head == chunks.size())
+    {
+        chunks.clear(); // keeps the capacity
+        head = 0;
+    }
+    else if (head >= OUTPUT_QUEUE_COMPACT && head * 2 >= chunks.size())
+    {
+        chunks.erase(chunks.begin(), chunks.begin() + static_cast<std::ptrdiff_t>(head));
+        head = 0;
+    }
+}
+
+char *ReceiveBuffer::space()
+{
+    if (!block)
+        block = PooledBuffer(receiveBufferPool());
+    return block.data() + length;
+}
+
+void ReceiveBuffer::consume(size_t n)
+{
+    length -= n;
+    if (length == 0)
+        block.reset();
+    else if (n > 0)
+        std::memmove(block.data(), block.data() + n, length);
+}
+
+Connection::Connection(int fd, SSL *ssl)
+    : fd(fd), ssl(ssl), state(ssl ? ConnState::Handshaking : ConnState::Reading), lastActive(monotonicMillis()),
+      acceptedAtNs(monotonicNanos()), handshakePending(ssl != nullptr)
+{
+    if (ssl)
+        pendingHandshakeCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+Connection::~Connection()
+{
+    if (handshakePending)
+        pendingHandshakeCount.fetch_sub(1, std::memory_order_relaxed);
+    if (ssl)
+    {
+        // Best-effort close_notify; the socket is non-blocking so this never waits.
+        if (SSL_is_init_finished(ssl))
+            SSL_shutdown(ssl);
+        SSL_free(ssl);
+        ERR_clear_error();
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+int64_t monotonicMillis()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+IoStatus continueHandshake(Connection &conn)
+{
+    ERR_clear_error();
+    int rc = SSL_accept(conn.ssl);
+    if (rc == 1)
+    {
+        recordLatency(Timer::TlsHandshake, monotonicNanos() - conn.acceptedAtNs);
+        conn.handshakePending = false;
+        pendingHandshakeCount.fetch_sub(1, std::memory_order_relaxed);
+        recordTlsHandshake(SSL_session_reused(conn.ssl) == 1);
+        conn.kernelTls = BIO_get_ktls_send(SSL_get_wbio(conn.ssl));
+        if (conn.kernelTls)
+            recordKernelTls();
+        conn.state = ConnState::Reading;
+        return IoStatus::Done;
+    }
+
+    int err = SSL_get_error(conn.ssl, rc);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        return IoStatus::WouldBlock;
+
+    LOG_WARN("TLS handshake failed on fd= " + std::to_string(conn.fd));
+    ERR_clear_error();
+    return IoStatus::Closed;
+}
+
+IoStatus readAvailable(Connection &conn)
+{
+    while (!conn.in.full())
+    {
+        char *space = conn.in.space();
+        size_t room = RECEIVE_BUFFER_SIZE - conn.in.size();
+        ssize_t bytes_read;
+        if (conn.ssl)
+        {
+            ERR_clear_error();
+            int rc = SSL_read(conn.ssl, space, static_cast<int>(room));
+            if (rc <= 0)
+            {
+                int err = SSL_get_error(conn.ssl, rc);
+                if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+                    return IoStatus::WouldBlock;
+                return IoStatus::Closed;
+            }
+            bytes_read = rc;
+        }
+        else
+        {
+            bytes_read = read(conn.fd, space, room);
+            if (bytes_read == 0)
+                return IoStatus::Closed;
+            if (bytes_read < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    return IoStatus::WouldBlock;
+                return IoStatus::Closed;
+            }
+        }
+        conn.in.commit(static_cast<size_t>(bytes_read));
+    }
+    return IoStatus::Done;
+}
+
+/*
+ * Writes up to `len` bytes from memory. Returns the number of bytes written,
+ * or -1 with `status` set to WouldBlock/Closed.
+ */
+static ssize_t writeSome(Connection &conn, const char *data, size_t len, IoStatus &status)
+{
+    while (true)
+    {
+        if (conn.ssl)
+        {
+            ERR_clear_error();
+            int rc = SSL_write(conn.ssl, data, static_cast<int>(std::min(len, SSL_WRITE_CHUNK)));
+            if (rc > 0)
+                return rc;
+            int err = SSL_get_error(conn.ssl, rc);
+            status = (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? IoStatus::WouldBlock : IoStatus::Closed;
+            return -1;
+        }
+
+        // MSG_NOSIGNAL: a peer that went away must not raise SIGPIPE
+        ssize_t sent = send(conn.fd, data, len, MSG_NOSIGNAL);
+        if (sent >= 0)
+            return sent;
+        if (errno == EINTR)
+            continue;
+        status = (errno == EAGAIN || errno == EWOULDBLOCK) ? IoStatus::WouldBlock : IoStatus::Closed;
+        return -1;
+    }
+}
+
+/*
+ * Sends the next part of a file chunk. Plain sockets use sendfile() so the
+ * body goes from the page cache straight to the socket, and so does a kTLS
+ * connection through SSL_sendfile(); otherwise TLS has to encrypt in user
+ * space, so the file is read a block at a time into `conn.readBuffer`.
+ */
+static ssize_t sendFileSome(Connection &conn, const OutputChunk &chunk, IoStatus &status)
+{
+    if (conn.kernelTls)
+    {
+        ERR_clear_error();
+        ossl_ssize_t sent = SSL_sendfile(conn.ssl, chunk.file->fd, chunk.offset, std::min(chunk.length, MAX_SENDFILE_CHUNK), 0);
+        if (sent > 0)
+            return sent;
+        int err = SSL_get_error(conn.ssl, static_cast<int>(sent));
+        status = (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? IoStatus::WouldBlock : IoStatus::Closed;
+        return -1;
+    }
+
+    if (!conn.ssl)
+    {
+        while (true)
+        {
+            off_t offset = chunk.offset;
+            ssize_t sent = sendfile(conn.fd, chunk.file->fd, &offset, std::min(chunk.length, MAX_SENDFILE_CHUNK));
+            if (sent > 0)
+                return sent;
+            if (sent < 0 && errno == EINTR)
+                continue;
+            // sent == 0 means the file shrank under us; the promised length can no longer be met
+            status = (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) ? IoStatus::WouldBlock : IoStatus::Closed;
+            return -1;
+        }
+    }
+
+    // Refill only when the chunk has moved past the buffered block. A retried
+    // SSL_write therefore gets the very same bytes, and one pread() serves
+    // FILE_READ_BLOCK / SSL_WRITE_CHUNK records.
+    FileReadBuffer &block = conn.readBuffer;
+    if (block.file != chunk.file || chunk.offset < block.offset ||
+        chunk.offset >= block.offset + static_cast<off_t>(block.length))
+    {
+        if (!block.data)
+            block.data = PooledBuffer(fileReadBufferPool());
+        block.file.reset();
+        ssize_t got;
+        do
+        {
+            got = pread(chunk.file->fd, block.data.data(), std::min(chunk.length, FILE_READ_BLOCK), chunk.offset);
+        } while (got < 0 && errno == EINTR);
+        if (got <= 0)
+        {
+            status = IoStatus::Closed;
+            return -1;
+        }
+        block.file = chunk.file;
+        block.offset = chunk.offset;
+        block.length = static_cast<size_t>(got);
+    }
+    size_t skip = static_cast<size_t>(chunk.offset - block.offset);
+    return writeSome(conn, block.data.data() + skip, std::min(block.length - skip, chunk.length), status);
+}
+
+void consumeOutput(Connection &conn, size_t sent)
+{
+    while (sent > 0)
+    {
+        OutputChunk &chunk = conn.out.front();
+        if (chunk.data)
+        {
+            size_t n = std::min(sent, chunk.length);
+            chunk.data += n;
+            chunk.length -= n;
+            sent -= n;
+            if (chunk.length == 0)
+                conn.out.pop_front();
+            continue;
+        }
+
+        size_t n = std::min(sent, chunk.bytes.size() - conn.outSent);
+        conn.outSent += n;
+        sent -= n;
+        if (conn.outSent == chunk.bytes.size())
+        {
+            if (chunk.bytes.capacity() <= MAX_SPARE_BYTES && chunk.bytes.capacity() > conn.spareBytes.capacity())
+            {
+                chunk.bytes.clear();
+                conn.spareBytes.swap(chunk.bytes);
+            }
+            conn.out.pop_front();
+            conn.outSent = 0;
+        }
+    }
+}
+
+/*
+ * Sends the run of in-memory chunks at the front of the queue (up to the
+ * next file chunk) with as few system calls as possible:
+ *  - plain sockets get one sendmsg() over all of them, with MSG_MORE when
+ *    a file body follows so the headers share its first segment;
+ *  - TLS gets one SSL_write() per record. Pieces smaller than a record
+ *    (headers, short bodies) are copied together first; a piece that fills
+ *    a record is written from where it lies.
+ * Returns the number of bytes sent, or -1 with `status` set.
+ */
+static ssize_t sendMemorySome(Connection &conn, IoStatus &status)
+{
+    struct iovec iov[MAX_GATHER];
+    bool fileFollows = false;
+    size_t count = gatherOutput(conn, iov, fileFollows);
+    if (count == 0)
+        return 0;
+
+    if (conn.ssl)
+    {
+        if (count == 1 || iov[0].iov_len >= SSL_WRITE_CHUNK)
+            return writeSome(conn, static_cast<const char *>(iov[0].iov_base), iov[0].iov_len, status);
+
+        // Rebuilt from the unchanged queue on a retry, so OpenSSL sees the same bytes
+        thread_local char record[SSL_WRITE_CHUNK];
+        size_t filled = 0;
+        for (size_t i = 0; i < count && filled < sizeof(record); ++i)
+        {
+            size_t n = std::min(iov[i].iov_len, sizeof(record) - filled);
+            std::memcpy(record + filled, iov[i].iov_base, n);
+            filled += n;
+        }
+        return writeSome(conn, record, filled, status);
+    }
+
+    struct msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    // MSG_NOSIGNAL: a peer that went away must not raise SIGPIPE
+    int flags = MSG_NOSIGNAL | (fileFollows ? MSG_MORE : 0);
+    while (true)
+    {
+        ssize_t sent = sendmsg(conn.fd, &msg, flags);
+        if (sent >= 0)
+            return sent;
+        if (errno == EINTR)
+            continue;
+        status = (errno == EAGAIN || errno == EWOULDBLOCK) ? IoStatus::WouldBlock : IoStatus::Closed;
+        return -1;
+    }
+}
+
+size_t gatherOutput(Connection &conn, struct iovec *iov, bool &fileFollows)
+{
+    size_t count = 0;
+    fileFollows = false;
+    for (size_t i = 0; i < conn.out.size() && count < MAX_GATHER; ++i)
+    {
+        const OutputChunk &chunk = conn.out[i];
+        if (chunk.file)
+        {
+            fileFollows = chunk.length > 0;
+            break;
+        }
+        const char *base = chunk.data ? chunk.data : chunk.bytes.data() + (i == 0 ? conn.outSent : 0);
+        size_t length = chunk.data ? chunk.length : chunk.bytes.size() - (i == 0 ? conn.outSent : 0);
+        if (length == 0)
+            continue;
+        iov[count].iov_base = const_cast<char *>(base);
+        iov[count].iov_len = length;
+        count++;
+    }
+    return count;
+}
+
+IoStatus flushOutput(Connection &conn)
+{
+    IoStatus status = IoStatus::Done;
+    while (!conn.out.empty())
+    {
+        OutputChunk &chunk = conn.out.front();
+        if (chunk.file)
+        {
+            if (chunk.length > 0)
+            {
+                ssize_t sent = sendFileSome(conn, chunk, status);
+                if (sent < 0)
+                    return status;
+                recordBytesSent(static_cast<uint64_t>(sent));
+                chunk.offset += sent;
+                chunk.length -= static_cast<size_t>(sent);
+            }
+            if (chunk.length == 0)
+                conn.out.pop_front();
+            continue;
+        }
+
+        ssize_t sent = sendMemorySome(conn, status);
+        if (sent < 0)
+            return status;
+        if (sent == 0)
+        {
+            // The run held only empty chunks
+            while (!conn.out.empty() && !conn.out.front().file)
+            {
+                conn.out.pop_front();
+                conn.outSent = 0;
+            }
+            continue;
+        }
+        recordBytesSent(static_cast<uint64_t>(sent));
+        consumeOutput(conn, static_cast<size_t>(sent));
+    }
+    // Nothing left to encrypt: an idle keep-alive connection holds no file block
+    conn.readBuffer = FileReadBuffer();
+    return IoStatus::Done;
+}
+
+std::string &outputBuffer(Connection &conn)
+{
+    if (conn.out.empty() || conn.out.back().file || conn.out.back().data)
+    {
+        OutputChunk chunk;
+        chunk.bytes.swap(conn.spareBytes);
+        conn.out.push_back(std::move(chunk));
+    }
+    return conn.out.back().bytes;
+}
+
+void queueOutput(Connection &conn, std::string_view data)
+{
+    // Coalesce consecutive in-memory pieces so they leave in as few writes as possible
+    outputBuffer(conn).append(data);
+}
+
+void queueBorrowed(Connection &conn, std::shared_ptr<const void> owner, const char *data, size_t length)
+{
+    OutputChunk chunk;
+    chunk.owner = std::move(owner);
+    chunk.data = data;
+    chunk.length = length;
+    conn.out.push_back(std::move(chunk));
+}
+
+void queueFile(Connection &conn, std::shared_ptr<FileHandle> file, off_t offset, size_t length)
+{
+    OutputChunk chunk;
+    chunk.file = std::move(file);
+    chunk.offset = offset;
+    chunk.length = length;
+    conn.out.push_back(std::move(chunk));
+}
@@ -2,192 +2,222 @@
 #include "../include/Logger.hpp"
 #include "../include/HttpParser.hpp"
 #include "../include/FileServer.hpp"
-#include <thread>   // for std::thread
-#include <unistd.h> // for close()
+#include "../include/Exception.hpp"
 #include "../include/HttpResponse.hpp"
 #include "../include/ContentNegotiation.hpp"
+#include "../include/Metrics.hpp"
+#include "../include/MemoryPool.hpp"
+#include "../include/Http2.hpp"
+#include <memory>
 
-void handleClient(int client_fd, const std::string docRoot)
+void handleClient(Connection &conn, const HttpRequest &req, const std::string &docRoot)
 {
     try
     {
         // curl -i http://localhost:8080/foo
-        HttpRequest req;
-        try
+        LOG_DEBUG("Method: " + std::string(req.method));
+        LOG_DEBUG("Path: " + std::string(req.path));
+        LOG_DEBUG("Version: " + std::string(req.version));
+        for (const auto &[name, value] : req.headers)
         {
-            req = receiveRequest(client_fd);
-            log("Method: " + req.method);
-            log("Path: " + req.path);
-            log("Version: " + req.version);
-            for (const auto &[name, value] : req.headers)
-            {
-                log(name + ": " + value);
-            }
-        }
-        catch (const std::exception &e)
-        {
-            std::string body = "<html><body><h1>400 Bad Request</h1></body></html>";
-            sendErrorResponse(client_fd, 400, "Bad Request", body);
-            close(client_fd);
-            return;
+            LOG_DEBUG(std::string(name) + ": " + std::string(value));
         }
 
         if (req.method == "OPTIONS")
         {
-            log("if (req.method == OPTIONS ) worked");
+            LOG_DEBUG("if (req.method == OPTIONS ) worked");
             // curl -X OPTIONS -i http://localhost:8080/index.html
-            std::ostringstream resp;
-            resp << "HTTP/1.1 204 No Content\r\n"
-                 << "Allow: GET, HEAD, OPTIONS\r\n"
-                 << "Connection: close \r\n\r\n";
-            sendRaw(client_fd, resp.str());
-            close(client_fd);
+            ResponseHead head(conn, 204);
+            head.header("Allow", "GET, HEAD, OPTIONS");
+            head.end();
             return;
         }
-        if (req.method == "HEAD")
+        if ((req.method == "GET" || req.method == "HEAD") && isMetricsPath(req.path))
         {
-            log("if (req.method == HEAD ) worked");
-            // curl -I http://localhost:8080/index.html
-            std::string dummy, mime;
-            bool found = peekFile(req.path, docRoot, dummy, mime);
-            log("docRoot is " + docRoot);
-            if (!found)
-            {
-                // curl -i http://localhost:8080/notexist.html
-                std::string body = "<html><body><h1>404 Not Found</h1></body></html>";
-                sendErrorResponse(client_fd, 404, "Not Found", body);
-            }
-            else
-            {
-                std::ostringstream hdr;
-                hdr << "HTTP/1.1 200 OK\r\n"
-                    << "Content-Type: " << mime << "\r\n"
-                    << "Content-Length: " << dummy.size() << "\r\n"
-                    << "Connection: close \r\n\r\n";
-                sendRaw(client_fd, hdr.str());
-            }
-
-            close(client_fd);
+            // curl http://localhost:8080/__metrics
+            // curl -I http://localhost:8080/__metrics
+            sendResponse(conn, renderMetrics(), "text/plain; version=0.0.4", req.method == "HEAD");
             return;
         }
-        if (req.method == "GET")
+        if (req.method == "GET" || req.method == "HEAD")
         {
-            log("if (req.method == GET ) worked");
-            std::string content, mime;
-            bool found = peekFile(req.path, docRoot, content, mime);
+            // curl -i http://localhost:8080/index.html
+            // curl -I http://localhost:8080/index.html
+            LOG_DEBUG("if (req.method == GET || req.method == HEAD) worked");
+            StaticFile file;
+            bool found = peekFile(req.path, docRoot, file);
 
             if (!found)
             {
+                // curl -i http://localhost:8080/notexist.html
                 std::string body404 = "<html><body><h1>404 Not Found</h1></body></html>";
-                sendErrorResponse(client_fd, 404, "Not Found", body404);
-                close(client_fd);
+                sendErrorResponse(conn, 404, "Not Found", body404, req.method == "HEAD");
                 return;
             }
 
-            std::string acceptHeader;
-            auto it = req.headers.find("Accept");
-            if (it != req.headers.end())
-                acceptHeader = it->second;
+            std::string_view acceptHeader = req.headers.find("Accept");
 
             // Check if the MIME type is acceptable
-            if (!isAcceptable(acceptHeader, mime))
+            if (!isAcceptable(acceptHeader, file.entry->mime))
             {
-                log("if (!isAcceptable(acceptHeader, mime)) worked");
-                log("acceptHeader is " + acceptHeader);
-                log("mime is " + mime);
+                LOG_DEBUG("if (!isAcceptable(acceptHeader, mime)) worked");
+                LOG_DEBUG("acceptHeader is " + std::string(acceptHeader));
+                LOG_DEBUG("mime is " + std::string(file.entry->mime));
                 std::string body406 = "<html><body><h1>406 Not Acceptable</h1></body></html>";
-                sendErrorResponse(client_fd, 406, "Not Acceptable", body406);
-                close(client_fd);
+                sendErrorResponse(conn, 406, "Not Acceptable", body406, req.method == "HEAD");
                 return;
             }
-            log("Entering the serveStaticFile function.");
-            serveStaticFile(client_fd, req.path, docRoot);
+
+            // A revalidation whose validators still match costs only the stat() above
+            if (sendNotModified(conn, req, file))
+                return;
+
+            // HEAD goes through the same path so its headers (including the
+            // negotiated Content-Encoding and length) match what GET would send
+            LOG_DEBUG("Entering the serveStaticFile function.");
+            serveStaticFile(conn, req, file);
+            return;
         }
 
         if (req.method != "GET" && req.method != "HEAD" && req.method != "OPTIONS")
         {
             // curl -X POST -i http://localhost:8080/index.html
             std::string body = "<html><body><h1>405 Method Not Allowed</h1></body></html>";
-            sendErrorResponse(client_fd, 405, "Method Not Allowed", body);
+            sendErrorResponse(conn, 405, "Method Not Allowed", body);
         }
 
-        close(client_fd);
         return;
     }
     catch (const std::exception &e)
     {
+        conn.keepAlive = false;
         std::string body = "<html><body><h1>500 Internal Server Error</h1></body></html>";
-        sendErrorResponse(client_fd, 500, "Internal Server Error", body);
-        log(std::string("Internal error: ") + e.what());
+        sendErrorResponse(conn, 500, "Internal Server Error", body, req.method == "HEAD");
+        LOG_ERROR(std::string("Internal error: ") + e.what());
 
-        close(client_fd);
         return;
     }
 }
 
-void handleClientSSL(SSL *ssl, const std::string docRoot)
+void processRequests(Connection &conn, const Config &cfg)
 {
-    // Read HTTP request using SSL
-    // curl -i https://localhost:8080/index.html --insecure
-
-    HttpRequest req = receiveRequestSSL(ssl);
-    log("Method: " + req.method);
-    log("Path: " + req.path);
-    log("Version: " + req.version);
-
-    for (const auto &[name, value] : req.headers)
+    size_t start = 0; // first byte of `conn.in` not consumed yet
+    HttpRequest req;
+    while (!conn.closeAfterWrite)
     {
-        log(name + ": " + value);
-    }
-
-    // Serve static file using SSL
-    serveStaticFileSSL(ssl, req.path, "../public");
+        int64_t parseStart = monotonicNanos();
+        try
+        {
+            if (!conn.parser.parse(conn.in.view().substr(start), req))
+                break;
+        }
+        catch (const HttpParseException &e)
+        {
+            LOG_WARN(e.what());
+            conn.keepAlive = false;
+            std::string body = "<html><body><h1>400 Bad Request</h1></body></html>";
+            sendErrorResponse(conn, 400, "Bad Request", body);
+            recordRequest("", 400);
+            conn.closeAfterWrite = true;
+            conn.state = ConnState::Writing;
+            break;
+        }
 
-    // // Close SSL connection properly
-    // SSL_shutdown(ssl);
-    // SSL_free(ssl);
+        int64_t handleStart = monotonicNanos();
+        recordLatency(Timer::Parse, handleStart - parseStart);
+
+        conn.requestsServed++;
+        conn.keepAlive = wantsKeepAlive(req) && conn.requestsServed < cfg.maxKeepAliveRequests;
+        conn.status = 0;
+        handleClient(conn, req, cfg.docRoot);
+        recordLatency(Timer::Request, monotonicNanos() - handleStart);
+        recordRequest(req.method, conn.status);
+        // The response is queued, so nothing the request allocated is needed any more
+        requestArena().reset();
+        if (!conn.keepAlive)
+            conn.closeAfterWrite = true;
+        conn.state = ConnState::Writing;
+
+        // `req` points into `conn.in`, so the bytes are only dropped once it is answered
+        start += conn.parser.consumed();
+        conn.parser.reset();
+    }
+    // One compaction per batch; a partially parsed request keeps its parser state
+    conn.in.consume(start);
 }
 
-void spawnClientThreadHTTP(int client_fd, const std::string &docRoot)
+/*
+ * Answers a request that arrived on an HTTP/2 stream: the same handleClient()
+ * and bookkeeping as processRequests(), on the session's stream connection.
+ */
+static void answerStream(Connection &response, const HttpRequest &req, const Config &cfg)
 {
-    log("I am in the spawnClientThreadHTTP for http");
-    // Spawn a new thread to handle the client connection
-    // - This line creates a new std::thread object.
-    // - The thread entry function is handleClient, with client_fd as its argument.
-    // - The newly created thread immediately begins executing handleClient(client_fd) on its own stack.
-    std::thread t([client_fd, docRoot]()
-                  { handleClient(client_fd, docRoot); });
-
-    // Detach the thread from the main thread
-    // - Calling detach() makes this new thread independent of the main thread.
-    // - The main thread does not wait for it to finish and immediately continues to the next accept().
-    // - The detached thread cleans up its own resources once its work (reading request, serving file, closing socket) is done.
-    t.detach();
+    int64_t handleStart = monotonicNanos();
+    handleClient(response, req, cfg.docRoot);
+    recordLatency(Timer::Request, monotonicNanos() - handleStart);
+    recordRequest(req.method, response.status);
+    requestArena().reset();
 }
 
-void spawnClientThreadHTTPS(int client_fd, SSL_CTX *sslCtx, const std::string &docRoot)
+void driveConnection(Connection &conn, const Config &cfg)
 {
-    log("I am in the spawnClientThreadHTTPS for https");
-    std::thread t([client_fd, sslCtx, docRoot]()
-                  {
-        SSL *ssl = SSL_new(sslCtx);
-        SSL_set_fd(ssl, client_fd);
-        
-        // Perform SSL/TLS handshake
-        if (SSL_accept(ssl) <= 0)
-        {
-            ERR_print_errors_fp(stderr);
-            SSL_free(ssl);
-            close(client_fd);
+    conn.lastActive = monotonicMillis();
+
+    if (conn.state == ConnState::Handshaking)
+    {
+        IoStatus status = continueHandshake(conn);
+        if (status == IoStatus::Closed)
+            conn.state = ConnState::Closed;
+        if (status != IoStatus::Done)
             return;
+        if (negotiatedHttp2(conn))
+        {
+            conn.http2 = std::make_shared<Http2Session>(cfg, answerStream);
+            conn.http2->start(conn);
+        }
+    }
+
+    while (true)
+    {
+        if (conn.state == ConnState::Reading)
+        {
+            IoStatus status = readAvailable(conn);
+            if (conn.http2)
+                conn.http2->process(conn);
+            else
+                processRequests(conn, cfg);
+            if (conn.state == ConnState::Reading)
+            {
+                // HTTP/2 consumed a full buffer of frames: TLS may hold more already decrypted
+                if (conn.http2 && status == IoStatus::Done)
+                    continue;
+                // No complete request yet: wait for more bytes unless the peer is gone
+                if (status == IoStatus::Closed)
+                    conn.state = ConnState::Closed;
+                return;
+            }
         }
-        else
+
+        if (conn.state == ConnState::Writing)
         {
-            handleClientSSL(ssl, docRoot);
+            int64_t sendStart = monotonicNanos();
+            IoStatus status = flushOutput(conn);
+            recordLatency(Timer::Send, monotonicNanos() - sendStart);
+            if (status == IoStatus::WouldBlock)
+                return;
+            if (status == IoStatus::Closed || conn.closeAfterWrite)
+            {
+                conn.state = ConnState::Closed;
+                return;
+            }
+            // HTTP/2: the windows may allow more DATA before the client speaks again
+            if (conn.http2 && conn.http2->refill(conn))
+                continue;
+            // Keep-alive: go back to reading; pipelined bytes may already be buffered
+            conn.state = ConnState::Reading;
+            continue;
         }
-        SSL_shutdown(ssl);
-        SSL_free(ssl);
-        close(client_fd); });
 
-    t.detach();
+        return;
+    }
 }
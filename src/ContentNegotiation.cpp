@@ -1,52 +1,258 @@
 #include "../include/ContentNegotiation.hpp"
-#include "../include/Logger.hpp"
-#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
 
-std::vector<std::string> splitAndTrim(const std::string s)
+// Accept headers longer than this are parsed every time instead of being memoized
+constexpr size_t MAX_CACHED_ACCEPT = 1024;
+// Memoized headers per thread
+constexpr size_t ACCEPT_CACHE_SLOTS = 16;
+
+static std::string_view trimView(std::string_view s)
+{
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string_view::npos)
+        return {};
+    return s.substr(start, s.find_last_not_of(" \t") - start + 1);
+}
+
+static bool equalsNoCase(std::string_view a, std::string_view b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+                                               { return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y)); });
+}
+
+static std::string lowercase(std::string_view s)
 {
-    std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, ','))
+    std::string out(s);
+    for (char &c : out)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+/*
+ * Parses a qvalue ("0", "0.5", "1.000") into thousandths.
+ * Returns -1 for anything else.
+ */
+static int parseQValue(std::string_view value)
+{
+    if (value.empty() || (value[0] != '0' && value[0] != '1'))
+        return -1;
+    int q = (value[0] - '0') * 1000;
+    if (value.size() == 1)
+        return q;
+    if (value[1] != '.' || value.size() > 5)
+        return -1;
+    int scale = 100;
+    for (size_t i = 2; i < value.size(); ++i, scale /= 10)
     {
-        auto start = token.find_first_not_of(" \r\n\t");
-        auto end = token.find_last_not_of(" \r\n\t");
-        if (start == std::string::npos || end == std::string::npos)
+        if (value[i] < '0' || value[i] > '9')
+            return -1;
+        q += (value[i] - '0') * scale;
+    }
+    return q <= 1000 ? q : -1;
+}
+
+/*
+ * Joins the parameters of a media type (the text after its first ';'),
+ * lowercased and without whitespace, e.g. "level=1;charset=utf-8".
+ */
+static std::string normalizeParams(std::string_view params)
+{
+    std::string out;
+    for (char c : params)
+        if (c != ' ' && c != '\t')
+            out.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+    return out;
+}
+
+AcceptList AcceptList::parse(std::string_view header)
+{
+    AcceptList list;
+    size_t pos = 0;
+    while (pos <= header.size())
+    {
+        size_t comma = header.find(',', pos);
+        if (comma == std::string_view::npos)
+            comma = header.size();
+        std::string_view element = header.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        size_t semicolon = element.find(';');
+        std::string_view mediaType = trimView(element.substr(0, semicolon));
+        size_t slash = mediaType.find('/');
+        if (slash == std::string_view::npos || slash == 0 || slash + 1 == mediaType.size())
             continue;
-        token = token.substr(start, end - start + 1);
-        tokens.push_back(token);
+
+        MediaRange range;
+        range.type = lowercase(mediaType);
+        range.q = 1000;
+        bool anyType = mediaType.substr(0, slash) == "*";
+        bool anySubtype = mediaType.substr(slash + 1) == "*";
+        if (anyType && !anySubtype)
+            continue; // "*/html" is not a media range
+        range.specificity = anyType ? 0 : anySubtype ? 1 : 2;
+
+        // Parameters up to "q" belong to the range; anything after q is an accept-ext
+        bool valid = true;
+        std::string_view rest = semicolon == std::string_view::npos ? std::string_view() : element.substr(semicolon + 1);
+        while (!rest.empty())
+        {
+            size_t next = rest.find(';');
+            std::string_view param = trimView(rest.substr(0, next));
+            rest = next == std::string_view::npos ? std::string_view() : rest.substr(next + 1);
+            if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+            {
+                range.q = parseQValue(trimView(param.substr(2)));
+                valid = range.q >= 0;
+                break;
+            }
+            if (param.empty())
+                continue;
+            if (!range.params.empty())
+                range.params.push_back(';');
+            range.params += normalizeParams(param);
+        }
+        if (!valid)
+            continue;
+        if (!range.params.empty() && range.specificity == 2)
+            range.specificity = 3;
+        list.ranges.push_back(std::move(range));
+    }
+
+    // Most specific first; header order among equals
+    std::stable_sort(list.ranges.begin(), list.ranges.end(), [](const MediaRange &a, const MediaRange &b)
+                     { return a.specificity > b.specificity; });
+    return list;
+}
+
+int AcceptList::quality(std::string_view mimeType) const
+{
+    if (ranges.empty())
+        return 1000;
+
+    size_t semicolon = mimeType.find(';');
+    std::string_view base = trimView(mimeType.substr(0, semicolon));
+    std::string params;
+    if (semicolon != std::string_view::npos)
+        params = normalizeParams(mimeType.substr(semicolon + 1));
+    size_t slash = base.find('/');
+    std::string_view typePart = base.substr(0, slash == std::string_view::npos ? base.size() : slash + 1);
+
+    for (const MediaRange &range : ranges)
+    {
+        bool matches;
+        if (range.specificity == 0)
+            matches = true;
+        else if (range.specificity == 1)
+            matches = typePart.size() == range.type.size() - 1 &&
+                      std::equal(typePart.begin(), typePart.end(), range.type.begin(), [](char a, char b)
+                                 { return std::tolower(static_cast<unsigned char>(a)) == b; });
+        else
+            matches = base.size() == range.type.size() && range.params == params &&
+                      std::equal(base.begin(), base.end(), range.type.begin(), [](char a, char b)
+                                 { return std::tolower(static_cast<unsigned char>(a)) == b; });
+        if (matches)
+            return range.q;
     }
-    return tokens;
+    return 0;
 }
 
-bool isAcceptable(const std::string &acceptHeader, const std::string &mimeType)
+const AcceptList &acceptListFor(std::string_view header)
 {
-    if (acceptHeader.empty())
-        return true;
+    static const AcceptList acceptAll;
+    if (header.empty())
+        return acceptAll;
 
-    auto tokens = splitAndTrim(acceptHeader);
-    for (const auto &token : tokens)
+    struct Slot
     {
-        auto semicolon = token.find(';');
-        log("Header is " + token);
-        std::string mediaRange = (semicolon == std::string::npos) ? token : token.substr(0, semicolon);
+        std::string header;
+        AcceptList list;
+        bool filled = false;
+    };
+    thread_local Slot slots[ACCEPT_CACHE_SLOTS];
+    thread_local AcceptList uncached;
 
-        // If mediaRange == "*/*", allow everything
-        if (mediaRange == "*/*")
-            return true;
+    if (header.size() > MAX_CACHED_ACCEPT)
+    {
+        uncached = AcceptList::parse(header);
+        return uncached;
+    }
+    Slot &slot = slots[std::hash<std::string_view>{}(header) % ACCEPT_CACHE_SLOTS];
+    if (!slot.filled || slot.header != header)
+    {
+        slot.header.assign(header);
+        slot.list = AcceptList::parse(header);
+        slot.filled = true;
+    }
+    return slot.list;
+}
 
-        // If mediaRange ends with "/*" (e.g., "text/*") and mimeType starts with the same prefix, allow it
-        auto slashPos = mediaRange.find('/');
-        if (slashPos != std::string::npos && mediaRange.back() == '*')
+bool isAcceptable(std::string_view acceptHeader, std::string_view mimeType)
+{
+    return acceptListFor(acceptHeader).quality(mimeType) > 0;
+}
+
+ContentEncoding chooseEncoding(std::string_view acceptEncoding)
+{
+    // In thousandths; -1 means "not mentioned", 0 means explicitly refused
+    int gzipQ = -1, deflateQ = -1, anyQ = -1;
+    size_t pos = 0;
+    while (pos < acceptEncoding.size())
+    {
+        size_t comma = acceptEncoding.find(',', pos);
+        if (comma == std::string_view::npos)
+            comma = acceptEncoding.size();
+        std::string_view element = acceptEncoding.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        size_t semicolon = element.find(';');
+        std::string_view coding = trimView(element.substr(0, semicolon));
+        int q = 1000;
+        std::string_view rest = semicolon == std::string_view::npos ? std::string_view() : element.substr(semicolon + 1);
+        while (!rest.empty())
         {
-            std::string typePrefix = mediaRange.substr(0, slashPos);
-            if (mimeType.rfind(typePrefix + '/', 0) == 0)
-                return true;
+            size_t next = rest.find(';');
+            std::string_view param = trimView(rest.substr(0, next));
+            rest = next == std::string_view::npos ? std::string_view() : rest.substr(next + 1);
+            if (param.size() >= 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+            {
+                // A malformed qvalue counts as a refusal
+                q = std::max(parseQValue(trimView(param.substr(2))), 0);
+                break;
+            }
         }
 
-        if (mediaRange == mimeType)
-            return true;
+        if (equalsNoCase(coding, "gzip") || equalsNoCase(coding, "x-gzip"))
+            gzipQ = q;
+        else if (equalsNoCase(coding, "deflate"))
+            deflateQ = q;
+        else if (coding == "*")
+            anyQ = q;
     }
 
-    return false;
-}
\ No newline at end of file
+    if (gzipQ < 0)
+        gzipQ = anyQ;
+    if (deflateQ < 0)
+        deflateQ = anyQ;
+
+    if (gzipQ > 0 && gzipQ >= deflateQ)
+        return ContentEncoding::Gzip;
+    if (deflateQ > 0)
+        return ContentEncoding::Deflate;
+    return ContentEncoding::Identity;
+}
+
+const char *encodingName(ContentEncoding encoding)
+{
+    switch (encoding)
+    {
+    case ContentEncoding::Gzip:
+        return "gzip";
+    case ContentEncoding::Deflate:
+        return "deflate";
+    default:
+        return "";
+    }
+}
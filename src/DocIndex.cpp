@@ -0,0 +1,399 @@
+#include "../include/DocIndex.hpp"
+#include "../include/Exception.hpp"
+#include "../include/Logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                                IN_MOVED_TO | IN_DONT_FOLLOW | IN_ONLYDIR;
+constexpr int WATCH_POLL_MS = 500; // how often the watcher checks whether it should stop
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool normalizeUrlPath(std::string_view target, std::pmr::string &out)
+{
+    size_t end = target.find_first_of("?#");
+    if (end != std::string_view::npos)
+        target = target.substr(0, end);
+    if (target.empty() || target.front() != '/')
+        return false;
+
+    std::pmr::string decoded(out.get_allocator());
+    decoded.reserve(target.size());
+    for (size_t i = 0; i < target.size(); ++i)
+    {
+        char c = target[i];
+        if (c == '%')
+        {
+            int high = i + 2 < target.size() ? hexValue(target[i + 1]) : -1;
+            int low = high >= 0 ? hexValue(target[i + 2]) : -1;
+            if (low < 0)
+                return false;
+            c = static_cast<char>(high * 16 + low);
+            i += 2;
+        }
+        if (c == '\0')
+            return false;
+        decoded += c;
+    }
+
+    // `out` keeps a trailing '/' while segments are added; it is dropped at
+    // the end unless the path names a directory ("/a/", "/a/.", "/a/b/..")
+    out.assign(1, '/');
+    bool endsWithName = false;
+    size_t start = 1;
+    while (start <= decoded.size())
+    {
+        size_t slash = std::min(decoded.find('/', start), decoded.size());
+        std::string_view segment(decoded.data() + start, slash - start);
+        endsWithName = false;
+        if (segment == "..")
+        {
+            if (out.size() > 1)
+            {
+                out.pop_back();
+                out.resize(out.rfind('/') + 1);
+            }
+        }
+        else if (!segment.empty() && segment != ".")
+        {
+            out.append(segment);
+            out += '/';
+            endsWithName = true;
+        }
+        start = slash + 1;
+    }
+    if (endsWithName)
+        out.pop_back();
+    return true;
+}
+
+static int64_t steadyNanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+DocIndex::DocIndex(std::string docRoot, std::function<std::string_view(std::string_view)> mimeOf, size_t maxCachedSize,
+                   size_t maxOpenFiles)
+    : docRoot(std::move(docRoot)), mimeOf(std::move(mimeOf)), maxCachedSize(maxCachedSize), maxOpenFiles(maxOpenFiles)
+{
+    // "../public/" and "../public" index the same tree
+    while (this->docRoot.size() > 1 && this->docRoot.back() == '/')
+        this->docRoot.pop_back();
+}
+
+DocIndex::~DocIndex()
+{
+    stopping = true;
+    if (watcher.joinable())
+        watcher.join();
+    if (inotifyFd >= 0)
+        close(inotifyFd);
+}
+
+std::shared_ptr<const DocEntry> DocIndex::makeEntry(const std::string &urlPath, const struct stat &st, const DocEntry *previous)
+{
+    // The deleter returns the entry's descriptor to the open-file budget
+    std::shared_ptr<DocEntry> entry(new DocEntry, [this](DocEntry *e)
+                                    {
+                                        if (e->handle)
+                                            openHandles.fetch_sub(1, std::memory_order_relaxed);
+                                        delete e; });
+    entry->fullPath = docRoot + urlPath;
+    entry->mime = previous ? previous->mime : mimeOf(entry->fullPath);
+    entry->st = st;
+    entry->policy = HandlePolicy::CacheContent;
+    if (static_cast<size_t>(st.st_size) <= maxCachedSize)
+        return entry;
+
+    entry->policy = HandlePolicy::OpenPerRequest;
+    // The same file (inode) keeps its descriptor across metadata updates
+    if (previous && previous->handle && previous->st.st_ino == st.st_ino && previous->st.st_dev == st.st_dev)
+        entry->handle = previous->handle;
+    else if (openHandles.load(std::memory_order_relaxed) < maxOpenFiles)
+    {
+        int fd = open(entry->fullPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            entry->handle = std::make_shared<FileHandle>(fd);
+        }
+    }
+    if (entry->handle)
+    {
+        entry->policy = HandlePolicy::KeepOpen;
+        openHandles.fetch_add(1, std::memory_order_relaxed);
+    }
+    return entry;
+}
+
+void DocIndex::scan(const std::string &urlDir, Map &into, size_t &directoryCount)
+{
+    std::string fsDir = docRoot + urlDir;
+    DIR *dir = opendir(fsDir.c_str());
+    if (!dir)
+    {
+        if (urlDir == "/")
+            throw FileException("Cannot read docRoot " + docRoot + ": " + std::strerror(errno));
+        return; // removed meanwhile or unreadable; not served either way
+    }
+    ++directoryCount;
+    if (inotifyFd >= 0)
+    {
+        int wd = inotify_add_watch(inotifyFd, fsDir.c_str(), WATCH_MASK);
+        if (wd >= 0)
+            watches[wd] = urlDir;
+        else
+            LOG_WARN("inotify_add_watch failed for " + fsDir + ": " + std::strerror(errno));
+    }
+
+    std::vector<std::string> subdirectories;
+    while (dirent *item = readdir(dir))
+    {
+        std::string_view name = item->d_name;
+        if (name == "." || name == "..")
+            continue;
+
+        struct stat st;
+        // Follows file symlinks like the request path always did
+        if (fstatat(dirfd(dir), item->d_name, &st, 0) < 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+        {
+            struct stat link;
+            bool symlink = item->d_type == DT_LNK ||
+                           (item->d_type == DT_UNKNOWN && fstatat(dirfd(dir), item->d_name, &link, AT_SYMLINK_NOFOLLOW) == 0 &&
+                            S_ISLNK(link.st_mode));
+            if (!symlink)
+                subdirectories.push_back(urlDir + item->d_name + "/");
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            std::string urlPath = urlDir + item->d_name;
+            into[urlPath] = makeEntry(urlPath, st, nullptr);
+        }
+    }
+    closedir(dir);
+
+    // Recurse after closing, so deep trees hold one directory open at a time
+    for (const std::string &sub : subdirectories)
+        scan(sub, into, directoryCount);
+}
+
+void DocIndex::build()
+{
+    int64_t start = steadyNanos();
+    Map fresh;
+    size_t directoryCount = 0;
+    watches.clear();
+    scan("/", fresh, directoryCount);
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        entries.swap(fresh);
+    }
+    directories = directoryCount;
+    buildSeconds = static_cast<double>(steadyNanos() - start) / 1e9;
+    // `fresh` now holds the old entries and releases their descriptors here
+}
+
+bool DocIndex::startWatching()
+{
+    inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotifyFd < 0)
+        return false;
+    build();
+    watcher = std::thread([this]()
+                          { watchLoop(); });
+    return true;
+}
+
+std::shared_ptr<const DocEntry> DocIndex::lookup(std::string_view urlPath) const
+{
+    // The map needs a std::string to search for; this one keeps its capacity
+    thread_local std::string key;
+    key.assign(urlPath);
+    if (!key.empty() && key.back() == '/')
+        key += "index.html";
+
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = entries.find(key);
+    return it != entries.end() ? it->second : nullptr;
+}
+
+/*
+ * Re-reads one file's metadata after an event: updates, adds or drops its
+ * entry. The stat() happens outside the lock.
+ */
+void DocIndex::refresh(const std::string &urlPath)
+{
+    struct stat st;
+    bool regular = stat((docRoot + urlPath).c_str(), &st) == 0 && S_ISREG(st.st_mode);
+
+    std::shared_ptr<const DocEntry> previous;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        auto it = entries.find(urlPath);
+        if (it != entries.end())
+            previous = it->second;
+    }
+    if (!regular && !previous)
+        return;
+
+    std::shared_ptr<const DocEntry> updated = regular ? makeEntry(urlPath, st, previous.get()) : nullptr;
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (updated)
+            entries[urlPath] = std::move(updated);
+        else
+            entries.erase(urlPath);
+    }
+    updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DocIndex::addTree(const std::string &urlDir)
+{
+    Map added;
+    size_t directoryCount = 0;
+    scan(urlDir, added, directoryCount);
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (auto &[path, entry] : added)
+            entries[path] = std::move(entry);
+    }
+    updates.fetch_add(added.size(), std::memory_order_relaxed);
+}
+
+void DocIndex::removeTree(const std::string &urlDir)
+{
+    // A directory moved elsewhere keeps its watches; drop them too
+    for (auto it = watches.begin(); it != watches.end();)
+    {
+        if (it->second.compare(0, urlDir.size(), urlDir) == 0)
+        {
+            inotify_rm_watch(inotifyFd, it->first);
+            it = watches.erase(it);
+        }
+        else
+            ++it;
+    }
+
+    std::vector<std::shared_ptr<const DocEntry>> removed; // released after unlocking
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        if (it->first.compare(0, urlDir.size(), urlDir) == 0)
+        {
+            removed.push_back(std::move(it->second));
+            it = entries.erase(it);
+        }
+        else
+            ++it;
+    }
+    updates.fetch_add(removed.size(), std::memory_order_relaxed);
+}
+
+void DocIndex::watchLoop()
+{
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (!stopping)
+    {
+        pollfd pfd{inotifyFd, POLLIN, 0};
+        if (poll(&pfd, 1, WATCH_POLL_MS) <= 0)
+            continue;
+
+        // Directory events are applied in order; files touched by the batch
+        // are re-read once at the end, which sees their latest state
+        bool overflow = false;
+        std::unordered_set<std::string> changedFiles;
+        ssize_t length;
+        while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char *p = buffer; p < buffer + length;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    overflow = true;
+                    continue;
+                }
+                auto watch = watches.find(event->wd);
+                if (watch == watches.end())
+                    continue;
+                if (event->mask & IN_IGNORED)
+                {
+                    watches.erase(watch);
+                    continue;
+                }
+                if (event->len == 0 || overflow)
+                    continue;
+
+                std::string path = watch->second + event->name;
+                if (event->mask & IN_ISDIR)
+                {
+                    if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                        removeTree(path + "/");
+                    else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                        addTree(path + "/");
+                }
+                else
+                    changedFiles.insert(std::move(path));
+            }
+        }
+
+        if (overflow)
+        {
+            LOG_WARN("inotify queue overflowed; rebuilding the docRoot index");
+            try
+            {
+                build();
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(std::string("docRoot index rebuild failed: ") + e.what());
+            }
+            rebuilds.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        for (const std::string &path : changedFiles)
+            refresh(path);
+        directories = watches.size();
+    }
+}
+
+DocIndex::Stats DocIndex::stats() const
+{
+    Stats s{};
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        s.files = entries.size();
+        for (const auto &[path, entry] : entries)
+            s.bytes += static_cast<uint64_t>(entry->st.st_size);
+    }
+    s.directories = directories.load(std::memory_order_relaxed);
+    s.openHandles = openHandles.load(std::memory_order_relaxed);
+    s.buildSeconds = buildSeconds.load(std::memory_order_relaxed);
+    s.updates = updates.load(std::memory_order_relaxed);
+    s.rebuilds = rebuilds.load(std::memory_order_relaxed);
+    return s;
+}
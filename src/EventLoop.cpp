@@ -0,0 +1,216 @@
+#include "../include/EventLoop.hpp"
+#include "../include/ConnectionManager.hpp"
+#include "../include/SocketManager.hpp"
+#include "../include/Exception.hpp"
+#include "../include/Logger.hpp"
+#include "../include/Metrics.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h> // for shutdown
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+constexpr int MAX_EVENTS = 256;        // events handled per epoll_wait() call
+constexpr int SWEEP_INTERVAL_MS = 1000; // how often idle connections are looked for
+constexpr int PAUSED_POLL_MS = 10;      // how often a paused TLS listener checks for free handshake slots
+
+EventLoop::EventLoop(const Config &cfg, SSL_CTX *sslCtx, ThreadPool &pool)
+    : cfg(cfg), sslCtx(sslCtx), pool(pool)
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+        throw SocketException("epoll_create1 failed: " + std::string(std::strerror(errno)));
+}
+
+EventLoop::~EventLoop()
+{
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    connections.clear();
+    close(epollFd);
+}
+
+void EventLoop::addListener(int listenFd, bool tls)
+{
+    setNonBlocking(listenFd);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = listenFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev) < 0)
+        throw SocketException("epoll_ctl(ADD listener) failed: " + std::string(std::strerror(errno)));
+    listeners[listenFd] = tls;
+}
+
+void EventLoop::run()
+{
+    epoll_event events[MAX_EVENTS];
+    int64_t lastSweep = monotonicMillis();
+    while (true)
+    {
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, tlsAcceptPaused ? PAUSED_POLL_MS : SWEEP_INTERVAL_MS);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw SocketException("epoll_wait failed: " + std::string(std::strerror(errno)));
+        }
+
+        int64_t now = monotonicMillis();
+        if (now - lastSweep >= SWEEP_INTERVAL_MS)
+        {
+            closeIdleConnections();
+            lastSweep = now;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            int fd = events[i].data.fd;
+
+            auto listener = listeners.find(fd);
+            if (listener != listeners.end())
+            {
+                acceptClients(fd, listener->second);
+                continue;
+            }
+
+            Connection *conn = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(connectionsMutex);
+                auto it = connections.find(fd);
+                if (it != connections.end())
+                    conn = it->second.get();
+            }
+            if (!conn)
+                continue;
+
+            // The one-shot registration is now disarmed: the job owns the connection until it re-arms it.
+            // The events travel in the connection so the job fits std::function's inline storage.
+            conn->readyEvents = events[i].events;
+            pool.submit([this, conn]()
+                        { serviceConnection(*conn, conn->readyEvents); });
+        }
+
+        // Connections that queued up while paused are still in the backlog,
+        // and no new edge will announce them
+        if (tlsAcceptPaused && pendingHandshakes() < cfg.maxPendingHandshakes)
+        {
+            tlsAcceptPaused = false;
+            for (const auto &[listenFd, tls] : listeners)
+                if (tls)
+                    acceptClients(listenFd, true);
+        }
+    }
+}
+
+void EventLoop::acceptClients(int listenFd, bool tls)
+{
+    // Edge-triggered: keep accepting until the queue is empty or we miss the next edge
+    while (true)
+    {
+        // Past the cap new TLS clients wait in the kernel backlog, where they
+        // cost no SSL object, until run() sees free handshake slots
+        if (tls && pendingHandshakes() >= cfg.maxPendingHandshakes)
+        {
+            tlsAcceptPaused = true;
+            return;
+        }
+
+        int client_fd = acceptClient(listenFd);
+        if (client_fd < 0)
+            return;
+
+        SSL *ssl = nullptr;
+        if (tls)
+        {
+            ssl = SSL_new(sslCtx);
+            if (!ssl)
+            {
+                close(client_fd);
+                continue;
+            }
+            SSL_set_fd(ssl, client_fd);
+            // Non-blocking writes may be retried from a grown (moved) output buffer
+            SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        }
+
+        // Publish the connection before arming it so a worker can never miss it
+        {
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            connections.emplace(client_fd, std::make_unique<Connection>(client_fd, ssl));
+        }
+        recordConnectionOpened();
+
+        // Clients speak first, so only readability is armed initially
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+        ev.data.fd = client_fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, client_fd, &ev) < 0)
+        {
+            perror("epoll_ctl");
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+            connections.erase(client_fd); // the destructor closes the socket
+            recordConnectionClosed();
+        }
+    }
+}
+
+void EventLoop::serviceConnection(Connection &conn, uint32_t events)
+{
+    if (events & EPOLLERR)
+        conn.state = ConnState::Closed;
+    else
+        driveConnection(conn, cfg);
+
+    if (conn.state == ConnState::Closed)
+        closeConnection(conn.fd);
+    else
+        rearm(conn);
+}
+
+void EventLoop::rearm(Connection &conn)
+{
+    // Ask for writability only while there is something to write, otherwise
+    // a writable socket would wake us up immediately after every re-arm.
+    bool wantWrite = conn.state == ConnState::Writing || (conn.ssl && SSL_want_write(conn.ssl));
+
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+    if (wantWrite)
+        ev.events |= EPOLLOUT;
+    ev.data.fd = conn.fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, conn.fd, &ev) < 0)
+    {
+        perror("epoll_ctl");
+        closeConnection(conn.fd);
+    }
+}
+
+void EventLoop::closeConnection(int fd)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    if (connections.erase(fd)) // Connection's destructor releases SSL and closes the socket
+        recordConnectionClosed();
+}
+
+void EventLoop::closeIdleConnections()
+{
+    int64_t deadline = monotonicMillis() - static_cast<int64_t>(cfg.keepAliveTimeout) * 1000;
+    int64_t handshakeDeadlineNs = monotonicNanos() - static_cast<int64_t>(cfg.tlsHandshakeTimeout) * 1000000000;
+
+    // A worker may own any of these connections right now, so they are not
+    // destroyed here. shutdown() is safe under concurrent use: the socket
+    // reports a hang-up and whoever drives it next sees EOF and closes it.
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (const auto &[fd, conn] : connections)
+    {
+        // A handshake has a fixed budget, so trickling bytes does not extend it
+        if (conn->handshakePending.load(std::memory_order_relaxed) && conn->acceptedAtNs < handshakeDeadlineNs)
+        {
+            shutdown(fd, SHUT_RDWR);
+            recordTlsHandshakeTimeout();
+        }
+        else if (conn->lastActive.load(std::memory_order_relaxed) < deadline)
+            shutdown(fd, SHUT_RDWR);
+    }
+}
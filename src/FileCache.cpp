@@ -0,0 +1,213 @@
+#include "../include/FileCache.hpp"
+#include "../include/Compression.hpp"
+#include "../include/Metrics.hpp"
+#include <algorithm>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+int64_t mtimeNanos(const struct stat &st)
+{
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+std::shared_ptr<const std::string> CachedFile::compressed(ContentEncoding encoding) const
+{
+    if (encoding == ContentEncoding::Identity)
+        return nullptr;
+    size_t slot = encoding == ContentEncoding::Gzip ? 0 : 1;
+
+    std::lock_guard<std::mutex> lock(variantMutex);
+    if (!variantBuilt[slot])
+    {
+        variantBuilt[slot] = true;
+        auto body = std::make_shared<std::string>();
+        if (compressBody(content.data(), size, encoding, *body) && body->size() < size)
+        {
+            body->shrink_to_fit();
+            variants[slot] = std::move(body);
+        }
+    }
+    return variants[slot];
+}
+
+/*
+ * Wraps the complete contents of the file version described by `st`.
+ */
+static std::shared_ptr<const CachedFile> makeEntry(std::string content, const struct stat &st, std::string_view mime)
+{
+    auto entry = std::make_shared<CachedFile>();
+    entry->content = std::move(content);
+    entry->mime = mime;
+    entry->size = entry->content.size();
+    entry->mtimeNs = mtimeNanos(st);
+    entry->inode = st.st_ino;
+    return entry;
+}
+
+/*
+ * Reads a whole regular file. Size, mtime and inode are taken from the
+ * descriptor actually read, so the entry always describes its own content.
+ */
+static std::shared_ptr<const CachedFile> loadFile(const std::string &fullPath, std::string_view mime)
+{
+    int fd = open(fullPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    std::string content(static_cast<size_t>(st.st_size), '\0');
+    size_t done = 0;
+    while (done < content.size())
+    {
+        ssize_t got = read(fd, &content[done], content.size() - done);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        done += static_cast<size_t>(got);
+    }
+    close(fd);
+    if (done != content.size())
+        return nullptr; // the file changed while we read it; do not cache a torn copy
+    return makeEntry(std::move(content), st, mime);
+}
+
+FileCache::FileCache(size_t capacityBytes)
+    : capacity(capacityBytes), shardCapacity(capacityBytes / SHARD_COUNT)
+{
+    for (size_t i = 0; i < SHARD_COUNT; ++i)
+        shards.push_back(std::make_unique<Shard>());
+}
+
+bool FileCache::cacheable(size_t size) const
+{
+    return size <= maxEntrySize();
+}
+
+size_t FileCache::maxEntrySize() const
+{
+    return std::min(MAX_ENTRY_SIZE, shardCapacity);
+}
+
+FileCache::Shard &FileCache::shardFor(const std::string &fullPath)
+{
+    return *shards[std::hash<std::string>{}(fullPath) % SHARD_COUNT];
+}
+
+/*
+ * Returns the fresh entry for `fullPath` and marks it most recently used.
+ * A stale entry is dropped. Counts a hit; the caller counts misses.
+ */
+std::shared_ptr<const CachedFile> FileCache::lookup(Shard &shard, const std::string &fullPath, const struct stat &st)
+{
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(fullPath);
+    if (it == shard.index.end())
+        return nullptr;
+
+    const CachedFile &cached = *it->second->second;
+    if (cached.size == static_cast<size_t>(st.st_size) && cached.mtimeNs == mtimeNanos(st) && cached.inode == st.st_ino)
+    {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second->second;
+    }
+    // Stale: the file changed on disk since it was cached
+    shard.bytes -= cached.size;
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+    return nullptr;
+}
+
+std::shared_ptr<const CachedFile> FileCache::get(const std::string &fullPath, const struct stat &st, std::string_view mime)
+{
+    if (!cacheable(static_cast<size_t>(st.st_size)))
+        return nullptr;
+
+    Shard &shard = shardFor(fullPath);
+    if (auto cached = lookup(shard, fullPath, st))
+        return cached;
+
+    misses.fetch_add(1, std::memory_order_relaxed);
+    // Disk I/O happens outside the shard lock
+    int64_t readStart = monotonicNanos();
+    auto entry = loadFile(fullPath, mime);
+    recordLatency(Timer::FileRead, monotonicNanos() - readStart);
+    if (entry && cacheable(entry->size))
+        insert(shard, fullPath, entry);
+    return entry;
+}
+
+std::shared_ptr<const CachedFile> FileCache::find(const std::string &fullPath, const struct stat &st)
+{
+    if (!cacheable(static_cast<size_t>(st.st_size)))
+        return nullptr;
+    return lookup(shardFor(fullPath), fullPath, st);
+}
+
+std::shared_ptr<const CachedFile> FileCache::probe(const std::string &fullPath, const struct stat &st)
+{
+    auto cached = find(fullPath, st);
+    if (!cached && cacheable(static_cast<size_t>(st.st_size)))
+        misses.fetch_add(1, std::memory_order_relaxed);
+    return cached;
+}
+
+void FileCache::put(const std::string &fullPath, const struct stat &st, std::string_view mime, std::string content)
+{
+    // A short read means the file shrank meanwhile; that copy is torn
+    if (content.size() != static_cast<size_t>(st.st_size) || !cacheable(content.size()))
+        return;
+    insert(shardFor(fullPath), fullPath, makeEntry(std::move(content), st, mime));
+}
+
+void FileCache::insert(Shard &shard, const std::string &fullPath, std::shared_ptr<const CachedFile> entry)
+{
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another thread may have loaded the same file meanwhile; keep the newest
+    auto existing = shard.index.find(fullPath);
+    if (existing != shard.index.end())
+    {
+        shard.bytes -= existing->second->second->size;
+        shard.lru.erase(existing->second);
+        shard.index.erase(existing);
+    }
+
+    while (!shard.lru.empty() && shard.bytes + entry->size > shardCapacity)
+    {
+        auto &victim = shard.lru.back();
+        shard.bytes -= victim.second->size;
+        shard.index.erase(victim.first);
+        shard.lru.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.bytes += entry->size;
+    shard.lru.emplace_front(fullPath, std::move(entry));
+    shard.index[fullPath] = shard.lru.begin();
+}
+
+FileCache::Stats FileCache::stats() const
+{
+    Stats s{};
+    s.hits = hits.load(std::memory_order_relaxed);
+    s.misses = misses.load(std::memory_order_relaxed);
+    s.evictions = evictions.load(std::memory_order_relaxed);
+    s.capacity = capacity;
+    for (const auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        s.bytes += shard->bytes;
+        s.entries += shard->lru.size();
+    }
+    return s;
+}
@@ -2,221 +2,561 @@
 #include "../include/Logger.hpp"
 #include <unordered_map>
 #include <algorithm>
-#include <iterator>
-#include <fstream>
+#include <charconv>
+#include <memory>
 #include <sstream>
 #include <string>
-#include <unistd.h>
-#include <openssl/ssl.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>    // for open
+#include <sys/stat.h> // for stat, fstat
 #include "../include/HttpResponse.hpp"
 #include "../include/Exception.hpp"
+#include "../include/Compression.hpp"
+#include "../include/ContentNegotiation.hpp"
+#include "../include/ByteRange.hpp"
+#include "../include/MemoryPool.hpp"
+#include <random>
+#include <vector>
 
-std::string getMimeType(const std::string &path)
-{
-    // Find last dot in filename
-    size_t pos = path.rfind('.');
-    if (pos == std::string::npos)
-        return "application/octet-stream";
-
-    // find extention
-    std::string ext = path.substr(pos + 1);
-    // make lower case
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-
-    // static so that the lookup table is constructed only once and shared across calls
-    static const std::unordered_map<std::string, std::string> mimeTypes = {
-        {"html", "text/html"},
-        {"htm", "text/html"},
-        {"css", "text/css"},
-        {"js", "application/javascript"},
-        {"json", "application/json"},
-        {"txt", "text/plain"},
-        {"png", "image/png"},
-        {"jpg", "image/jpeg"},
-        {"jpeg", "image/jpeg"},
-        {"gif", "image/gif"},
-        {"ico", "image/x-icon"},
-        {"svg", "image/svg+xml"},
-        {"pdf", "application/pdf"},
-        {"doc", "application/msword"}};
-
-    std::unordered_map<std::string, std::string>::const_iterator it = mimeTypes.find(ext);
-    // if type not found
-    if (it == mimeTypes.end())
-        return "application/octet-stream";
-    return it->second;
-}
-
-void serveStaticFile(int fd, const std::string &path, const std::string &docRoot)
-{
-    std::string fullPath = docRoot + path;
-    if (path == "/")
-        fullPath += "index.html";
-
-    // input file stream
-    // In text mode, some systems translate end-of-line sequences ("\r\n" <-> "\n");
-    // in binary mode, no such translations occur and bytes are read exactly as-is.
-    std::ifstream file(fullPath, std::ios::binary);
-    if (!file)
-    {
-        std::string body = "<html><body><h1>404 Not Found</h1></body></html>";
-        sendErrorResponse(fd, 404, "Not Found", body);
-        log("serveStaticFile: Not Found Path is " + fullPath);
-        return;
+// Bodies up to this size are copied behind the response head by sendResponse()
+constexpr size_t INLINE_BODY_MAX = 2048;
+
+// Shared by all workers; created once by initFileCache() before the event loop starts
+static std::unique_ptr<FileCache> fileCache;
+
+void initFileCache(size_t capacityBytes)
+{
+    fileCache = capacityBytes > 0 ? std::make_unique<FileCache>(capacityBytes) : nullptr;
+}
+
+// Set by I/O backends that load cache misses asynchronously, see setCacheFiller()
+static thread_local CacheFiller *cacheFiller = nullptr;
+
+void setCacheFiller(CacheFiller *filler)
+{
+    cacheFiller = filler;
+}
+
+void storeInFileCache(const std::string &fullPath, const struct stat &st, std::string_view mime, std::string content)
+{
+    if (fileCache)
+        fileCache->put(fullPath, st, mime, std::move(content));
+}
+
+FileCache::Stats fileCacheStats()
+{
+    return fileCache ? fileCache->stats() : FileCache::Stats{};
+}
+
+// Created once by initDocIndex() before the event loop starts; null means stat() per request
+static std::unique_ptr<DocIndex> docIndex;
+
+void initDocIndex(const std::string &docRoot, size_t maxOpenFiles)
+{
+    size_t maxCachedSize = fileCache ? fileCache->maxEntrySize() : 0;
+    docIndex = std::make_unique<DocIndex>(docRoot, getMimeType, maxCachedSize, maxOpenFiles);
+    if (!docIndex->startWatching())
+    {
+        LOG_WARN(std::string("inotify unavailable (") + std::strerror(errno) + "); the docRoot index will not see changes");
+        docIndex->build();
     }
-    else if (!file.is_open())
+    DocIndex::Stats s = docIndex->stats();
+    LOG_INFO("docRoot index: " + std::to_string(s.files) + " files in " + std::to_string(s.directories) +
+             " directories (" + std::to_string(s.bytes) + " bytes, " + std::to_string(s.openHandles) +
+             " kept open) built in " + std::to_string(static_cast<int64_t>(s.buildSeconds * 1000)) + " ms");
+}
+
+DocIndex::Stats docIndexStats()
+{
+    return docIndex ? docIndex->stats() : DocIndex::Stats{};
+}
+
+// Set once by initCacheControl() before the event loop starts
+static std::vector<std::pair<std::string, std::string>> cacheControlRules;
+
+void initCacheControl(const std::vector<std::pair<std::string, std::string>> &rules)
+{
+    cacheControlRules = rules;
+}
+
+/*
+ * Picks the Cache-Control value for a response. The longest matching path
+ * prefix wins; otherwise an exact MIME type beats a "type/…" wildcard rule.
+ * Returns nullptr when no rule applies.
+ */
+static const std::string *cacheControlFor(std::string_view path, std::string_view mime)
+{
+    const std::string *byPath = nullptr, *byMime = nullptr, *byType = nullptr;
+    size_t longest = 0;
+    for (const auto &[match, value] : cacheControlRules)
     {
-        throw FileException("Failed to open file: " + fullPath);
+        if (match.front() == '/')
+        {
+            if (path.compare(0, match.size(), match) == 0 && match.size() > longest)
+            {
+                byPath = &value;
+                longest = match.size();
+            }
+        }
+        else if (match == mime)
+        {
+            byMime = &value;
+        }
+        else if (match.size() > 2 && match.compare(match.size() - 2, 2, "/*") == 0 &&
+                 mime.compare(0, match.size() - 1, match, 0, match.size() - 1) == 0)
+        {
+            byType = &value;
+        }
     }
+    return byPath ? byPath : byMime ? byMime : byType;
+}
+
+/*
+ * The bytes of a file about to be sent: either a cache entry or an open
+ * descriptor, plus the size, mtime and inode of exactly that version.
+ */
+struct FileBody
+{
+    std::shared_ptr<const CachedFile> cached;
+    std::shared_ptr<FileHandle> handle;
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    ino_t inode = 0;
+};
+
+/*
+ * The form of the body a request gets: whether it depends on
+ * Accept-Encoding at all, the negotiated coding and, unless that is
+ * Identity, the compressed bytes from the cache entry.
+ */
+struct Representation
+{
+    bool varies = false;
+    ContentEncoding encoding = ContentEncoding::Identity;
+    std::shared_ptr<const std::string> variant;
+};
 
-    // Read entire file into a string using input stream buffer iterators
-    std::string content(
-        (std::istreambuf_iterator<char>(file)), // iterator positioned at start of file stream
-        std::istreambuf_iterator<char>()        // end-of-stream iterator indicating EOF(end of file)
-    );
+/*
+ * Negotiates Accept-Encoding for `body`. Compressed bodies exist only for
+ * cache entries, and only compressible types depend on the header.
+ */
+static Representation selectRepresentation(const HttpRequest &req, const FileBody &body, std::string_view mime)
+{
+    Representation rep;
+    rep.varies = body.cached && shouldCompress(mime, body.cached->size);
+    if (!rep.varies)
+        return rep;
 
-    std::string mime = getMimeType(fullPath);
-    log("Serving file: " + fullPath);
-    sendResponse(fd, content, mime);
+    ContentEncoding encoding = chooseEncoding(req.headers.find("Accept-Encoding"));
+    if (encoding == ContentEncoding::Identity)
+        return rep;
+    rep.variant = body.cached->compressed(encoding);
+    if (rep.variant)
+        rep.encoding = encoding;
+    return rep;
 }
 
-void serveStaticFileSSL(SSL *ssl, const std::string &path, const std::string &docRoot)
+static void appendNumber(std::pmr::string &out, uint64_t value, int base = 10)
 {
-    std::string fullPath = docRoot + path;
-    log("Serving file: " + fullPath);
-    if (path == "/")
-        fullPath += "index.html";
+    char digits[20];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, base);
+    out.append(digits, static_cast<size_t>(result.ptr - digits));
+}
 
-    // input file stream
-    // In text mode, some systems translate end-of-line sequences ("\r\n" <-> "\n");
-    // in binary mode, no such translations occur and bytes are read exactly as-is.
-    std::ifstream file(fullPath, std::ios::binary);
-    if (!file)
+/*
+ * Strong entity tag of one representation of a file version: inode, size
+ * and mtime, whether or not the file is cached, so the tag does not change
+ * when the entry is loaded or evicted. Compressed bodies get the coding
+ * appended, since their bytes differ.
+ * Lives in the request arena.
+ */
+static std::pmr::string entityTag(const FileBody &body, ContentEncoding encoding)
+{
+    std::pmr::string tag("\"", &requestArena());
+    appendNumber(tag, static_cast<uint64_t>(body.inode), 16);
+    tag += '-';
+    appendNumber(tag, body.size, 16);
+    tag += '-';
+    appendNumber(tag, static_cast<uint64_t>(body.mtimeNs), 16);
+    if (encoding != ContentEncoding::Identity)
     {
-        std::string body = "<html><body><h1>404 Not Found</h1></body></html>";
-        sendResponseSSL(ssl, "404 Not Found\n", "text/plain");
-        log("fullPath is " + fullPath);
+        tag += '-';
+        tag += encodingName(encoding);
+    }
+    tag += '"';
+    return tag;
+}
+
+/*
+ * Validator and caching headers shared by 200, 206 and 304 responses.
+ */
+static void writeCacheHeaders(ResponseHead &head, const HttpRequest &req, std::string_view mime, std::string_view etag, int64_t mtimeNs)
+{
+    char lastModified[HTTP_DATE_LENGTH + 1];
+    formatHttpDate(static_cast<time_t>(mtimeNs / 1000000000), lastModified);
+    head.header("ETag", etag).header("Last-Modified", std::string_view(lastModified, HTTP_DATE_LENGTH));
+    if (const std::string *cacheControl = cacheControlFor(req.path, mime))
+        head.header("Cache-Control", *cacheControl);
+}
+
+/*
+ * Whether an If-None-Match list ("*", or comma-separated entity tags)
+ * matches `etag` under weak comparison, i.e. ignoring "W/" prefixes.
+ */
+static bool noneMatchHits(std::string_view header, std::string_view etag)
+{
+    size_t pos = 0;
+    while (pos < header.size())
+    {
+        char c = header[pos];
+        if (c == '*')
+            return true;
+        if (c == '"')
+        {
+            size_t end = header.find('"', pos + 1);
+            if (end == std::string_view::npos)
+                return false;
+            if (header.substr(pos, end - pos + 1) == etag)
+                return true;
+            pos = end + 1;
+            continue;
+        }
+        pos++; // separators, whitespace and "W/"
+    }
+    return false;
+}
+
+/*
+ * Queues `length` bytes of the body starting at `offset`, borrowed from the
+ * cache entry or streamed from the descriptor.
+ */
+static void queueBody(Connection &conn, const FileBody &body, uint64_t offset, uint64_t length)
+{
+    if (body.cached)
+        queueBorrowed(conn, body.cached, body.cached->content.data() + offset, static_cast<size_t>(length));
+    else
+        queueFile(conn, body.handle, static_cast<off_t>(offset), static_cast<size_t>(length));
+}
+
+/*
+ * Whether an If-Range validator still matches the file, so the Range header
+ * may be honoured. Without If-Range it always does. An entity tag must match
+ * the identity ETag exactly (strong comparison); a date must equal the mtime.
+ */
+static bool ifRangeMatches(std::string_view ifRange, const FileBody &body)
+{
+    if (ifRange.empty())
+        return true;
+    if (ifRange.front() == '"' || ifRange.substr(0, 2) == "W/")
+        return ifRange == entityTag(body, ContentEncoding::Identity);
+    time_t date;
+    if (!parseHttpDate(ifRange, date))
+        return false;
+    return static_cast<int64_t>(date) == body.mtimeNs / 1000000000;
+}
+
+// "bytes first-last/size", the Content-Range value of one satisfied range, in the request arena
+static std::pmr::string contentRange(const ByteRange &r, uint64_t size)
+{
+    std::pmr::string range("bytes ", &requestArena());
+    appendNumber(range, r.first);
+    range += '-';
+    appendNumber(range, r.last);
+    range += '/';
+    appendNumber(range, size);
+    return range;
+}
+
+/*
+ * Separator between the parts of multipart/byteranges responses. It is
+ * random per process so it cannot be predicted and planted in a file.
+ */
+static const std::string &multipartBoundary()
+{
+    static const std::string boundary = []
+    {
+        std::random_device rd;
+        std::ostringstream out;
+        out << "CppWebServer-" << std::hex << rd() << rd();
+        return out.str();
+    }();
+    return boundary;
+}
+
+/*
+ * Queues a 206 response for `ranges` (sorted, non-overlapping): a single
+ * range is sent as a plain body with Content-Range, several as
+ * multipart/byteranges with one part per range.
+ */
+static void sendRanges(Connection &conn, const HttpRequest &req, std::string_view mime, const FileBody &body, const std::pmr::vector<ByteRange> &ranges)
+{
+    ResponseHead head(conn, 206);
+    head.header("Accept-Ranges", "bytes");
+    writeCacheHeaders(head, req, mime, entityTag(body, ContentEncoding::Identity), body.mtimeNs);
+
+    if (ranges.size() == 1)
+    {
+        const ByteRange &r = ranges.front();
+        head.header("Content-Type", mime)
+            .header("Content-Range", contentRange(r, body.size))
+            .header("Content-Length", r.length());
+        head.end();
+        queueBody(conn, body, r.first, r.length());
         return;
     }
 
-    // Read entire file into a string using input stream buffer iterators
-    std::string content(
-        (std::istreambuf_iterator<char>(file)), // iterator positioned at start of file stream
-        std::istreambuf_iterator<char>()        // end-of-stream iterator indicating EOF(end of file)
-    );
+    // Part headers are built first because Content-Length must cover them
+    const std::string &boundary = multipartBoundary();
+    std::pmr::vector<std::pmr::string> partHeaders(&requestArena());
+    partHeaders.reserve(ranges.size());
+    uint64_t total = 0;
+    for (const ByteRange &r : ranges)
+    {
+        std::pmr::string &part = partHeaders.emplace_back();
+        part.append("\r\n--").append(boundary).append("\r\nContent-Type: ").append(mime);
+        part.append("\r\nContent-Range: ").append(contentRange(r, body.size)).append("\r\n\r\n");
+        total += part.size() + r.length();
+    }
+    std::pmr::string closing("\r\n--", &requestArena());
+    closing.append(boundary).append("--\r\n");
+    total += closing.size();
 
-    std::string mime = getMimeType(fullPath);
-    sendResponseSSL(ssl, content, mime);
+    std::pmr::string contentType("multipart/byteranges; boundary=", &requestArena());
+    contentType += boundary;
+    head.header("Content-Type", contentType).header("Content-Length", total);
+    head.end();
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        queueOutput(conn, partHeaders[i]);
+        queueBody(conn, body, ranges[i].first, ranges[i].length());
+    }
+    queueOutput(conn, closing);
 }
 
-void sendResponse(int fd, const std::string &body, const std::string &contentType)
+void serveStaticFile(Connection &conn, const HttpRequest &req, const StaticFile &file)
 {
-    // Build status line and headers dynamically
-    std::ostringstream resp;
-    resp << "HTTP/1.1 200 OK\r\n"
-         << "Content-Type: " << contentType << "\r\n"
-         << "Content-Length: " << body.size() << "\r\n"
-         << "Connection: close\r\n\r\n"
-         << body;
+    const DocEntry &entry = *file.entry;
+    size_t size = static_cast<size_t>(entry.st.st_size);
+    bool headOnly = req.method == "HEAD";
+    FileBody body;
+    bool fillCache = false;
 
-    // Send the full response
-    std::string response = resp.str();
-    const char *data = response.c_str();
-    ssize_t to_send = response.size();
-    ssize_t total_sent = 0;
-    while (total_sent < to_send)
+    // Small, hot files are served from RAM; the stat() done by peekFile()
+    // is what revalidates the cached copy.
+    if (fileCache && fileCache->cacheable(size))
     {
-        ssize_t sent = write(fd, data + total_sent, to_send - total_sent);
-        if (sent < 0)
+        // With a filler this thread never waits for the disk: the miss is
+        // streamed below and the cache is filled in the background
+        body.cached = cacheFiller ? fileCache->probe(entry.fullPath, entry.st) : fileCache->get(entry.fullPath, entry.st, entry.mime);
+        fillCache = !body.cached && cacheFiller;
+        if (body.cached)
         {
-            perror("write");
-            exit(EXIT_FAILURE);
+            body.size = body.cached->size;
+            body.mtimeNs = body.cached->mtimeNs;
+            body.inode = body.cached->inode;
         }
-        total_sent += sent;
     }
-}
 
-void sendResponseSSL(SSL *ssl, const std::string &body, const std::string &contentType)
-{
-    // Build status line and headers dynamically
-    std::ostringstream resp;
-    resp << "HTTP/1.1 200 OK\r\n"
-         << "Content-Type: " << contentType << "\r\n"
-         << "Content-Length: " << body.size() << "\r\n"
-         << "Connection: close\r\n\r\n"
-         << body;
+    if (!body.cached && headOnly && file.indexed)
+    {
+        // No body to send, and the index is current: no need to open the file
+        body.size = static_cast<uint64_t>(entry.st.st_size);
+        body.mtimeNs = mtimeNanos(entry.st);
+        body.inode = entry.st.st_ino;
+    }
+    else if (!body.cached && entry.handle)
+    {
+        // The index keeps large files open; fstat() on the shared descriptor
+        // gives the size of exactly what will be streamed
+        body.handle = entry.handle;
+        struct stat st;
+        if (fstat(body.handle->fd, &st) < 0)
+            throw FileException("Failed to stat file: " + entry.fullPath);
+        body.size = static_cast<uint64_t>(st.st_size);
+        body.mtimeNs = mtimeNanos(st);
+        body.inode = st.st_ino;
+    }
+    else if (!body.cached)
+    {
+        // Open once and keep the descriptor: the body is streamed from it later,
+        // so its size must come from the same open file (fstat), not a second lookup.
+        int fd = open(entry.fullPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            std::string notFound = "<html><body><h1>404 Not Found</h1></body></html>";
+            sendErrorResponse(conn, 404, "Not Found", notFound, headOnly);
+            LOG_DEBUG("serveStaticFile: Not Found Path is " + entry.fullPath);
+            return;
+        }
+        body.handle = std::make_shared<FileHandle>(fd);
+        // Streamed front to back: lets the kernel read ahead more aggressively
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-    // Send the full response
-    std::string response = resp.str();
-    const char *data = response.c_str();
-    ssize_t to_send = response.size();
-    ssize_t total_sent = 0;
-    while (total_sent < to_send)
+        struct stat st;
+        if (fstat(fd, &st) < 0)
+            throw FileException("Failed to stat file: " + entry.fullPath);
+        if (!S_ISREG(st.st_mode))
+        {
+            std::string notFound = "<html><body><h1>404 Not Found</h1></body></html>";
+            sendErrorResponse(conn, 404, "Not Found", notFound, headOnly);
+            return;
+        }
+        body.size = static_cast<uint64_t>(st.st_size);
+        body.mtimeNs = mtimeNanos(st);
+        body.inode = st.st_ino;
+        if (fillCache && fileCache->cacheable(body.size))
+            cacheFiller->fill(body.handle, entry.fullPath, st, entry.mime);
+    }
+
+    LOG_DEBUG("Serving file: " + entry.fullPath);
+
+    // Range only applies to GET; ranges always address the uncompressed bytes
+    std::string_view rangeHeader = req.headers.find("Range");
+    if (!headOnly && !rangeHeader.empty() && ifRangeMatches(req.headers.find("If-Range"), body))
     {
-        ssize_t sent = SSL_write(ssl, data + total_sent, to_send - total_sent);
-        if (sent < 0)
+        std::pmr::vector<ByteRange> ranges(&requestArena());
+        RangeResult result = parseRangeHeader(rangeHeader, body.size, ranges);
+        if (result == RangeResult::Unsatisfiable)
         {
-            perror("write");
-            exit(EXIT_FAILURE);
+            std::pmr::string unsatisfied("bytes */", &requestArena());
+            appendNumber(unsatisfied, body.size);
+            ResponseHead head(conn, 416);
+            head.header("Content-Range", unsatisfied).header("Content-Length", "0");
+            head.end();
+            return;
+        }
+        if (result == RangeResult::Partial)
+        {
+            sendRanges(conn, req, entry.mime, body, ranges);
+            return;
         }
-        total_sent += sent;
     }
+
+    Representation rep = selectRepresentation(req, body, entry.mime);
+
+    ResponseHead head(conn, 200);
+    head.header("Content-Type", entry.mime)
+        .header("Content-Length", rep.variant ? static_cast<uint64_t>(rep.variant->size()) : body.size)
+        .header("Accept-Ranges", "bytes");
+    writeCacheHeaders(head, req, entry.mime, entityTag(body, rep.encoding), body.mtimeNs);
+    if (rep.encoding != ContentEncoding::Identity)
+        head.header("Content-Encoding", encodingName(rep.encoding));
+    if (rep.varies)
+        head.header("Vary", "Accept-Encoding");
+    head.end();
+
+    if (headOnly)
+        return;
+    if (rep.variant)
+        queueBorrowed(conn, rep.variant, rep.variant->data(), rep.variant->size());
+    else
+        queueBody(conn, body, 0, body.size);
 }
 
-void sendRaw(int fd, const std::string &data)
+bool sendNotModified(Connection &conn, const HttpRequest &req, const StaticFile &file)
 {
-    const char *ptr = data.c_str();
-    ssize_t to_send = data.size();
-    ssize_t total_sent = 0;
-    while (total_sent < to_send)
+    std::string_view ifNoneMatch = req.headers.find("If-None-Match");
+    std::string_view ifModifiedSince = req.headers.find("If-Modified-Since");
+    if (ifNoneMatch.empty() && ifModifiedSince.empty())
+        return false;
+
+    // The validators come from peekFile()'s stat, as they do for a 200; the
+    // cache is only asked which codings it holds, and the file is not opened
+    const DocEntry &entry = *file.entry;
+    FileBody body;
+    body.size = static_cast<uint64_t>(entry.st.st_size);
+    body.mtimeNs = mtimeNanos(entry.st);
+    body.inode = entry.st.st_ino;
+    if (fileCache)
+        body.cached = fileCache->find(entry.fullPath, entry.st);
+
+    Representation rep = selectRepresentation(req, body, entry.mime);
+    std::pmr::string etag = entityTag(body, rep.encoding);
+
+    // If-Modified-Since is only consulted when there is no If-None-Match
+    bool fresh;
+    if (!ifNoneMatch.empty())
     {
-        ssize_t sent = write(fd, ptr + total_sent, to_send - total_sent);
-        if (sent < 0)
-        {
-            perror("write");
-            exit(EXIT_FAILURE);
-        }
-        total_sent += sent;
+        fresh = noneMatchHits(ifNoneMatch, etag);
+    }
+    else
+    {
+        time_t since;
+        fresh = parseHttpDate(ifModifiedSince, since) && body.mtimeNs / 1000000000 <= static_cast<int64_t>(since);
     }
+    if (!fresh)
+        return false;
+
+    ResponseHead head(conn, 304);
+    writeCacheHeaders(head, req, entry.mime, etag, body.mtimeNs);
+    if (rep.varies)
+        head.header("Vary", "Accept-Encoding");
+    head.end();
+    return true;
 }
 
-void sendRaw(SSL *ssl, const std::string &data)
+void sendResponse(Connection &conn, std::string body, const std::string &contentType, bool headOnly)
 {
-    const char *ptr = data.c_str();
-    ssize_t to_send = data.size();
-    ssize_t total_sent = 0;
-    while (total_sent < to_send)
+    ResponseHead head(conn, 200);
+    head.header("Content-Type", contentType).header("Content-Length", static_cast<uint64_t>(body.size()));
+    head.end();
+    if (headOnly)
+        return;
+
+    // A short body is cheaper to copy behind the head than to hand over;
+    // a longer one is moved into the queue and sent from where it is
+    if (body.size() <= INLINE_BODY_MAX)
     {
-        ssize_t sent = SSL_write(ssl, ptr + total_sent, to_send - total_sent);
-        if (sent < 0)
-        {
-            perror("write");
-            exit(EXIT_FAILURE);
-        }
-        total_sent += sent;
+        outputBuffer(conn).append(body);
+        return;
     }
+    auto owned = std::make_shared<const std::string>(std::move(body));
+    queueBorrowed(conn, owned, owned->data(), owned->size());
 }
 
-bool peekFile(const std::string &path, const std::string &docRoot, std::string &content, std::string &mime)
+void sendRaw(Connection &conn, const std::string &data)
 {
-    std::string fullPath = docRoot + path;
-    log("Peeking file: " + fullPath);
-    if (path == "/")
-        fullPath += "index.html";
+    queueOutput(conn, data);
+}
 
-    std::ifstream file(fullPath, std::ios::binary);
-    if (!file)
+bool peekFile(std::string_view path, const std::string &docRoot, StaticFile &file)
+{
+    std::pmr::string normalized(&requestArena());
+    if (!normalizeUrlPath(path, normalized))
     {
-        log("peekFile returned false");
+        LOG_DEBUG("peekFile rejected path " + std::string(path));
         return false;
     }
 
-    content.assign(
-        (std::istreambuf_iterator<char>(file)), // iterator positioned at start of file stream
-        std::istreambuf_iterator<char>()        // end-of-stream iterator indicating EOF(end of file)
-    );
+    if (docIndex)
+    {
+        file.entry = docIndex->lookup(normalized);
+        if (!file.entry)
+        {
+            LOG_DEBUG("peekFile: not in the docRoot index: " + std::string(normalized));
+            return false;
+        }
+        file.indexed = true;
+        return true;
+    }
+
+    auto entry = std::make_shared<DocEntry>();
+    entry->fullPath = docRoot;
+    entry->fullPath += normalized;
+    LOG_DEBUG("Peeking file: " + entry->fullPath);
+    if (entry->fullPath.back() == '/')
+        entry->fullPath += "index.html";
 
-    mime = getMimeType(fullPath);
-    log("peekFile function's mime value is " + mime);
+    if (stat(entry->fullPath.c_str(), &entry->st) < 0 || !S_ISREG(entry->st.st_mode))
+    {
+        LOG_DEBUG("peekFile returned false");
+        return false;
+    }
+
+    entry->mime = getMimeType(entry->fullPath);
+    entry->policy = HandlePolicy::CacheContent; // decided per request by serveStaticFile()
+    LOG_DEBUG("peekFile function's mime value is " + std::string(entry->mime));
+    file.entry = std::move(entry);
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,464 @@
+#include "../include/Hpack.hpp"
+#include <algorithm>
+#include <charconv>
+
+struct FieldView
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+// The static table (RFC 7541, Appendix A); index 1 is the first entry
+constexpr FieldView STATIC_TABLE[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+constexpr size_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+static_assert(STATIC_TABLE_SIZE == 61, "RFC 7541 defines 61 static entries");
+
+// Per-field overhead counted against a dynamic table's size (RFC 7541, 4.1)
+constexpr size_t FIELD_OVERHEAD = 32;
+// Longest header name lowercased on the stack; longer ones are rare enough to allocate
+constexpr size_t MAX_STACK_NAME = 64;
+
+/*
+ * Code lengths of the Huffman code (RFC 7541, Appendix B) by symbol;
+ * symbol 256 is EOS. The code is canonical: codes are handed out in order
+ * of length and, within a length, of symbol, so the lengths determine it.
+ */
+constexpr uint8_t HUFFMAN_LENGTHS[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+constexpr unsigned MAX_HUFFMAN_LENGTH = 30;
+constexpr unsigned MIN_HUFFMAN_LENGTH = 5;
+constexpr uint16_t HUFFMAN_EOS = 256;
+
+struct HuffmanCode
+{
+    uint32_t codes[257] = {};
+    uint16_t symbols[257] = {};                      // in code order
+    uint32_t firstCode[MAX_HUFFMAN_LENGTH + 1] = {}; // smallest code of each length
+    uint16_t firstSymbol[MAX_HUFFMAN_LENGTH + 1] = {}; // position of that code in `symbols`
+    uint16_t count[MAX_HUFFMAN_LENGTH + 1] = {};     // codes of each length
+};
+
+constexpr HuffmanCode buildHuffmanCode()
+{
+    HuffmanCode h{};
+    uint32_t code = 0;
+    uint16_t assigned = 0;
+    for (unsigned length = 1; length <= MAX_HUFFMAN_LENGTH; ++length)
+    {
+        h.firstCode[length] = code;
+        h.firstSymbol[length] = assigned;
+        for (uint16_t symbol = 0; symbol <= HUFFMAN_EOS; ++symbol)
+        {
+            if (HUFFMAN_LENGTHS[symbol] != length)
+                continue;
+            h.codes[symbol] = code++;
+            h.symbols[assigned++] = symbol;
+            h.count[length]++;
+        }
+        code <<= 1;
+    }
+    return h;
+}
+
+constexpr HuffmanCode HUFFMAN = buildHuffmanCode();
+static_assert(HUFFMAN.codes['0'] == 0x0 && HUFFMAN.codes['a'] == 0x3 && HUFFMAN.codes[HUFFMAN_EOS] == 0x3fffffff,
+              "Huffman codes must match RFC 7541, Appendix B");
+
+void hpackEncodeInteger(std::string &out, uint64_t value, int prefixBits, uint8_t flags)
+{
+    uint64_t limit = (uint64_t(1) << prefixBits) - 1;
+    if (value < limit)
+    {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out.push_back(static_cast<char>(flags | limit));
+    value -= limit;
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+/*
+ * Reads an integer with an N-bit prefix at `pos`. Values are capped well
+ * below anything a header block can legitimately need.
+ */
+static uint64_t readInteger(std::string_view block, size_t &pos, int prefixBits)
+{
+    uint64_t limit = (uint64_t(1) << prefixBits) - 1;
+    uint64_t value = static_cast<unsigned char>(block[pos++]) & limit;
+    if (value < limit)
+        return value;
+    for (unsigned shift = 0;; shift += 7)
+    {
+        if (pos == block.size())
+            throw HpackException("truncated integer");
+        if (shift > 21)
+            throw HpackException("integer too large");
+        unsigned char byte = static_cast<unsigned char>(block[pos++]);
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+}
+
+size_t huffmanEncodedLength(std::string_view text)
+{
+    size_t bits = 0;
+    for (unsigned char c : text)
+        bits += HUFFMAN_LENGTHS[c];
+    return (bits + 7) / 8;
+}
+
+void huffmanEncode(std::string &out, std::string_view text)
+{
+    uint64_t bits = 0;
+    unsigned pending = 0; // bits in `bits` not written yet, always < 8 between symbols
+    for (unsigned char c : text)
+    {
+        bits = (bits << HUFFMAN_LENGTHS[c]) | HUFFMAN.codes[c];
+        pending += HUFFMAN_LENGTHS[c];
+        while (pending >= 8)
+        {
+            pending -= 8;
+            out.push_back(static_cast<char>(bits >> pending));
+        }
+    }
+    // Padded with the most significant bits of EOS, which are all ones
+    if (pending > 0)
+        out.push_back(static_cast<char>((bits << (8 - pending)) | (0xffu >> pending)));
+}
+
+void huffmanDecode(std::string_view code, std::string &out)
+{
+    uint64_t bits = 0;
+    unsigned available = 0; // low bits of `bits` not decoded yet
+    for (unsigned char byte : code)
+    {
+        bits = (bits << 8) | byte;
+        available += 8;
+        while (available >= MIN_HUFFMAN_LENGTH)
+        {
+            // Canonical code: the shortest prefix that falls within the
+            // codes of its length is the symbol
+            unsigned length = MIN_HUFFMAN_LENGTH;
+            uint32_t offset = 0;
+            for (; length <= available && length <= MAX_HUFFMAN_LENGTH; ++length)
+            {
+                uint32_t prefix = static_cast<uint32_t>(bits >> (available - length)) & ((uint32_t(1) << length) - 1);
+                offset = prefix - HUFFMAN.firstCode[length];
+                if (offset < HUFFMAN.count[length])
+                    break;
+            }
+            if (length > available || length > MAX_HUFFMAN_LENGTH)
+                break; // the code continues in the next byte
+            uint16_t symbol = HUFFMAN.symbols[HUFFMAN.firstSymbol[length] + offset];
+            if (symbol == HUFFMAN_EOS)
+                throw HpackException("EOS in Huffman-coded string");
+            out.push_back(static_cast<char>(symbol));
+            available -= length;
+        }
+    }
+    // What is left must be padding: fewer than 8 bits, all ones
+    uint64_t padding = (uint64_t(1) << available) - 1;
+    if (available >= 8 || (bits & padding) != padding)
+        throw HpackException("invalid Huffman padding");
+}
+
+/*
+ * Appends a string literal, Huffman-coded when that is shorter.
+ */
+static void writeString(std::string &out, std::string_view text)
+{
+    size_t coded = huffmanEncodedLength(text);
+    if (coded < text.size())
+    {
+        hpackEncodeInteger(out, coded, 7, 0x80);
+        huffmanEncode(out, text);
+        return;
+    }
+    hpackEncodeInteger(out, text.size(), 7, 0x00);
+    out.append(text);
+}
+
+void HpackTable::add(std::string_view name, std::string_view value)
+{
+    size_t fieldSize = name.size() + value.size() + FIELD_OVERHEAD;
+    while (entries > 0 && size + fieldSize > maxSize)
+        evictOldest();
+    if (fieldSize > maxSize)
+        return;
+
+    if (entries == ring.size())
+    {
+        // Unrolled oldest first into a ring twice the size
+        std::vector<HpackField> grown(std::max<size_t>(16, ring.size() * 2));
+        for (size_t i = 0; i < entries; ++i)
+            grown[i] = std::move(ring[(head + i) & (ring.size() - 1)]);
+        ring.swap(grown);
+        head = 0;
+    }
+    HpackField &slot = ring[(head + entries) & (ring.size() - 1)];
+    slot.name.assign(name);
+    slot.value.assign(value);
+    entries++;
+    size += fieldSize;
+}
+
+void HpackTable::resize(size_t newMaxSize)
+{
+    maxSize = newMaxSize;
+    while (size > maxSize)
+        evictOldest();
+}
+
+void HpackTable::evictOldest()
+{
+    const HpackField &oldest = ring[head];
+    size -= oldest.name.size() + oldest.value.size() + FIELD_OVERHEAD;
+    head = (head + 1) & (ring.size() - 1);
+    entries--;
+}
+
+std::string_view HpackDecoder::readString(std::string_view block, size_t &pos, std::string &scratch)
+{
+    if (pos == block.size())
+        throw HpackException("truncated string");
+    bool huffman = static_cast<unsigned char>(block[pos]) & 0x80;
+    uint64_t length = readInteger(block, pos, 7);
+    if (length > block.size() - pos)
+        throw HpackException("string exceeds the header block");
+    std::string_view text = block.substr(pos, static_cast<size_t>(length));
+    pos += static_cast<size_t>(length);
+    if (!huffman)
+        return text;
+    scratch.clear();
+    huffmanDecode(text, scratch);
+    return scratch;
+}
+
+bool HpackDecoder::next(std::string_view block, size_t &pos, std::string_view &name, std::string_view &value)
+{
+    // Index 1..61 is the static table, from 62 on the dynamic table
+    auto field = [this](uint64_t index) -> FieldView
+    {
+        if (index == 0)
+            throw HpackException("index 0");
+        if (index <= STATIC_TABLE_SIZE)
+            return {STATIC_TABLE[index - 1].name, STATIC_TABLE[index - 1].value};
+        if (index - STATIC_TABLE_SIZE - 1 >= table.count())
+            throw HpackException("index " + std::to_string(index) + " beyond the dynamic table");
+        const HpackField &f = table[static_cast<size_t>(index - STATIC_TABLE_SIZE - 1)];
+        return {f.name, f.value};
+    };
+
+    unsigned char first = static_cast<unsigned char>(block[pos]);
+    if (first & 0x80)
+    {
+        // Indexed field
+        FieldView f = field(readInteger(block, pos, 7));
+        name = f.name;
+        value = f.value;
+        return true;
+    }
+    if ((first & 0xe0) == 0x20)
+    {
+        // Dynamic table size update, bounded by our SETTINGS_HEADER_TABLE_SIZE
+        uint64_t size = readInteger(block, pos, 5);
+        if (size > HPACK_DEFAULT_TABLE_SIZE)
+            throw HpackException("table size update above the limit");
+        table.resize(static_cast<size_t>(size));
+        return false;
+    }
+
+    // Literal with incremental indexing (01), without indexing (0000) or never indexed (0001)
+    bool index = (first & 0xc0) == 0x40;
+    uint64_t nameIndex = readInteger(block, pos, index ? 6 : 4);
+    if (nameIndex == 0)
+        name = readString(block, pos, nameScratch);
+    else if (index)
+    {
+        // Copied: adding the field below may evict the entry the name lives in
+        nameScratch.assign(field(nameIndex).name);
+        name = nameScratch;
+    }
+    else
+        name = field(nameIndex).name;
+    value = readString(block, pos, valueScratch);
+    if (index)
+        table.add(name, value);
+    return true;
+}
+
+void HpackEncoder::begin(std::string &out)
+{
+    if (!sizeUpdatePending)
+        return;
+    // A limit lowered and raised again since the last block is announced twice,
+    // so the peer evicts what the lower limit evicted
+    if (smallestPendingSize < pendingSize)
+    {
+        hpackEncodeInteger(out, smallestPendingSize, 5, 0x20);
+        table.resize(smallestPendingSize);
+    }
+    hpackEncodeInteger(out, pendingSize, 5, 0x20);
+    table.resize(pendingSize);
+    sizeUpdatePending = false;
+    smallestPendingSize = pendingSize;
+}
+
+void HpackEncoder::setPeerTableSize(uint32_t peerSize)
+{
+    size_t size = std::min<size_t>(peerSize, HPACK_DEFAULT_TABLE_SIZE);
+    if (size == (sizeUpdatePending ? pendingSize : table.limit()))
+        return;
+    pendingSize = size;
+    smallestPendingSize = std::min(smallestPendingSize, size);
+    sizeUpdatePending = true;
+}
+
+// Values that differ from response to response would only push useful fields out of the table
+static bool worthIndexing(std::string_view name)
+{
+    return name != "content-length" && name != "etag" && name != "content-range";
+}
+
+void HpackEncoder::encode(std::string &out, std::string_view name, std::string_view value)
+{
+    char stackName[MAX_STACK_NAME];
+    std::string heapName;
+    char *lower = stackName;
+    if (name.size() > MAX_STACK_NAME)
+    {
+        heapName.resize(name.size());
+        lower = heapName.data();
+    }
+    for (size_t i = 0; i < name.size(); ++i)
+        lower[i] = (name[i] >= 'A' && name[i] <= 'Z') ? static_cast<char>(name[i] - 'A' + 'a') : name[i];
+    name = std::string_view(lower, name.size());
+
+    size_t nameIndex = 0;
+    for (size_t i = 0; i < STATIC_TABLE_SIZE; ++i)
+    {
+        if (STATIC_TABLE[i].name != name)
+            continue;
+        if (STATIC_TABLE[i].value == value)
+        {
+            hpackEncodeInteger(out, i + 1, 7, 0x80);
+            return;
+        }
+        if (nameIndex == 0)
+            nameIndex = i + 1;
+    }
+    for (size_t i = 0; i < table.count(); ++i)
+    {
+        const HpackField &f = table[i];
+        if (f.name != name)
+            continue;
+        if (f.value == value)
+        {
+            hpackEncodeInteger(out, STATIC_TABLE_SIZE + 1 + i, 7, 0x80);
+            return;
+        }
+        if (nameIndex == 0)
+            nameIndex = STATIC_TABLE_SIZE + 1 + i;
+    }
+
+    bool index = worthIndexing(name);
+    hpackEncodeInteger(out, nameIndex, index ? 6 : 4, index ? 0x40 : 0x00);
+    if (nameIndex == 0)
+        writeString(out, name);
+    writeString(out, value);
+    if (index)
+        table.add(name, value);
+}
+
+void HpackEncoder::encodeStatus(std::string &out, int status)
+{
+    char digits[8];
+    auto result = std::to_chars(digits, digits + sizeof(digits), status);
+    encode(out, ":status", std::string_view(digits, static_cast<size_t>(result.ptr - digits)));
+}
@@ -0,0 +1,811 @@
+#include "../include/Http2.hpp"
+#include "../include/Exception.hpp"
+#include "../include/Logger.hpp"
+#include "../include/Metrics.hpp"
+#include <unistd.h> // for pread
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <utility>
+
+constexpr std::string_view CLIENT_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr size_t FRAME_HEADER_SIZE = 9;
+
+enum FrameType : uint8_t
+{
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9
+};
+
+constexpr uint8_t FLAG_END_STREAM = 0x1;
+constexpr uint8_t FLAG_ACK = 0x1;
+constexpr uint8_t FLAG_END_HEADERS = 0x4;
+constexpr uint8_t FLAG_PADDED = 0x8;
+constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+enum ErrorCode : uint32_t
+{
+    NO_ERROR = 0x0,
+    PROTOCOL_ERROR = 0x1,
+    INTERNAL_ERROR = 0x2,
+    FLOW_CONTROL_ERROR = 0x3,
+    FRAME_SIZE_ERROR = 0x6,
+    REFUSED_STREAM = 0x7,
+    COMPRESSION_ERROR = 0x9,
+    ENHANCE_YOUR_CALM = 0xb
+};
+
+enum SettingId : uint16_t
+{
+    SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    SETTINGS_ENABLE_PUSH = 0x2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    SETTINGS_MAX_FRAME_SIZE = 0x5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+// Protocol defaults (RFC 9113, 6.5.2) and limits
+constexpr int64_t DEFAULT_WINDOW = 65535;
+constexpr int64_t MAX_WINDOW = 0x7fffffff;
+constexpr uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+constexpr uint32_t LARGEST_MAX_FRAME_SIZE = 16777215;
+// We never raise SETTINGS_MAX_FRAME_SIZE, so no client frame may be larger
+constexpr uint32_t LOCAL_MAX_FRAME_SIZE = DEFAULT_MAX_FRAME_SIZE;
+// The same room HTTP/1.1 gets for a request head, plus the 32 bytes HPACK counts per field
+constexpr uint32_t MAX_HEADER_LIST_SIZE = MAX_REQ_SIZE + MAX_HEADERS * 32;
+// A header block split over CONTINUATION frames may not grow past this
+constexpr size_t MAX_HEADER_BLOCK = 65536;
+// Received request-body bytes are credited back once this many have piled up
+constexpr uint32_t CREDIT_THRESHOLD = DEFAULT_WINDOW / 2;
+// DATA queued per pass, so `conn.out` stays short and new responses get in between
+constexpr size_t DATA_BUDGET = 131072;
+// File frames fill exactly one TLS record with their header, so they are written without a copy
+constexpr size_t FILE_FRAME_PAYLOAD = 16384 - FRAME_HEADER_SIZE;
+
+static std::atomic<uint64_t> connectionCount{0};
+static std::atomic<uint64_t> streamCount{0};
+static std::atomic<uint64_t> streamResetCount{0};
+static std::atomic<uint64_t> connectionErrorCount{0};
+static std::atomic<uint64_t> headerByteCount{0};
+
+/*
+ * A response with DATA left to send.
+ */
+struct Http2Session::Stream
+{
+    uint32_t id = 0;
+    int64_t window = 0;      // what the client still accepts on this stream
+    uint64_t remaining = 0;  // body bytes not framed yet
+    OutputQueue body;        // the handler's chunks, consumed as they are framed
+    size_t frontSent = 0;    // bytes of the front bytes chunk already framed
+};
+
+static uint32_t read32(std::string_view bytes)
+{
+    return static_cast<uint32_t>(static_cast<unsigned char>(bytes[0])) << 24 |
+           static_cast<uint32_t>(static_cast<unsigned char>(bytes[1])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(bytes[2])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(bytes[3]));
+}
+
+static void append32(std::string &out, uint32_t value)
+{
+    char bytes[4] = {static_cast<char>(value >> 24), static_cast<char>(value >> 16),
+                     static_cast<char>(value >> 8), static_cast<char>(value)};
+    out.append(bytes, sizeof(bytes));
+}
+
+static void writeFrameHeader(char *out, size_t length, uint8_t type, uint8_t flags, uint32_t streamId)
+{
+    out[0] = static_cast<char>(length >> 16);
+    out[1] = static_cast<char>(length >> 8);
+    out[2] = static_cast<char>(length);
+    out[3] = static_cast<char>(type);
+    out[4] = static_cast<char>(flags);
+    out[5] = static_cast<char>(streamId >> 24);
+    out[6] = static_cast<char>(streamId >> 16);
+    out[7] = static_cast<char>(streamId >> 8);
+    out[8] = static_cast<char>(streamId);
+}
+
+static void appendFrameHeader(std::string &out, size_t length, uint8_t type, uint8_t flags, uint32_t streamId)
+{
+    char header[FRAME_HEADER_SIZE];
+    writeFrameHeader(header, length, type, flags, streamId);
+    out.append(header, sizeof(header));
+}
+
+static void appendSetting(std::string &out, uint16_t id, uint32_t value)
+{
+    out.push_back(static_cast<char>(id >> 8));
+    out.push_back(static_cast<char>(id));
+    append32(out, value);
+}
+
+static void queueRstStream(Connection &conn, uint32_t streamId, uint32_t errorCode)
+{
+    std::string &out = outputBuffer(conn);
+    appendFrameHeader(out, 4, FRAME_RST_STREAM, 0, streamId);
+    append32(out, errorCode);
+}
+
+static void queueWindowUpdate(Connection &conn, uint32_t streamId, uint32_t increment)
+{
+    std::string &out = outputBuffer(conn);
+    appendFrameHeader(out, 4, FRAME_WINDOW_UPDATE, 0, streamId);
+    append32(out, increment);
+}
+
+/*
+ * Reads exactly `length` bytes at `offset`; false if the file ended early
+ * or the read failed.
+ */
+static bool readFully(int fd, char *out, size_t length, off_t offset)
+{
+    while (length > 0)
+    {
+        ssize_t got = pread(fd, out, length, offset);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return false;
+        out += got;
+        length -= static_cast<size_t>(got);
+        offset += got;
+    }
+    return true;
+}
+
+static size_t chunkLength(const OutputChunk &chunk)
+{
+    return chunk.file || chunk.data ? chunk.length : chunk.bytes.size();
+}
+
+// Fields that only make sense hop by hop on HTTP/1.1 (RFC 9113, 8.2.2)
+static bool isConnectionSpecific(std::string_view name, std::string_view value)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade" || (name == "te" && value != "trailers");
+}
+
+Http2Session::Http2Session(const Config &cfg, Http2RequestHandler handler)
+    : cfg(cfg), handler(handler), response(-1), connectionWindow(DEFAULT_WINDOW),
+      initialStreamWindow(DEFAULT_WINDOW), peerMaxFrameSize(DEFAULT_MAX_FRAME_SIZE)
+{
+    response.hpack = &encoder;
+}
+
+Http2Session::~Http2Session() = default;
+
+void Http2Session::start(Connection &conn)
+{
+    connectionCount.fetch_add(1, std::memory_order_relaxed);
+    std::string &out = outputBuffer(conn);
+    appendFrameHeader(out, 2 * 6, FRAME_SETTINGS, 0, 0);
+    appendSetting(out, SETTINGS_MAX_CONCURRENT_STREAMS, static_cast<uint32_t>(cfg.http2MaxStreams));
+    appendSetting(out, SETTINGS_MAX_HEADER_LIST_SIZE, MAX_HEADER_LIST_SIZE);
+    conn.state = ConnState::Writing;
+}
+
+void Http2Session::process(Connection &conn)
+{
+    std::string_view buffered = conn.in.view();
+    size_t start = 0; // first byte of `conn.in` not consumed yet
+    try
+    {
+        while (start < buffered.size())
+        {
+            std::string_view rest = buffered.substr(start);
+            if (oversizedMissing > 0)
+            {
+                size_t n = std::min(rest.size(), oversizedMissing);
+                oversizedPayload.append(rest.data(), n);
+                oversizedMissing -= n;
+                start += n;
+                if (oversizedMissing == 0)
+                    handleFrame(conn, oversizedFrame, oversizedPayload);
+                continue;
+            }
+            if (!prefaceReceived)
+            {
+                size_t n = std::min(rest.size(), CLIENT_PREFACE.size());
+                if (rest.substr(0, n) != CLIENT_PREFACE.substr(0, n))
+                    throw Http2Exception(PROTOCOL_ERROR, "invalid connection preface");
+                if (n < CLIENT_PREFACE.size())
+                    break;
+                prefaceReceived = true;
+                start += n;
+                continue;
+            }
+            if (rest.size() < FRAME_HEADER_SIZE)
+                break;
+
+            FrameHeader frame;
+            frame.length = read32(rest) >> 8;
+            frame.type = static_cast<uint8_t>(rest[3]);
+            frame.flags = static_cast<uint8_t>(rest[4]);
+            frame.streamId = read32(rest.substr(5)) & 0x7fffffff;
+            if (frame.length > LOCAL_MAX_FRAME_SIZE)
+                throw Http2Exception(FRAME_SIZE_ERROR, "frame of " + std::to_string(frame.length) + " bytes");
+
+            size_t frameSize = FRAME_HEADER_SIZE + frame.length;
+            if (rest.size() >= frameSize)
+            {
+                start += frameSize;
+                handleFrame(conn, frame, rest.substr(FRAME_HEADER_SIZE, frame.length));
+                continue;
+            }
+            if (frameSize <= RECEIVE_BUFFER_SIZE)
+                break; // arrives whole once the buffer is compacted
+
+            // Only a full-size frame does not fit the receive buffer; it is gathered here instead
+            oversizedFrame = frame;
+            oversizedPayload.assign(rest.substr(FRAME_HEADER_SIZE));
+            oversizedMissing = frame.length - oversizedPayload.size();
+            start = buffered.size();
+        }
+    }
+    catch (const Http2Exception &e)
+    {
+        LOG_WARN(std::string(e.what()) + " on fd= " + std::to_string(conn.fd));
+        goAway(conn, e.errorCode);
+        start = buffered.size();
+    }
+    catch (const HpackException &e)
+    {
+        LOG_WARN(std::string(e.what()) + " on fd= " + std::to_string(conn.fd));
+        goAway(conn, COMPRESSION_ERROR);
+        start = buffered.size();
+    }
+    conn.in.consume(start);
+
+    // Request bodies are dropped unread; crediting them keeps the connection open to new requests
+    if (uncreditedData >= CREDIT_THRESHOLD && !goAwaySent)
+    {
+        queueWindowUpdate(conn, 0, uncreditedData);
+        uncreditedData = 0;
+    }
+    queueData(conn);
+    finish(conn);
+}
+
+bool Http2Session::refill(Connection &conn)
+{
+    queueData(conn);
+    finish(conn);
+    return !conn.out.empty() || conn.closeAfterWrite;
+}
+
+void Http2Session::finish(Connection &conn)
+{
+    if ((goAwaySent || goAwayReceived) && streams.empty())
+        conn.closeAfterWrite = true;
+    if (!conn.out.empty() || conn.closeAfterWrite)
+        conn.state = ConnState::Writing;
+}
+
+void Http2Session::handleFrame(Connection &conn, const FrameHeader &frame, std::string_view payload)
+{
+    if (!settingsReceived && frame.type != FRAME_SETTINGS)
+        throw Http2Exception(PROTOCOL_ERROR, "the client preface must start with SETTINGS");
+    if (continuationStream != 0 && (frame.type != FRAME_CONTINUATION || frame.streamId != continuationStream))
+        throw Http2Exception(PROTOCOL_ERROR, "header block interrupted by another frame");
+
+    switch (frame.type)
+    {
+    case FRAME_DATA:
+    {
+        if (frame.streamId == 0 || frame.streamId > lastStreamId)
+            throw Http2Exception(PROTOCOL_ERROR, "DATA on an idle stream");
+        if ((frame.flags & FLAG_PADDED) && (payload.empty() || static_cast<unsigned char>(payload[0]) >= payload.size()))
+            throw Http2Exception(PROTOCOL_ERROR, "DATA padding exceeds the frame");
+        // Discarded, but credited back (padding included) so an upload still in flight can finish
+        uncreditedData += frame.length;
+        if (frame.length > 0 && !(frame.flags & FLAG_END_STREAM))
+            queueWindowUpdate(conn, frame.streamId, frame.length);
+        return;
+    }
+    case FRAME_HEADERS:
+    {
+        if (frame.streamId == 0)
+            throw Http2Exception(PROTOCOL_ERROR, "HEADERS on stream 0");
+        std::string_view fragment = payload;
+        size_t padding = 0;
+        if (frame.flags & FLAG_PADDED)
+        {
+            if (fragment.empty())
+                throw Http2Exception(PROTOCOL_ERROR, "HEADERS padding exceeds the frame");
+            padding = static_cast<unsigned char>(fragment[0]);
+            fragment.remove_prefix(1);
+        }
+        // The priority fields are advisory; responses are interleaved round-robin
+        if (frame.flags & FLAG_PRIORITY)
+        {
+            if (fragment.size() < 5)
+                throw Http2Exception(PROTOCOL_ERROR, "HEADERS too short for its priority");
+            fragment.remove_prefix(5);
+        }
+        if (padding > fragment.size())
+            throw Http2Exception(PROTOCOL_ERROR, "HEADERS padding exceeds the frame");
+        fragment.remove_suffix(padding);
+
+        if (frame.flags & FLAG_END_HEADERS)
+        {
+            handleHeaderBlock(conn, frame.streamId, fragment);
+            return;
+        }
+        continuationStream = frame.streamId;
+        headerFragments.assign(fragment);
+        return;
+    }
+    case FRAME_CONTINUATION:
+        if (continuationStream == 0)
+            throw Http2Exception(PROTOCOL_ERROR, "CONTINUATION without HEADERS");
+        if (headerFragments.size() + payload.size() > MAX_HEADER_BLOCK)
+            throw Http2Exception(ENHANCE_YOUR_CALM, "header block larger than " + std::to_string(MAX_HEADER_BLOCK) + " bytes");
+        headerFragments.append(payload);
+        if (frame.flags & FLAG_END_HEADERS)
+        {
+            continuationStream = 0;
+            handleHeaderBlock(conn, frame.streamId, headerFragments);
+        }
+        return;
+    case FRAME_PRIORITY:
+        if (frame.streamId == 0)
+            throw Http2Exception(PROTOCOL_ERROR, "PRIORITY on stream 0");
+        if (payload.size() != 5)
+            resetStream(conn, frame.streamId, FRAME_SIZE_ERROR);
+        return;
+    case FRAME_RST_STREAM:
+        if (frame.streamId == 0 || frame.streamId > lastStreamId)
+            throw Http2Exception(PROTOCOL_ERROR, "RST_STREAM on an idle stream");
+        if (payload.size() != 4)
+            throw Http2Exception(FRAME_SIZE_ERROR, "RST_STREAM of " + std::to_string(payload.size()) + " bytes");
+        // The client gave up on it: nothing more is sent
+        streams.erase(std::remove_if(streams.begin(), streams.end(), [&](const Stream &s)
+                                     { return s.id == frame.streamId; }),
+                      streams.end());
+        return;
+    case FRAME_SETTINGS:
+        handleSettings(conn, frame, payload);
+        return;
+    case FRAME_PUSH_PROMISE:
+        throw Http2Exception(PROTOCOL_ERROR, "PUSH_PROMISE from a client");
+    case FRAME_PING:
+        if (frame.streamId != 0)
+            throw Http2Exception(PROTOCOL_ERROR, "PING on a stream");
+        if (payload.size() != 8)
+            throw Http2Exception(FRAME_SIZE_ERROR, "PING of " + std::to_string(payload.size()) + " bytes");
+        if (!(frame.flags & FLAG_ACK))
+        {
+            std::string &out = outputBuffer(conn);
+            appendFrameHeader(out, 8, FRAME_PING, FLAG_ACK, 0);
+            out.append(payload);
+        }
+        return;
+    case FRAME_GOAWAY:
+        if (frame.streamId != 0)
+            throw Http2Exception(PROTOCOL_ERROR, "GOAWAY on a stream");
+        // Every stream it covers has been answered already; finish sending them, then close
+        goAwayReceived = true;
+        return;
+    case FRAME_WINDOW_UPDATE:
+        handleWindowUpdate(conn, frame, payload);
+        return;
+    default:
+        return; // unknown frame types are ignored
+    }
+}
+
+void Http2Session::handleSettings(Connection &conn, const FrameHeader &frame, std::string_view payload)
+{
+    if (frame.streamId != 0)
+        throw Http2Exception(PROTOCOL_ERROR, "SETTINGS on a stream");
+    if (frame.flags & FLAG_ACK)
+    {
+        if (!payload.empty())
+            throw Http2Exception(FRAME_SIZE_ERROR, "SETTINGS acknowledgement with a payload");
+        return;
+    }
+    if (payload.size() % 6 != 0)
+        throw Http2Exception(FRAME_SIZE_ERROR, "SETTINGS of " + std::to_string(payload.size()) + " bytes");
+
+    for (size_t pos = 0; pos < payload.size(); pos += 6)
+    {
+        uint16_t id = static_cast<uint16_t>(static_cast<unsigned char>(payload[pos]) << 8 | static_cast<unsigned char>(payload[pos + 1]));
+        uint32_t value = read32(payload.substr(pos + 2));
+        switch (id)
+        {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            encoder.setPeerTableSize(value);
+            break;
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+                throw Http2Exception(PROTOCOL_ERROR, "SETTINGS_ENABLE_PUSH must be 0 or 1");
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > MAX_WINDOW)
+                throw Http2Exception(FLOW_CONTROL_ERROR, "SETTINGS_INITIAL_WINDOW_SIZE above 2^31-1");
+            // Applies to the windows of open streams too, which may go negative
+            int64_t delta = static_cast<int64_t>(value) - initialStreamWindow;
+            for (Stream &stream : streams)
+            {
+                stream.window += delta;
+                if (stream.window > MAX_WINDOW)
+                    throw Http2Exception(FLOW_CONTROL_ERROR, "stream window above 2^31-1");
+            }
+            initialStreamWindow = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < DEFAULT_MAX_FRAME_SIZE || value > LARGEST_MAX_FRAME_SIZE)
+                throw Http2Exception(PROTOCOL_ERROR, "SETTINGS_MAX_FRAME_SIZE out of range");
+            peerMaxFrameSize = value;
+            break;
+        default:
+            break; // SETTINGS_MAX_CONCURRENT_STREAMS limits pushes, which we never make; unknown ids are ignored
+        }
+    }
+    settingsReceived = true;
+
+    std::string &out = outputBuffer(conn);
+    appendFrameHeader(out, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+}
+
+void Http2Session::handleWindowUpdate(Connection &conn, const FrameHeader &frame, std::string_view payload)
+{
+    if (payload.size() != 4)
+        throw Http2Exception(FRAME_SIZE_ERROR, "WINDOW_UPDATE of " + std::to_string(payload.size()) + " bytes");
+    uint32_t increment = read32(payload) & 0x7fffffff;
+    if (frame.streamId == 0)
+    {
+        if (increment == 0)
+            throw Http2Exception(PROTOCOL_ERROR, "WINDOW_UPDATE of 0 for the connection");
+        connectionWindow += increment;
+        if (connectionWindow > MAX_WINDOW)
+            throw Http2Exception(FLOW_CONTROL_ERROR, "connection window above 2^31-1");
+        return;
+    }
+    if (frame.streamId > lastStreamId)
+        throw Http2Exception(PROTOCOL_ERROR, "WINDOW_UPDATE on an idle stream");
+
+    Stream *stream = findStream(frame.streamId);
+    if (!stream)
+        return; // already answered in full or reset
+    if (increment == 0)
+    {
+        resetStream(conn, frame.streamId, PROTOCOL_ERROR);
+        return;
+    }
+    stream->window += increment;
+    if (stream->window > MAX_WINDOW)
+        resetStream(conn, frame.streamId, FLOW_CONTROL_ERROR);
+}
+
+void Http2Session::handleHeaderBlock(Connection &conn, uint32_t streamId, std::string_view block)
+{
+    if (streamId <= lastStreamId)
+    {
+        // Trailers of a request whose body is not read: decoded only to keep HPACK in step
+        decoder.decode(block, [](std::string_view, std::string_view) {});
+        return;
+    }
+    if (streamId % 2 == 0)
+        throw Http2Exception(PROTOCOL_ERROR, "client stream " + std::to_string(streamId) + " is even");
+    lastStreamId = streamId;
+
+    int64_t parseStart = monotonicNanos();
+    HttpRequest req;
+    bool valid = decodeRequest(block, req);
+    // After our GOAWAY new streams are ignored; the client retries them on a new connection
+    if (goAwaySent)
+        return;
+    if (!valid)
+    {
+        resetStream(conn, streamId, PROTOCOL_ERROR);
+        return;
+    }
+    if (streams.size() >= static_cast<size_t>(cfg.http2MaxStreams))
+    {
+        resetStream(conn, streamId, REFUSED_STREAM);
+        return;
+    }
+    recordLatency(Timer::Parse, monotonicNanos() - parseStart);
+    respond(conn, streamId, req);
+}
+
+bool Http2Session::decodeRequest(std::string_view block, HttpRequest &req)
+{
+    struct Span
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+    enum : unsigned
+    {
+        NONE = 0,
+        METHOD = 1,
+        PATH = 2,
+        SCHEME = 4,
+        AUTHORITY = 8
+    };
+
+    Span method{}, path{}, authority{};
+    std::array<std::pair<Span, Span>, MAX_HEADERS - 1> fields; // one slot is left for Host
+    size_t count = 0;
+    unsigned pseudo = 0;
+    bool valid = true, sawRegular = false;
+    size_t listSize = 0;
+
+    fieldText.clear();
+    auto keep = [this](std::string_view text)
+    {
+        Span span{static_cast<uint32_t>(fieldText.size()), static_cast<uint32_t>(text.size())};
+        fieldText.append(text);
+        return span;
+    };
+
+    // Every field is decoded even once the request is known to be bad, so HPACK stays in step
+    decoder.decode(block, [&](std::string_view name, std::string_view value)
+                   {
+        listSize += name.size() + value.size() + 32;
+        if (!valid || listSize > MAX_HEADER_LIST_SIZE || name.empty())
+        {
+            valid = false;
+            return;
+        }
+        if (name[0] == ':')
+        {
+            unsigned bit = name == ":method" ? METHOD : name == ":path" ? PATH : name == ":scheme" ? SCHEME : name == ":authority" ? AUTHORITY : NONE;
+            if (bit == NONE || sawRegular || (pseudo & bit))
+            {
+                valid = false;
+                return;
+            }
+            pseudo |= bit;
+            if (bit == METHOD)
+                method = keep(value);
+            else if (bit == PATH)
+                path = keep(value);
+            else if (bit == AUTHORITY)
+                authority = keep(value);
+            return;
+        }
+        sawRegular = true;
+        bool upper = std::any_of(name.begin(), name.end(), [](char c)
+                                 { return c >= 'A' && c <= 'Z'; });
+        if (upper || isConnectionSpecific(name, value) || count == fields.size())
+        {
+            valid = false;
+            return;
+        }
+        Span nameSpan = keep(name);
+        fields[count++] = {nameSpan, keep(value)}; });
+
+    if (!valid || (pseudo & (METHOD | PATH | SCHEME)) != (METHOD | PATH | SCHEME) || path.length == 0)
+        return false;
+
+    // Views are taken only now: fieldText no longer grows
+    std::string_view text = fieldText;
+    auto view = [text](Span span)
+    { return text.substr(span.offset, span.length); };
+    req.method = view(method);
+    req.path = view(path);
+    req.version = "HTTP/2";
+    req.headers.clear();
+    if (pseudo & AUTHORITY)
+        req.headers.push("Host", view(authority));
+    for (size_t i = 0; i < count; ++i)
+        req.headers.push(view(fields[i].first), view(fields[i].second));
+    return true;
+}
+
+void Http2Session::respond(Connection &conn, uint32_t streamId, const HttpRequest &req)
+{
+    streamsOpened++;
+    streamCount.fetch_add(1, std::memory_order_relaxed);
+
+    response.status = 0;
+    response.keepAlive = true; // only read by ResponseHead for HTTP/1.1's Connection header
+    response.headerBlock.clear();
+    encoder.begin(response.headerBlock);
+    handler(response, req, cfg);
+
+    uint64_t length = 0;
+    for (size_t i = 0; i < response.out.size(); ++i)
+        length += chunkLength(response.out[i]);
+    headerByteCount.fetch_add(response.headerBlock.size(), std::memory_order_relaxed);
+    queueHeaders(conn, streamId, response.headerBlock, length == 0);
+
+    if (length == 0)
+    {
+        while (!response.out.empty())
+            response.out.pop_front();
+    }
+    else
+    {
+        Stream stream;
+        stream.id = streamId;
+        stream.window = initialStreamWindow;
+        stream.remaining = length;
+        // The queue moves as a whole; the response gets back a drained one in queueData()
+        std::swap(stream.body, response.out);
+        streams.push_back(std::move(stream));
+    }
+
+    if (streamsOpened >= static_cast<uint32_t>(cfg.maxKeepAliveRequests))
+        goAway(conn, NO_ERROR);
+}
+
+void Http2Session::queueHeaders(Connection &conn, uint32_t streamId, std::string_view block, bool endStream)
+{
+    std::string &out = outputBuffer(conn);
+    size_t first = std::min<size_t>(block.size(), peerMaxFrameSize);
+    uint8_t flags = (endStream ? FLAG_END_STREAM : 0) | (first == block.size() ? FLAG_END_HEADERS : 0);
+    appendFrameHeader(out, first, FRAME_HEADERS, flags, streamId);
+    out.append(block.substr(0, first));
+    for (size_t pos = first; pos < block.size();)
+    {
+        size_t n = std::min<size_t>(block.size() - pos, peerMaxFrameSize);
+        appendFrameHeader(out, n, FRAME_CONTINUATION, pos + n == block.size() ? FLAG_END_HEADERS : 0, streamId);
+        out.append(block.substr(pos, n));
+        pos += n;
+    }
+}
+
+bool Http2Session::queueData(Connection &conn)
+{
+    size_t budget = DATA_BUDGET;
+    bool queued = false;
+    while (!streams.empty() && budget > 0 && connectionWindow > 0)
+    {
+        // One frame per stream and pass, starting one stream further each time
+        bool progress = false;
+        size_t count = streams.size();
+        size_t first = nextStream % count;
+        for (size_t k = 0; k < count && budget > 0 && connectionWindow > 0; ++k)
+        {
+            Stream &stream = streams[(first + k) % count];
+            if (stream.window <= 0)
+                continue;
+            size_t limit = static_cast<size_t>(std::min<int64_t>(stream.window, connectionWindow));
+            limit = std::min<size_t>(limit, peerMaxFrameSize);
+            if (!queueDataFrame(conn, stream, limit))
+            {
+                // The file shrank under us: the promised length cannot be met
+                queueRstStream(conn, stream.id, INTERNAL_ERROR);
+                streamResetCount.fetch_add(1, std::memory_order_relaxed);
+                stream.remaining = 0;
+                continue;
+            }
+            progress = queued = true;
+            budget -= std::min(budget, limit);
+        }
+        nextStream = first + 1;
+
+        for (size_t i = 0; i < streams.size();)
+        {
+            if (streams[i].remaining > 0)
+            {
+                ++i;
+                continue;
+            }
+            if (response.out.empty())
+                std::swap(response.out, streams[i].body); // keeps its capacity for the next response
+            streams.erase(streams.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+        if (!progress)
+            break;
+    }
+    return queued;
+}
+
+bool Http2Session::queueDataFrame(Connection &conn, Stream &stream, size_t limit)
+{
+    while (chunkLength(stream.body.front()) == stream.frontSent)
+    {
+        stream.body.pop_front();
+        stream.frontSent = 0;
+    }
+    OutputChunk &chunk = stream.body.front();
+    size_t length = std::min(limit, chunkLength(chunk) - stream.frontSent);
+
+    if (chunk.file)
+    {
+        // A frame of its own, read straight into place after its header
+        length = std::min(length, FILE_FRAME_PAYLOAD);
+        OutputChunk frame;
+        frame.bytes.resize(FRAME_HEADER_SIZE + length);
+        if (!readFully(chunk.file->fd, frame.bytes.data() + FRAME_HEADER_SIZE, length, chunk.offset))
+            return false;
+        writeFrameHeader(frame.bytes.data(), length, FRAME_DATA, length == stream.remaining ? FLAG_END_STREAM : 0, stream.id);
+        conn.out.push_back(std::move(frame));
+        chunk.offset += static_cast<off_t>(length);
+        chunk.length -= length;
+    }
+    else if (chunk.data)
+    {
+        appendFrameHeader(outputBuffer(conn), length, FRAME_DATA, length == stream.remaining ? FLAG_END_STREAM : 0, stream.id);
+        queueBorrowed(conn, chunk.owner, chunk.data, length);
+        chunk.data += length;
+        chunk.length -= length;
+    }
+    else
+    {
+        std::string &out = outputBuffer(conn);
+        appendFrameHeader(out, length, FRAME_DATA, length == stream.remaining ? FLAG_END_STREAM : 0, stream.id);
+        out.append(chunk.bytes, stream.frontSent, length);
+        stream.frontSent += length;
+    }
+
+    stream.remaining -= length;
+    stream.window -= static_cast<int64_t>(length);
+    connectionWindow -= static_cast<int64_t>(length);
+    return true;
+}
+
+void Http2Session::resetStream(Connection &conn, uint32_t streamId, uint32_t errorCode)
+{
+    queueRstStream(conn, streamId, errorCode);
+    streamResetCount.fetch_add(1, std::memory_order_relaxed);
+    streams.erase(std::remove_if(streams.begin(), streams.end(), [&](const Stream &s)
+                                 { return s.id == streamId; }),
+                  streams.end());
+}
+
+void Http2Session::goAway(Connection &conn, uint32_t errorCode)
+{
+    // A graceful GOAWAY may be followed by an error, never the other way round
+    if (goAwaySent && errorCode == NO_ERROR)
+        return;
+    std::string &out = outputBuffer(conn);
+    appendFrameHeader(out, 8, FRAME_GOAWAY, 0, 0);
+    append32(out, lastStreamId);
+    append32(out, errorCode);
+    goAwaySent = true;
+    if (errorCode != NO_ERROR)
+    {
+        connectionErrorCount.fetch_add(1, std::memory_order_relaxed);
+        streams.clear();
+    }
+}
+
+Http2Session::Stream *Http2Session::findStream(uint32_t streamId)
+{
+    for (Stream &stream : streams)
+        if (stream.id == streamId)
+            return &stream;
+    return nullptr;
+}
+
+bool negotiatedHttp2(const Connection &conn)
+{
+    if (!conn.ssl)
+        return false;
+    const unsigned char *protocol = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(conn.ssl, &protocol, &length);
+    return length == 2 && protocol[0] == 'h' && protocol[1] == '2';
+}
+
+Http2Stats http2Stats()
+{
+    Http2Stats s{};
+    s.connections = connectionCount.load(std::memory_order_relaxed);
+    s.streams = streamCount.load(std::memory_order_relaxed);
+    s.streamsReset = streamResetCount.load(std::memory_order_relaxed);
+    s.connectionErrors = connectionErrorCount.load(std::memory_order_relaxed);
+    s.headerBytes = headerByteCount.load(std::memory_order_relaxed);
+    return s;
+}
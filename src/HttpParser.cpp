@@ -1,142 +1,203 @@
 #include "../include/HttpParser.hpp"
-#include <iostream> // for std::cout
-#include <fstream>  // for std::ifstream
-#include <unistd.h> // for read
-#include <sstream>
-#include <openssl/ssl.h>
+#include "../include/Exception.hpp"
+#include "../include/SimdScan.hpp"
 
-HttpRequest receiveRequest(int fd)
+// Offset of the first `c` in `s` at or after `from`, or npos
+static size_t findChar(std::string_view s, char c, size_t from = 0)
 {
-    // Reserve space to avoid frequent reallocations
-    std::string raw;
-    raw.reserve(MAX_REQ_SIZE);
-    char buffer[512];
-    // Read until "\r\n\r\n"
-    while (raw.find("\r\n\r\n") == std::string::npos)
-    {
-        ssize_t bytes_read = read(fd, buffer, sizeof(buffer));
-        if (bytes_read < 0)
-        {
-            perror("read");
-            exit(EXIT_FAILURE);
-        }
-        else if (bytes_read == 0)
-        {
-            std::cout << "Client disconnected\n";
-            exit(EXIT_FAILURE);
-        }
-        // Append exactly bytes_read characters from buffer to raw
-        raw.append(buffer, bytes_read);
-        if (raw.size() > MAX_REQ_SIZE)
-        {
-            std::cout << "Request too large\n";
-            exit(EXIT_FAILURE);
-        }
-    }
+    if (from >= s.size())
+        return std::string_view::npos;
+    size_t at = from + scanFor(s.data() + from, s.size() - from, c);
+    return at < s.size() ? at : std::string_view::npos;
+}
 
-    // Create a stream over the raw string
-    std::istringstream stream(raw);
-    std::string line;
+static char lowerAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
 
-    // 1) Parse Request-Line: e.g. "GET /index.html HTTP/1.1"
-    HttpRequest req;
-    if (!std::getline(stream, line) || line.back() != '\r')
+bool equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
     {
-        std::cout << "Invalid request\n";
-        exit(EXIT_FAILURE);
+        if (lowerAscii(a[i]) != lowerAscii(b[i]))
+            return false;
     }
+    return true;
+}
 
+std::string_view HeaderList::find(std::string_view name) const
+{
+    for (const auto &header : *this)
     {
-        std::istringstream rl(line);
-        rl >> req.method >> req.path >> req.version;
+        if (equalsIgnoreCase(header.name, name))
+            return header.value;
     }
+    return {};
+}
 
-    // 2) Parse headers until empty line
-    while (std::getline(stream, line) && line != "\r" && !line.empty())
+// RFC 9110 token characters, used to validate methods and header names
+static bool isTokenChar(char c)
+{
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+        return true;
+    switch (c)
     {
-        // If the line ends with '\r', remove it
-        if (line.back() == '\r')
-            line.pop_back();
+    case '!': case '#': case '$': case '%': case '&': case '\'': case '*':
+    case '+': case '-': case '.': case '^': case '_': case '`': case '|': case '~':
+        return true;
+    default:
+        return false;
+    }
+}
 
-        // Find the ':' separator between header name and value
-        size_t pos = line.find(':');
-        if (pos != std::string::npos)
-        {
-            std::string name = line.substr(0, pos);
-            std::string value = line.substr(pos + 1);
-            // Trim leading space
-            if (!value.empty() && value[0] == ' ')
-                value.erase(0, 1);
-            req.headers[name] = value;
-        }
+static bool isToken(std::string_view s)
+{
+    if (s.empty())
+        return false;
+    for (char c : s)
+    {
+        if (!isTokenChar(c))
+            return false;
     }
-    return req;
+    return true;
+}
+
+void HttpParser::reset()
+{
+    state = State::RequestLine;
+    pos = 0;
+    scanned = 0;
+    headerCount = 0;
 }
 
-HttpRequest receiveRequestSSL(SSL *ssl)
+void HttpParser::parseRequestLine(std::string_view line, size_t lineStart)
 {
-    // Reserve space to avoid frequent reallocations
-    std::string raw;
-    raw.reserve(MAX_REQ_SIZE);
-    char buffer[512];
-    // Read until "\r\n\r\n"
-    while (raw.find("\r\n\r\n") == std::string::npos)
+    // e.g. "GET /index.html HTTP/1.1"
+    size_t firstSpace = findChar(line, ' ');
+    size_t lastSpace = findChar(line, ' ', firstSpace + 1);
+    if (firstSpace == std::string_view::npos || lastSpace == std::string_view::npos)
+        throw HttpParseException("Invalid request line");
+
+    std::string_view m = line.substr(0, firstSpace);
+    std::string_view p = line.substr(firstSpace + 1, lastSpace - firstSpace - 1);
+    std::string_view v = line.substr(lastSpace + 1);
+    if (!isToken(m) || p.empty() || v.size() != 8 || v.substr(0, 5) != "HTTP/")
+        throw HttpParseException("Invalid request line");
+
+    method = Span{static_cast<uint32_t>(lineStart), static_cast<uint32_t>(m.size())};
+    path = Span{static_cast<uint32_t>(lineStart + firstSpace + 1), static_cast<uint32_t>(p.size())};
+    version = Span{static_cast<uint32_t>(lineStart + lastSpace + 1), static_cast<uint32_t>(v.size())};
+}
+
+void HttpParser::parseHeaderLine(std::string_view line, size_t lineStart)
+{
+    // Find the ':' separator between header name and value
+    size_t colon = findChar(line, ':');
+    if (colon == std::string_view::npos || !isToken(line.substr(0, colon)))
+        throw HttpParseException("Invalid header line");
+    if (headerCount == headerSpans.size())
+        throw HttpParseException("Too many headers");
+
+    // Trim optional whitespace around the value
+    size_t valueStart = colon + 1;
+    size_t valueEnd = line.size();
+    while (valueStart < valueEnd && (line[valueStart] == ' ' || line[valueStart] == '\t'))
+        valueStart++;
+    while (valueEnd > valueStart && (line[valueEnd - 1] == ' ' || line[valueEnd - 1] == '\t'))
+        valueEnd--;
+
+    headerSpans[headerCount++] = HeaderSpan{
+        Span{static_cast<uint32_t>(lineStart), static_cast<uint32_t>(colon)},
+        Span{static_cast<uint32_t>(lineStart + valueStart), static_cast<uint32_t>(valueEnd - valueStart)}};
+}
+
+bool HttpParser::parse(std::string_view buffer, HttpRequest &req)
+{
+    while (state != State::Complete)
     {
-        ssize_t bytes_read = SSL_read(ssl, buffer, sizeof(buffer));
-        if (bytes_read < 0)
+        // Resume where the previous call stopped scanning, not at the line start:
+        // a long header arriving in many reads is scanned exactly once.
+        size_t newline = findChar(buffer, '\n', scanned > pos ? scanned : pos);
+        if (newline == std::string_view::npos)
         {
-            perror("read");
-            exit(EXIT_FAILURE);
+            scanned = buffer.size();
+            if (buffer.size() > MAX_REQ_SIZE)
+                throw HttpParseException("Request too large");
+            return false;
         }
-        else if (bytes_read == 0)
+        if (newline + 1 > MAX_REQ_SIZE)
+            throw HttpParseException("Request too large");
+
+        size_t lineStart = pos;
+        std::string_view line = buffer.substr(lineStart, newline - lineStart);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        pos = newline + 1;
+
+        if (state == State::RequestLine)
         {
-            std::cout << "Client disconnected\n";
-            exit(EXIT_FAILURE);
+            // Tolerate stray empty lines between pipelined requests (RFC 9112 2.2)
+            if (line.empty())
+                continue;
+            parseRequestLine(line, lineStart);
+            state = State::Headers;
         }
-        // Append exactly bytes_read characters from buffer to raw
-        raw.append(buffer, bytes_read);
-        if (raw.size() > MAX_REQ_SIZE)
+        else if (line.empty())
         {
-            std::cout << "Request too large\n";
-            exit(EXIT_FAILURE);
+            state = State::Complete;
+        }
+        else
+        {
+            parseHeaderLine(line, lineStart);
         }
     }
 
-    // Create a stream over the raw string
-    std::istringstream stream(raw);
-    std::string line;
-
-    // 1) Parse Request-Line: e.g. "GET /index.html HTTP/1.1"
-    HttpRequest req;
-    if (!std::getline(stream, line) || line.back() != '\r')
-    {
-        std::cout << "Invalid request\n";
-        exit(EXIT_FAILURE);
-    }
-
-    {
-        std::istringstream rl(line);
-        rl >> req.method >> req.path >> req.version;
-    }
+    auto view = [&buffer](Span s)
+    { return buffer.substr(s.offset, s.length); };
+    req.method = view(method);
+    req.path = view(path);
+    req.version = view(version);
+    req.headers.clear();
+    for (size_t i = 0; i < headerCount; ++i)
+        req.headers.push(view(headerSpans[i].name), view(headerSpans[i].value));
+    return true;
+}
 
-    // 2) Parse headers until empty line
-    while (std::getline(stream, line) && line != "\r" && !line.empty())
+/*
+ * Whether the comma-separated Connection value lists `option`, ignoring
+ * case and the whitespace around each token.
+ */
+static bool hasConnectionOption(std::string_view value, std::string_view option)
+{
+    while (!value.empty())
     {
-        // If the line ends with '\r', remove it
-        if (line.back() == '\r')
-            line.pop_back();
-
-        // Find the ':' separator between header name and value
-        size_t pos = line.find(':');
-        if (pos != std::string::npos)
+        size_t comma = value.find(',');
+        std::string_view token = value.substr(0, comma);
+        size_t first = token.find_first_not_of(" \t");
+        if (first != std::string_view::npos)
         {
-            std::string name = line.substr(0, pos);
-            std::string value = line.substr(pos + 1);
-            // Trim leading space
-            if (!value.empty() && value[0] == ' ')
-                value.erase(0, 1);
-            req.headers[name] = value;
+            token = token.substr(first, token.find_last_not_of(" \t") - first + 1);
+            if (equalsIgnoreCase(token, option))
+                return true;
         }
+        if (comma == std::string_view::npos)
+            break;
+        value.remove_prefix(comma + 1);
     }
-    return req;
-}
\ No newline at end of file
+    return false;
+}
+
+bool wantsKeepAlive(const HttpRequest &req)
+{
+    std::string_view length = req.headers.find("Content-Length");
+    if ((!length.empty() && length != "0") || !req.headers.find("Transfer-Encoding").empty())
+        return false;
+
+    std::string_view connection = req.headers.find("Connection");
+    if (hasConnectionOption(connection, "close"))
+        return false;
+    return req.version == "HTTP/1.1" || hasConnectionOption(connection, "keep-alive");
+}
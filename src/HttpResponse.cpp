@@ -1,32 +1,202 @@
 #include "../include/HttpResponse.hpp"
-#include <unistd.h>
-#include <sstream>
+#include "../include/Hpack.hpp"
+#include <algorithm>
+#include <charconv>
 #include <cstdio>
-#include <cstdlib>
+#include <cstring>
 
-void writeAll(int fd, const std::string &data)
+/*
+ * Pre-rendered status line of a code this server sends, or an empty view.
+ */
+static std::string_view statusLine(int status)
 {
-    const char *ptr = data.c_str();
-    ssize_t to_send = data.size();
-    ssize_t total_sent = 0;
-    while (total_sent < to_send)
+    switch (status)
     {
-        ssize_t sent = write(fd, ptr + total_sent, to_send - total_sent);
-        if (sent < 0)
-        {
-            perror("write");
-            exit(EXIT_FAILURE);
-        }
-        total_sent += sent;
+    case 200: return "HTTP/1.1 200 OK\r\n";
+    case 204: return "HTTP/1.1 204 No Content\r\n";
+    case 206: return "HTTP/1.1 206 Partial Content\r\n";
+    case 304: return "HTTP/1.1 304 Not Modified\r\n";
+    case 400: return "HTTP/1.1 400 Bad Request\r\n";
+    case 404: return "HTTP/1.1 404 Not Found\r\n";
+    case 405: return "HTTP/1.1 405 Method Not Allowed\r\n";
+    case 406: return "HTTP/1.1 406 Not Acceptable\r\n";
+    case 416: return "HTTP/1.1 416 Range Not Satisfiable\r\n";
+    case 500: return "HTTP/1.1 500 Internal Server Error\r\n";
+    default: return {};
     }
 }
 
-void sendErrorResponse(int fd, int status, const std::string &reason, const std::string &body)
+/*
+ * The "Date:" line for the current second. Each thread re-renders its copy
+ * when the second changes, so this costs a time() call otherwise.
+ */
+static std::string_view dateLine()
 {
-    std::ostringstream resp;
-    resp << "HTTP/1.1 " << status << " " << reason << "\r\n"
-         << "Content-Length: " << body.size() << "\r\n"
-         << "Connection: close\r\n\r\n"
-         << body;
-    writeAll(fd, resp.str());
+    static constexpr char PREFIX[] = "Date: ";
+    static constexpr size_t PREFIX_LENGTH = sizeof(PREFIX) - 1;
+    thread_local time_t renderedFor = -1;
+    thread_local char line[PREFIX_LENGTH + HTTP_DATE_LENGTH + 3];
+
+    time_t now = time(nullptr);
+    if (now != renderedFor)
+    {
+        memcpy(line, PREFIX, PREFIX_LENGTH);
+        formatHttpDate(now, line + PREFIX_LENGTH);
+        memcpy(line + PREFIX_LENGTH + HTTP_DATE_LENGTH, "\r\n", 2);
+        renderedFor = now;
+    }
+    return std::string_view(line, PREFIX_LENGTH + HTTP_DATE_LENGTH + 2);
+}
+
+ResponseHead::ResponseHead(Connection &conn, int status, std::string_view reason)
+    : conn(conn), out(conn.hpack ? conn.headerBlock : outputBuffer(conn))
+{
+    conn.status = status;
+    if (conn.hpack)
+    {
+        conn.hpack->encodeStatus(out, status);
+        conn.hpack->encode(out, "server", "CppWebServer");
+        conn.hpack->encode(out, "date", dateLine().substr(6, HTTP_DATE_LENGTH));
+        return;
+    }
+    std::string_view line = statusLine(status);
+    if (!line.empty())
+        out.append(line);
+    else
+    {
+        out.append("HTTP/1.1 ");
+        out.append(std::to_string(status));
+        out.push_back(' ');
+        out.append(reason);
+        out.append("\r\n");
+    }
+    out.append("Server: CppWebServer\r\n");
+    out.append(dateLine());
+}
+
+ResponseHead &ResponseHead::header(std::string_view name, std::string_view value)
+{
+    if (conn.hpack)
+    {
+        conn.hpack->encode(out, name, value);
+        return *this;
+    }
+    out.append(name);
+    out.append(": ");
+    out.append(value);
+    out.append("\r\n");
+    return *this;
+}
+
+ResponseHead &ResponseHead::header(std::string_view name, uint64_t value)
+{
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return header(name, std::string_view(digits, static_cast<size_t>(result.ptr - digits)));
+}
+
+void ResponseHead::end()
+{
+    // HTTP/2 has no Connection header, and its frame says where the head ends
+    if (conn.hpack)
+        return;
+    out.append(conn.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+}
+
+void sendErrorResponse(Connection &conn, int status, const std::string &reason, const std::string &body, bool headOnly)
+{
+    ResponseHead head(conn, status, reason);
+    head.header("Content-Length", static_cast<uint64_t>(body.size()));
+    head.end();
+    // A body after a HEAD response would be read as the next response on a
+    // keep-alive connection (and as DATA on an HTTP/2 stream)
+    if (headOnly)
+        return;
+    // Error pages are a few dozen bytes: they go in the same buffer as the head
+    outputBuffer(conn).append(body);
+}
+
+static const char *const WEEKDAYS[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *const MONTHS[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// IMF-fixdate has a four-digit year: 0000-01-01 00:00:00 to 9999-12-31 23:59:59 UTC
+constexpr time_t EARLIEST_HTTP_DATE = -62167219200;
+constexpr time_t LATEST_HTTP_DATE = 253402300799;
+
+// Writes `value` as exactly `width` decimal digits, zero-padded
+static char *putDigits(char *out, int value, int width)
+{
+    for (int i = width - 1; i >= 0; --i)
+    {
+        out[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return out + width;
+}
+
+void formatHttpDate(time_t t, char *out)
+{
+    // Out-of-range times are clamped so the year always has four digits
+    t = std::clamp(t, EARLIEST_HTTP_DATE, LATEST_HTTP_DATE);
+    struct tm tm;
+    if (!gmtime_r(&t, &tm))
+    {
+        t = 0;
+        gmtime_r(&t, &tm);
+    }
+
+    // Names are spelled out by hand: strftime's %a/%b would follow the locale
+    char *p = out;
+    memcpy(p, WEEKDAYS[tm.tm_wday], 3);
+    p += 3;
+    *p++ = ',';
+    *p++ = ' ';
+    p = putDigits(p, tm.tm_mday, 2);
+    *p++ = ' ';
+    memcpy(p, MONTHS[tm.tm_mon], 3);
+    p += 3;
+    *p++ = ' ';
+    p = putDigits(p, tm.tm_year + 1900, 4);
+    *p++ = ' ';
+    p = putDigits(p, tm.tm_hour, 2);
+    *p++ = ':';
+    p = putDigits(p, tm.tm_min, 2);
+    *p++ = ':';
+    p = putDigits(p, tm.tm_sec, 2);
+    memcpy(p, " GMT", 5); // with the NUL
+}
+
+std::string formatHttpDate(time_t t)
+{
+    char buf[HTTP_DATE_LENGTH + 1];
+    formatHttpDate(t, buf);
+    return buf;
+}
+
+bool parseHttpDate(std::string_view value, time_t &t)
+{
+    // "Sun, 06 Nov 1994 08:49:37 GMT" is exactly 29 characters
+    if (value.size() != 29)
+        return false;
+    std::string text(value);
+
+    char weekday[4], month[4];
+    struct tm tm{};
+    int consumed = 0;
+    if (sscanf(text.c_str(), "%3s, %2d %3s %4d %2d:%2d:%2d GMT%n", weekday, &tm.tm_mday, month,
+               &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &consumed) != 7 ||
+        consumed != 29)
+        return false;
+
+    tm.tm_mon = -1;
+    for (int i = 0; i < 12; ++i)
+        if (strcmp(month, MONTHS[i]) == 0)
+            tm.tm_mon = i;
+    if (tm.tm_mon < 0 || tm.tm_mday < 1 || tm.tm_mday > 31 || tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60)
+        return false;
+
+    tm.tm_year -= 1900;
+    t = timegm(&tm);
+    return t != -1;
 }
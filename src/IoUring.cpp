@@ -0,0 +1,229 @@
+#include "../include/IoUring.hpp"
+#include "../include/Exception.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+static int ioUringSetup(unsigned entries, io_uring_params *p)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int ioUringRegister(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+static std::string errnoText(const char *what)
+{
+    return std::string(what) + " failed: " + std::strerror(errno);
+}
+
+IoUring::IoUring(unsigned entries)
+{
+    // Newest feature set first. A single-issuer ring binds to the thread that
+    // creates it, so it starts disabled and enable() binds it to its user.
+    const unsigned attempts[] = {
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED | IORING_SETUP_SUBMIT_ALL,
+        IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL,
+        0,
+    };
+    io_uring_params p{};
+    for (unsigned flags : attempts)
+    {
+        std::memset(&p, 0, sizeof(p));
+        // Room for a burst of completions without touching the overflow list
+        p.flags = flags | IORING_SETUP_CQSIZE;
+        p.cq_entries = entries * 4;
+        ringFd = ioUringSetup(entries, &p);
+        if (ringFd >= 0 || errno != EINVAL)
+            break;
+    }
+    if (ringFd < 0)
+        throw SocketException(errnoText("io_uring_setup"));
+    features = p.features;
+    disabled = (p.flags & IORING_SETUP_R_DISABLED) != 0;
+    if (!(features & IORING_FEAT_EXT_ARG) || !(features & IORING_FEAT_NODROP))
+    {
+        close(ringFd);
+        throw SocketException("io_uring is too old: waiting with a timeout needs Linux 5.11+");
+    }
+
+    sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap)
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+    {
+        sqRing = nullptr;
+        std::string message = errnoText("mmap(io_uring SQ ring)");
+        close(ringFd);
+        throw SocketException(message);
+    }
+    cqRing = singleMmap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void *sqeMemory = cqRing == MAP_FAILED ? MAP_FAILED
+                                           : mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqeMemory == MAP_FAILED)
+    {
+        std::string message = errnoText("mmap(io_uring rings)");
+        if (cqRing != MAP_FAILED && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        munmap(sqRing, sqRingSize);
+        close(ringFd);
+        throw SocketException(message);
+    }
+    sqes = static_cast<io_uring_sqe *>(sqeMemory);
+
+    char *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    sqEntries = p.sq_entries;
+    // SQE i always sits in slot i, so submitting is just moving the tail
+    unsigned *array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; ++i)
+        array[i] = i;
+    sqLocalTail = *sqTail;
+
+    char *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+}
+
+IoUring::~IoUring()
+{
+    if (bufRing)
+        munmap(bufRing, bufRingSize);
+    munmap(sqes, sqesSize);
+    if (cqRing != sqRing)
+        munmap(cqRing, cqRingSize);
+    munmap(sqRing, sqRingSize);
+    close(ringFd);
+}
+
+void IoUring::enable()
+{
+    if (!disabled)
+        return;
+    if (ioUringRegister(ringFd, IORING_REGISTER_ENABLE_RINGS, nullptr, 0) < 0)
+        throw SocketException(errnoText("io_uring_register(ENABLE_RINGS)"));
+    disabled = false;
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned waitNr, unsigned flags, const void *arg, size_t argSize)
+{
+    enters++;
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, waitNr, flags, arg, argSize));
+}
+
+void IoUring::flush()
+{
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+}
+
+void IoUring::reserve(unsigned count)
+{
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (sqEntries - (sqLocalTail - head) >= count)
+        return;
+
+    flush();
+    unsigned pending = sqLocalTail - head;
+    if (enter(pending, 0, 0, nullptr, 0) < 0 && errno != EINTR && errno != EBUSY)
+        throw SocketException(errnoText("io_uring_enter"));
+    // EBUSY consumes nothing; handing out slots the kernel has not read
+    // yet would overwrite prepared SQEs
+    head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    submitted += pending - (sqLocalTail - head);
+    if (sqEntries - (sqLocalTail - head) < count)
+        throw SocketException("io_uring submission ring is full");
+}
+
+io_uring_sqe *IoUring::get()
+{
+    reserve(1);
+    io_uring_sqe *sqe = &sqes[sqLocalTail & sqMask];
+    sqLocalTail++;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool IoUring::submitAndWait(unsigned waitNr, int timeoutMs)
+{
+    flush();
+    unsigned pending = sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    submitted += pending;
+
+    __kernel_timespec ts{};
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+    io_uring_getevents_arg arg{};
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    if (enter(pending, waitNr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) >= 0)
+        return true;
+    // EBUSY: completions are backed up in the overflow list; reaping frees them
+    if (errno == ETIME || errno == EINTR || errno == EBUSY)
+        return errno == EBUSY;
+    throw SocketException(errnoText("io_uring_enter"));
+}
+
+void IoUring::addBufferRing(uint16_t group, unsigned count, size_t size)
+{
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768)
+        throw SocketException("io_uring buffer ring size must be a power of two up to 32768");
+
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    bufRingSize = (count * sizeof(io_uring_buf) + pageSize - 1) / pageSize * pageSize;
+    void *ring = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED)
+        throw SocketException(errnoText("mmap(io_uring buffer ring)"));
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (ioUringRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        std::string message = errnoText("io_uring_register(PBUF_RING)");
+        munmap(ring, bufRingSize);
+        throw SocketException(message);
+    }
+
+    // Indexed by hand: in C++ the header's flexible `bufs` member does not
+    // start at offset 0. The tail overlays the `resv` field of entry 0.
+    bufRing = static_cast<io_uring_buf *>(ring);
+    bufTail = &bufRing[0].resv;
+    bufMask = count - 1;
+    bufferSize = size;
+    buffers = std::make_unique<char[]>(count * size);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        io_uring_buf &buf = bufRing[i];
+        buf.addr = reinterpret_cast<uint64_t>(buffer(static_cast<uint16_t>(i)));
+        buf.len = static_cast<uint32_t>(size);
+        buf.bid = static_cast<uint16_t>(i);
+    }
+    __atomic_store_n(bufTail, static_cast<uint16_t>(count), __ATOMIC_RELEASE);
+}
+
+void IoUring::recycleBuffer(uint16_t id)
+{
+    uint16_t tail = *bufTail; // only this thread adds buffers
+    io_uring_buf &buf = bufRing[tail & bufMask];
+    buf.addr = reinterpret_cast<uint64_t>(buffer(id));
+    buf.len = static_cast<uint32_t>(bufferSize);
+    buf.bid = id;
+    __atomic_store_n(bufTail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
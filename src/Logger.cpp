@@ -1,12 +1,300 @@
 #include "../include/Logger.hpp"
+#include "../include/Exception.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <ctime>
+#include <memory>
 #include <mutex>
-#include <iostream>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
 
-std::mutex logMutex;
+// Per-thread ring size; a power of two so positions wrap with a mask
+constexpr size_t RING_BYTES = 64 * 1024;
+// How long the writer sleeps when every ring was empty
+constexpr auto WRITER_IDLE = std::chrono::milliseconds(10);
+
+/*
+ * Fixed header in front of every message in a ring.
+ */
+struct RecordHeader
+{
+    uint32_t length; // message bytes following the header
+    uint32_t level;
+    int64_t timeNs; // wall-clock time the message was logged
+};
+
+/*
+ * Single-producer/single-consumer byte ring. The owning thread appends at
+ * `head`, the writer consumes at `tail`; both only ever grow, and each is
+ * published with release/acquire so the other side sees complete records.
+ */
+struct LogRing
+{
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<bool> orphaned{false}; // owning thread exited; remove once drained
+    char data[RING_BYTES];
+
+    void copyIn(uint64_t pos, const void *src, size_t len)
+    {
+        size_t offset = pos & (RING_BYTES - 1);
+        size_t first = std::min(len, RING_BYTES - offset);
+        std::memcpy(data + offset, src, first);
+        std::memcpy(data, static_cast<const char *>(src) + first, len - first);
+    }
+
+    void copyOut(uint64_t pos, void *dst, size_t len) const
+    {
+        size_t offset = pos & (RING_BYTES - 1);
+        size_t first = std::min(len, RING_BYTES - offset);
+        std::memcpy(dst, data + offset, first);
+        std::memcpy(static_cast<char *>(dst) + first, data, len - first);
+    }
+};
+
+static std::atomic<int> minLevel{static_cast<int>(LogLevel::Info)};
+static std::atomic<int> outputFd{STDOUT_FILENO};
+static std::atomic<uint64_t> dropped{0};
+
+/*
+ * Owns the list of rings and the background writer thread.
+ * Created on the first log call; the destructor (at exit) stops the writer
+ * after a final drain, so messages logged before exit are not lost.
+ */
+class LogWriter
+{
+public:
+    LogWriter() : writer(&LogWriter::run, this) {}
+
+    ~LogWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    void add(std::shared_ptr<LogRing> ring)
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(std::move(ring));
+    }
+
+private:
+    void run()
+    {
+        std::string batch;
+        uint64_t reportedDrops = 0;
+        while (true)
+        {
+            bool stop;
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stop = stopping;
+            }
+
+            batch.clear();
+            drain(batch);
+            uint64_t drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops)
+            {
+                batch += "[logger] dropped " + std::to_string(drops - reportedDrops) + " messages\n";
+                reportedDrops = drops;
+            }
+            writeAll(batch);
+
+            if (stop)
+                return;
+            if (batch.empty())
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                wake.wait_for(lock, WRITER_IDLE, [this]()
+                              { return stopping; });
+            }
+        }
+    }
+
+    /*
+     * Moves every complete record from every ring into `batch`, formatted.
+     * Rings of exited threads are released once empty.
+     */
+    void drain(std::string &batch)
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (size_t i = 0; i < rings.size();)
+        {
+            LogRing &ring = *rings[i];
+            bool orphaned = ring.orphaned.load(std::memory_order_acquire);
+            uint64_t head = ring.head.load(std::memory_order_acquire);
+            uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+            while (tail < head)
+            {
+                RecordHeader hdr;
+                ring.copyOut(tail, &hdr, sizeof(hdr));
+                appendPrefix(batch, hdr);
+                size_t at = batch.size();
+                batch.resize(at + hdr.length);
+                ring.copyOut(tail + sizeof(hdr), &batch[at], hdr.length);
+                batch += '\n';
+                tail += sizeof(hdr) + hdr.length;
+            }
+            ring.tail.store(tail, std::memory_order_release);
+
+            if (orphaned)
+            {
+                rings[i] = std::move(rings.back());
+                rings.pop_back();
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    /*
+     * "2024-05-01 12:00:00.123 INFO  " in UTC. The date part is only
+     * reformatted when the second changes.
+     */
+    void appendPrefix(std::string &batch, const RecordHeader &hdr)
+    {
+        static const char *const NAMES[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+        time_t seconds = static_cast<time_t>(hdr.timeNs / 1000000000);
+        if (seconds != cachedSecond)
+        {
+            struct tm tm;
+            gmtime_r(&seconds, &tm);
+            strftime(cachedDate, sizeof(cachedDate), "%Y-%m-%d %H:%M:%S", &tm);
+            cachedSecond = seconds;
+        }
+        char prefix[48];
+        int n = snprintf(prefix, sizeof(prefix), "%s.%03d %s ", cachedDate,
+                         static_cast<int>(hdr.timeNs / 1000000 % 1000), NAMES[hdr.level & 3]);
+        batch.append(prefix, static_cast<size_t>(n));
+    }
+
+    static void writeAll(const std::string &batch)
+    {
+        int fd = outputFd.load(std::memory_order_relaxed);
+        size_t done = 0;
+        while (done < batch.size())
+        {
+            ssize_t n = write(fd, batch.data() + done, batch.size() - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return; // nowhere to report a failing log sink
+            done += static_cast<size_t>(n);
+        }
+    }
+
+    std::mutex ringsMutex; // taken by the writer and once per thread on its first message
+    std::vector<std::shared_ptr<LogRing>> rings;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    time_t cachedSecond = -1;
+    char cachedDate[32] = {};
+
+    std::thread writer; // last member: starts after everything above is initialised
+};
+
+static LogWriter &logWriter()
+{
+    static LogWriter instance;
+    return instance;
+}
+
+/*
+ * Gives each thread its own ring, registered with the writer on first use
+ * and handed over to it (marked orphaned) when the thread exits.
+ */
+struct ThreadRing
+{
+    ThreadRing() : ring(std::make_shared<LogRing>())
+    {
+        logWriter().add(ring);
+    }
+    ~ThreadRing()
+    {
+        ring->orphaned.store(true, std::memory_order_release);
+    }
+    std::shared_ptr<LogRing> ring;
+};
+
+void initLogger(const std::string &path, LogLevel level)
+{
+    minLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+    if (path.empty())
+        return;
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw FileException("Failed to open log file: " + path);
+    int previous = outputFd.exchange(fd);
+    if (previous != STDOUT_FILENO)
+        close(previous);
+}
+
+bool logEnabled(LogLevel level)
+{
+    return static_cast<int>(level) >= minLevel.load(std::memory_order_relaxed);
+}
+
+void logAt(LogLevel level, const std::string &message)
+{
+    thread_local ThreadRing local;
+    LogRing &ring = *local.ring;
+
+    RecordHeader hdr;
+    hdr.length = static_cast<uint32_t>(message.size());
+    hdr.level = static_cast<uint32_t>(level);
+    hdr.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::system_clock::now().time_since_epoch())
+                     .count();
+
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t tail = ring.tail.load(std::memory_order_acquire);
+    size_t need = sizeof(hdr) + message.size();
+    if (message.size() > UINT32_MAX || need > RING_BYTES - (head - tail))
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring.copyIn(head, &hdr, sizeof(hdr));
+    ring.copyIn(head + sizeof(hdr), message.data(), message.size());
+    ring.head.store(head + need, std::memory_order_release);
+}
 
 void log(const std::string &message)
 {
-    std::lock_guard<std::mutex> lock(logMutex);
-    std::cout << message
-              << std::endl;
-}
\ No newline at end of file
+    LOG_INFO(message);
+}
+
+bool parseLogLevel(const std::string &name, LogLevel &level)
+{
+    if (name == "debug")
+        level = LogLevel::Debug;
+    else if (name == "info")
+        level = LogLevel::Info;
+    else if (name == "warn")
+        level = LogLevel::Warn;
+    else if (name == "error")
+        level = LogLevel::Error;
+    else
+        return false;
+    return true;
+}
+
+uint64_t droppedLogMessages()
+{
+    return dropped.load(std::memory_order_relaxed);
+}
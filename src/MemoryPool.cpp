@@ -0,0 +1,152 @@
+#include "../include/MemoryPool.hpp"
+#include <algorithm>
+#include <new>
+
+BufferPool::BufferPool(size_t blockSize) : size(blockSize)
+{
+}
+
+void BufferPool::addSlab()
+{
+    slabs.push_back(std::make_unique<char[]>(size * BLOCKS_PER_SLAB));
+    char *slab = slabs.back().get();
+    // Room for every block ever carved, so release() never reallocates
+    freeBlocks.reserve(slabs.size() * BLOCKS_PER_SLAB);
+    // Pushed in reverse so the slab is handed out front to back
+    for (size_t i = BLOCKS_PER_SLAB; i-- > 0;)
+        freeBlocks.push_back(slab + i * size);
+}
+
+char *BufferPool::acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (freeBlocks.empty())
+        addSlab();
+    char *block = freeBlocks.back();
+    freeBlocks.pop_back();
+    acquired++;
+    peakInUse = std::max(peakInUse, ++inUse);
+    return block;
+}
+
+void BufferPool::release(char *block)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    freeBlocks.push_back(block);
+    inUse--;
+}
+
+void BufferPool::reserve(size_t blocks)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    while (slabs.size() * BLOCKS_PER_SLAB < blocks)
+        addSlab();
+}
+
+BufferPool::Stats BufferPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats s;
+    s.blockSize = size;
+    s.blocks = slabs.size() * BLOCKS_PER_SLAB;
+    s.inUse = inUse;
+    s.peakInUse = peakInUse;
+    s.acquired = acquired;
+    s.slabs = slabs.size();
+    return s;
+}
+
+PooledBuffer &PooledBuffer::operator=(PooledBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        pool = other.pool;
+        block = other.block;
+        other.block = nullptr;
+    }
+    return *this;
+}
+
+void PooledBuffer::reset()
+{
+    if (block)
+        pool->release(block);
+    block = nullptr;
+}
+
+static std::atomic<uint64_t> arenaResets{0};
+static std::atomic<size_t> arenaPeakBytes{0};
+static std::atomic<uint64_t> arenaOverflows{0};
+
+RequestArena::~RequestArena()
+{
+    freeChunks();
+}
+
+void RequestArena::freeChunks()
+{
+    while (chunks)
+    {
+        Chunk *next = chunks->next;
+        ::operator delete(chunks);
+        chunks = next;
+    }
+}
+
+void RequestArena::reset()
+{
+    size_t bytes = used();
+    size_t peak = arenaPeakBytes.load(std::memory_order_relaxed);
+    while (bytes > peak && !arenaPeakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed))
+    {
+    }
+    arenaResets.fetch_add(1, std::memory_order_relaxed);
+
+    freeChunks();
+    current = inlineBlock;
+    capacity = INLINE_SIZE;
+    offset = 0;
+    usedBefore = 0;
+}
+
+void *RequestArena::do_allocate(size_t bytes, size_t alignment)
+{
+    size_t start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes > capacity)
+    {
+        // Each chunk is at least as large as the inline block, so a request
+        // that keeps growing takes few of them
+        size_t chunkSize = std::max(bytes + alignment, INLINE_SIZE);
+        Chunk *chunk = static_cast<Chunk *>(::operator new(sizeof(Chunk) + chunkSize));
+        chunk->next = chunks;
+        chunk->size = chunkSize;
+        chunks = chunk;
+        arenaOverflows.fetch_add(1, std::memory_order_relaxed);
+
+        usedBefore += offset;
+        current = reinterpret_cast<char *>(chunk + 1);
+        capacity = chunkSize;
+        offset = 0;
+        // Chunk data starts max_align_t-aligned; larger alignments are padded
+        size_t misalign = reinterpret_cast<uintptr_t>(current) & (alignment - 1);
+        start = misalign ? alignment - misalign : 0;
+    }
+    offset = start + bytes;
+    return current + start;
+}
+
+RequestArena &requestArena()
+{
+    thread_local RequestArena arena;
+    return arena;
+}
+
+RequestArena::Stats requestArenaStats()
+{
+    RequestArena::Stats s;
+    s.resets = arenaResets.load(std::memory_order_relaxed);
+    s.peakBytes = arenaPeakBytes.load(std::memory_order_relaxed);
+    s.overflows = arenaOverflows.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,340 @@
+#include "../include/Metrics.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Log-linear histogram layout: values below 8 get exact buckets, every
+// power of two above is split into 8 sub-buckets (~12.5% resolution).
+constexpr int SUB_BUCKET_BITS = 3;
+constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+constexpr size_t HISTOGRAM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+// Exported `le` bounds: 2^10 ns (~1 us) up to 2^34 ns (~17 s)
+constexpr int FIRST_EXPORTED_POWER = 10;
+constexpr int LAST_EXPORTED_POWER = 34;
+
+// Methods and statuses get fixed slots so recording is an array index
+static const char *const METHODS[] = {"GET", "HEAD", "OPTIONS", "other"};
+static const int STATUSES[] = {200, 204, 206, 304, 400, 404, 405, 406, 416, 500};
+constexpr size_t METHOD_SLOTS = sizeof(METHODS) / sizeof(METHODS[0]);
+constexpr size_t STATUS_SLOTS = sizeof(STATUSES) / sizeof(STATUSES[0]) + 1; // last slot: any other status
+
+struct TimerInfo
+{
+    const char *name;
+    const char *help;
+};
+static const TimerInfo TIMERS[] = {
+    {"cppweb_request_duration_seconds", "Time spent building a response in handleClient."},
+    {"cppweb_parse_duration_seconds", "Time of the parse call that completed a request."},
+    {"cppweb_file_read_duration_seconds", "Time to load a file into the file cache."},
+    {"cppweb_send_duration_seconds", "Time of one pass writing a connection's output queue."},
+    {"cppweb_tls_handshake_duration_seconds", "Time from accept to a finished TLS handshake."},
+};
+static_assert(sizeof(TIMERS) / sizeof(TIMERS[0]) == static_cast<size_t>(Timer::Count), "one entry per Timer");
+
+/*
+ * Counters owned by a single thread. Only that thread writes them, so an
+ * update is a relaxed load and store instead of a locked read-modify-write;
+ * renderMetrics() reads them concurrently from another thread.
+ */
+struct Histogram
+{
+    std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sumNs{0};
+};
+
+struct alignas(64) ThreadMetrics
+{
+    std::atomic<uint64_t> requests[METHOD_SLOTS][STATUS_SLOTS] = {};
+    std::atomic<uint64_t> bytesSent{0};
+    std::atomic<uint64_t> connectionsOpened{0};
+    std::atomic<uint64_t> connectionsClosed{0};
+    std::atomic<uint64_t> tlsHandshakes[2] = {}; // full, resumed
+    std::atomic<uint64_t> kernelTls{0};
+    std::atomic<uint64_t> tlsHandshakeTimeouts{0};
+    Histogram timers[static_cast<size_t>(Timer::Count)];
+};
+
+static inline void bump(std::atomic<uint64_t> &counter, uint64_t by = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+static std::string metricsPath;
+static std::mutex registryMutex; // taken once per thread and when rendering
+static std::vector<std::unique_ptr<ThreadMetrics>> registry;
+static std::vector<std::function<void(std::string &)>> collectors;
+
+/*
+ * The calling thread's block, created and registered on first use.
+ * Blocks outlive their threads so totals never go backwards.
+ */
+static ThreadMetrics &local()
+{
+    thread_local ThreadMetrics *mine = nullptr;
+    if (!mine)
+    {
+        auto block = std::make_unique<ThreadMetrics>();
+        mine = block.get();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::move(block));
+    }
+    return *mine;
+}
+
+static size_t bucketIndex(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+        return static_cast<size_t>(value);
+    int exponent = 63 - __builtin_clzll(value); // >= SUB_BUCKET_BITS
+    size_t sub = static_cast<size_t>(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return static_cast<size_t>(exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+/*
+ * Value range [lower, upper) covered by bucket `index`, as doubles so the
+ * topmost bucket does not overflow.
+ */
+static void bucketRange(size_t index, double &lower, double &upper)
+{
+    if (index < SUB_BUCKETS)
+    {
+        lower = static_cast<double>(index);
+        upper = lower + 1;
+        return;
+    }
+    int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+    double unit = static_cast<double>(uint64_t(1) << shift);
+    lower = static_cast<double>(SUB_BUCKETS + index % SUB_BUCKETS) * unit;
+    upper = lower + unit;
+}
+
+static size_t methodSlot(std::string_view method)
+{
+    for (size_t i = 0; i + 1 < METHOD_SLOTS; ++i)
+        if (method == METHODS[i])
+            return i;
+    return METHOD_SLOTS - 1;
+}
+
+static size_t statusSlot(int status)
+{
+    for (size_t i = 0; i + 1 < STATUS_SLOTS; ++i)
+        if (status == STATUSES[i])
+            return i;
+    return STATUS_SLOTS - 1;
+}
+
+void initMetrics(const std::string &path)
+{
+    metricsPath = path;
+}
+
+bool isMetricsPath(std::string_view path)
+{
+    return !metricsPath.empty() && path == metricsPath;
+}
+
+void recordRequest(std::string_view method, int status)
+{
+    bump(local().requests[methodSlot(method)][statusSlot(status)]);
+}
+
+void recordLatency(Timer timer, int64_t nanos)
+{
+    Histogram &h = local().timers[static_cast<size_t>(timer)];
+    uint64_t value = nanos > 0 ? static_cast<uint64_t>(nanos) : 0;
+    bump(h.buckets[bucketIndex(value)]);
+    bump(h.count);
+    bump(h.sumNs, value);
+}
+
+void recordBytesSent(uint64_t bytes)
+{
+    bump(local().bytesSent, bytes);
+}
+
+void recordConnectionOpened()
+{
+    bump(local().connectionsOpened);
+}
+
+void recordConnectionClosed()
+{
+    bump(local().connectionsClosed);
+}
+
+void recordTlsHandshake(bool resumed)
+{
+    bump(local().tlsHandshakes[resumed ? 1 : 0]);
+}
+
+void recordKernelTls()
+{
+    bump(local().kernelTls);
+}
+
+void recordTlsHandshakeTimeout()
+{
+    bump(local().tlsHandshakeTimeouts);
+}
+
+int64_t monotonicNanos()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void addMetricsCollector(std::function<void(std::string &)> collector)
+{
+    collectors.push_back(std::move(collector));
+}
+
+static void appendSample(std::string &out, const std::string &series, double value)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), " %.9g\n", value);
+    out += series;
+    out += buf;
+}
+
+static void appendHeader(std::string &out, const char *name, const char *type, const char *help)
+{
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+void writeMetric(std::string &out, const char *name, const char *type, const char *help, double value)
+{
+    appendHeader(out, name, type, help);
+    appendSample(out, name, value);
+}
+
+/*
+ * Writes one merged histogram: cumulative power-of-two buckets, _sum,
+ * _count, and quantiles estimated from the fine buckets.
+ */
+static void appendHistogram(std::string &out, const TimerInfo &info, const std::vector<uint64_t> &buckets, uint64_t count, uint64_t sumNs)
+{
+    appendHeader(out, info.name, "histogram", info.help);
+    std::string name = info.name;
+
+    uint64_t cumulative = 0;
+    size_t next = 0;
+    for (int power = FIRST_EXPORTED_POWER; power <= LAST_EXPORTED_POWER; ++power)
+    {
+        // Buckets line up with powers of two: everything below 2^power ends here
+        size_t end = static_cast<size_t>(power - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+        for (; next < end; ++next)
+            cumulative += buckets[next];
+        char le[32];
+        snprintf(le, sizeof(le), "%.9g", static_cast<double>(uint64_t(1) << power) / 1e9);
+        appendSample(out, name + "_bucket{le=\"" + le + "\"}", static_cast<double>(cumulative));
+    }
+    appendSample(out, name + "_bucket{le=\"+Inf\"}", static_cast<double>(count));
+    appendSample(out, name + "_sum", static_cast<double>(sumNs) / 1e9);
+    appendSample(out, name + "_count", static_cast<double>(count));
+
+    std::string quantileName = name.substr(0, name.size() - 8) + "_quantile_seconds"; // drop "_seconds"
+    appendHeader(out, quantileName.c_str(), "gauge", "Latency quantiles estimated from the histogram above.");
+    static const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+    for (double q : QUANTILES)
+    {
+        double estimate = 0;
+        if (count > 0)
+        {
+            uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+            {
+                seen += buckets[i];
+                if (seen >= rank)
+                {
+                    double lower, upper;
+                    bucketRange(i, lower, upper);
+                    estimate = (lower + upper) / 2 / 1e9;
+                    break;
+                }
+            }
+        }
+        char label[48];
+        snprintf(label, sizeof(label), "{quantile=\"%g\"}", q);
+        appendSample(out, quantileName + label, estimate);
+    }
+}
+
+std::string renderMetrics()
+{
+    std::string out;
+    out.reserve(16384);
+
+    uint64_t requests[METHOD_SLOTS][STATUS_SLOTS] = {};
+    uint64_t bytesSent = 0, opened = 0, closed = 0, fullHandshakes = 0, resumedHandshakes = 0, kernelTls = 0, handshakeTimeouts = 0;
+    std::vector<std::vector<uint64_t>> buckets(static_cast<size_t>(Timer::Count), std::vector<uint64_t>(HISTOGRAM_BUCKETS));
+    std::vector<uint64_t> counts(static_cast<size_t>(Timer::Count)), sums(static_cast<size_t>(Timer::Count));
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const auto &block : registry)
+        {
+            for (size_t m = 0; m < METHOD_SLOTS; ++m)
+                for (size_t s = 0; s < STATUS_SLOTS; ++s)
+                    requests[m][s] += block->requests[m][s].load(std::memory_order_relaxed);
+            bytesSent += block->bytesSent.load(std::memory_order_relaxed);
+            opened += block->connectionsOpened.load(std::memory_order_relaxed);
+            closed += block->connectionsClosed.load(std::memory_order_relaxed);
+            fullHandshakes += block->tlsHandshakes[0].load(std::memory_order_relaxed);
+            resumedHandshakes += block->tlsHandshakes[1].load(std::memory_order_relaxed);
+            kernelTls += block->kernelTls.load(std::memory_order_relaxed);
+            handshakeTimeouts += block->tlsHandshakeTimeouts.load(std::memory_order_relaxed);
+            for (size_t t = 0; t < static_cast<size_t>(Timer::Count); ++t)
+            {
+                const Histogram &h = block->timers[t];
+                for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+                    buckets[t][i] += h.buckets[i].load(std::memory_order_relaxed);
+                counts[t] += h.count.load(std::memory_order_relaxed);
+                sums[t] += h.sumNs.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    appendHeader(out, "cppweb_requests_total", "counter", "Requests answered, by method and status.");
+    for (size_t m = 0; m < METHOD_SLOTS; ++m)
+    {
+        for (size_t s = 0; s < STATUS_SLOTS; ++s)
+        {
+            if (requests[m][s] == 0)
+                continue;
+            std::string status = s + 1 < STATUS_SLOTS ? std::to_string(STATUSES[s]) : "other";
+            appendSample(out, std::string("cppweb_requests_total{method=\"") + METHODS[m] + "\",status=\"" + status + "\"}",
+                         static_cast<double>(requests[m][s]));
+        }
+    }
+    writeMetric(out, "cppweb_bytes_sent_total", "counter", "Bytes written to client sockets, headers included.", static_cast<double>(bytesSent));
+    writeMetric(out, "cppweb_connections_accepted_total", "counter", "Client connections accepted.", static_cast<double>(opened));
+    // The two sums are read at slightly different times, so clamp a transient negative
+    writeMetric(out, "cppweb_connections_active", "gauge", "Client connections currently open.", opened > closed ? static_cast<double>(opened - closed) : 0.0);
+    appendHeader(out, "cppweb_tls_handshakes_total", "counter", "Completed TLS handshakes, full or resumed from a session.");
+    appendSample(out, "cppweb_tls_handshakes_total{type=\"full\"}", static_cast<double>(fullHandshakes));
+    appendSample(out, "cppweb_tls_handshakes_total{type=\"resumed\"}", static_cast<double>(resumedHandshakes));
+    writeMetric(out, "cppweb_tls_handshake_timeouts_total", "counter", "TLS handshakes cut off after tlsHandshakeTimeout.", static_cast<double>(handshakeTimeouts));
+    writeMetric(out, "cppweb_tls_kernel_offload_total", "counter", "TLS connections whose writes are encrypted by the kernel (kTLS).", static_cast<double>(kernelTls));
+
+    for (size_t t = 0; t < static_cast<size_t>(Timer::Count); ++t)
+        appendHistogram(out, TIMERS[t], buckets[t], counts[t], sums[t]);
+
+    for (const auto &collector : collectors)
+        collector(out);
+    return out;
+}
@@ -0,0 +1,367 @@
+#include "../include/MimeTypes.hpp"
+#include "../include/Exception.hpp"
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Both tables are hash-and-displace perfect hashes:
+ *  - hash(ext, 0) picks a bucket, and the bucket's displacement d
+ *    places each of its extensions at slot hash(ext, d + 1), so every
+ *    extension has a slot of its own;
+ *  - a lookup is two hashes, two array reads and one comparison.
+ * Slots hold an entry index plus one (0 is an empty slot), at most half
+ * of them are used, and there is one bucket per two entries.
+ */
+
+struct MimeEntry
+{
+    std::string_view extension; // lowercase
+    std::string_view type;
+};
+
+// Longer extensions are not looked up (nor loaded), which also bounds the hashing
+constexpr size_t MAX_EXTENSION = 32;
+// Displacements tried per bucket before the build gives up
+constexpr uint32_t MAX_DISPLACEMENT = 1u << 16;
+constexpr std::string_view DEFAULT_TYPE = "application/octet-stream";
+
+constexpr char lowerAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// FNV-1a over the lowercased bytes, seeded and finished with a mix step
+constexpr uint32_t extensionHash(std::string_view extension, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (char c : extension)
+    {
+        h ^= static_cast<unsigned char>(lowerAscii(c));
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h;
+}
+
+// `key` is lowercase already; `extension` comes from a request path
+constexpr bool sameExtension(std::string_view key, std::string_view extension)
+{
+    if (key.size() != extension.size())
+        return false;
+    for (size_t i = 0; i < key.size(); ++i)
+        if (key[i] != lowerAscii(extension[i]))
+            return false;
+    return true;
+}
+
+constexpr size_t slotCountFor(size_t entries)
+{
+    size_t slots = 1;
+    while (slots < 2 * entries)
+        slots *= 2;
+    return slots;
+}
+
+constexpr size_t bucketCountFor(size_t entries)
+{
+    return entries / 2 + 1;
+}
+
+/*
+ * Tries displacement `d` for bucket `bucket`: every extension in it must
+ * land on a free slot. Either all of them are placed or none.
+ */
+template <class Entries, class Slots>
+constexpr bool placeBucket(const Entries &entries, size_t count, size_t bucketCount, size_t bucket, uint32_t d, Slots &slots, size_t slotCount)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (extensionHash(entries[i].extension, 0) % bucketCount != bucket)
+            continue;
+        size_t slot = extensionHash(entries[i].extension, d + 1) & (slotCount - 1);
+        if (slots[slot] == 0)
+        {
+            slots[slot] = static_cast<uint16_t>(i + 1);
+            continue;
+        }
+        // Taken: undo this bucket's placements made so far
+        for (size_t j = 0; j < i; ++j)
+            if (extensionHash(entries[j].extension, 0) % bucketCount == bucket)
+                slots[extensionHash(entries[j].extension, d + 1) & (slotCount - 1)] = 0;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Fills `displacements` and `slots` for `entries`, largest buckets first.
+ * Returns false if some bucket could not be placed (a repeated extension
+ * never can). Usable in constant expressions for the built-in table.
+ */
+template <class Entries, class Displacements, class Slots>
+constexpr bool buildPerfectHash(const Entries &entries, size_t count, Displacements &displacements, size_t bucketCount, Slots &slots, size_t slotCount)
+{
+    for (size_t s = 0; s < slotCount; ++s)
+        slots[s] = 0;
+    for (size_t b = 0; b < bucketCount; ++b)
+        displacements[b] = 0;
+
+    // Bucket sizes are recounted rather than stored, so no scratch space is needed
+    size_t largest = 0;
+    for (size_t b = 0; b < bucketCount; ++b)
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < count; ++i)
+            size += extensionHash(entries[i].extension, 0) % bucketCount == b;
+        largest = size > largest ? size : largest;
+    }
+
+    for (size_t size = largest; size > 0; --size)
+    {
+        for (size_t b = 0; b < bucketCount; ++b)
+        {
+            size_t members = 0;
+            for (size_t i = 0; i < count; ++i)
+                members += extensionHash(entries[i].extension, 0) % bucketCount == b;
+            if (members != size)
+                continue;
+            uint32_t d = 0;
+            while (d < MAX_DISPLACEMENT && !placeBucket(entries, count, bucketCount, b, d, slots, slotCount))
+                ++d;
+            if (d == MAX_DISPLACEMENT)
+                return false;
+            displacements[b] = d;
+        }
+    }
+    return true;
+}
+
+template <class Entries, class Displacements, class Slots>
+constexpr const MimeEntry *findExtension(std::string_view extension, const Entries &entries, const Displacements &displacements,
+                                         size_t bucketCount, const Slots &slots, size_t slotCount)
+{
+    uint32_t d = displacements[extensionHash(extension, 0) % bucketCount];
+    uint16_t slot = slots[extensionHash(extension, d + 1) & (slotCount - 1)];
+    if (slot == 0 || !sameExtension(entries[slot - 1].extension, extension))
+        return nullptr;
+    return &entries[slot - 1];
+}
+
+// Built-in types; extensions must be lowercase and appear once
+constexpr MimeEntry BUILTIN_ENTRIES[] = {
+    {"html", "text/html"},
+    {"htm", "text/html"},
+    {"css", "text/css"},
+    {"js", "application/javascript"},
+    {"mjs", "application/javascript"},
+    {"json", "application/json"},
+    {"map", "application/json"},
+    {"jsonld", "application/ld+json"},
+    {"webmanifest", "application/manifest+json"},
+    {"xml", "application/xml"},
+    {"xhtml", "application/xhtml+xml"},
+    {"rss", "application/rss+xml"},
+    {"atom", "application/atom+xml"},
+    {"txt", "text/plain"},
+    {"csv", "text/csv"},
+    {"md", "text/markdown"},
+    {"ics", "text/calendar"},
+    {"vtt", "text/vtt"},
+    {"png", "image/png"},
+    {"apng", "image/apng"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"avif", "image/avif"},
+    {"bmp", "image/bmp"},
+    {"tif", "image/tiff"},
+    {"tiff", "image/tiff"},
+    {"ico", "image/x-icon"},
+    {"svg", "image/svg+xml"},
+    {"mp3", "audio/mpeg"},
+    {"m4a", "audio/mp4"},
+    {"aac", "audio/aac"},
+    {"oga", "audio/ogg"},
+    {"ogg", "audio/ogg"},
+    {"opus", "audio/ogg"},
+    {"wav", "audio/wav"},
+    {"flac", "audio/flac"},
+    {"mid", "audio/midi"},
+    {"midi", "audio/midi"},
+    {"mp4", "video/mp4"},
+    {"m4v", "video/mp4"},
+    {"webm", "video/webm"},
+    {"ogv", "video/ogg"},
+    {"mpeg", "video/mpeg"},
+    {"mpg", "video/mpeg"},
+    {"mov", "video/quicktime"},
+    {"avi", "video/x-msvideo"},
+    {"ts", "video/mp2t"},
+    {"m3u8", "application/vnd.apple.mpegurl"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"ttf", "font/ttf"},
+    {"otf", "font/otf"},
+    {"eot", "application/vnd.ms-fontobject"},
+    {"wasm", "application/wasm"},
+    {"pdf", "application/pdf"},
+    {"rtf", "application/rtf"},
+    {"doc", "application/msword"},
+    {"docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document"},
+    {"xls", "application/vnd.ms-excel"},
+    {"xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"},
+    {"ppt", "application/vnd.ms-powerpoint"},
+    {"pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation"},
+    {"odt", "application/vnd.oasis.opendocument.text"},
+    {"ods", "application/vnd.oasis.opendocument.spreadsheet"},
+    {"epub", "application/epub+zip"},
+    {"zip", "application/zip"},
+    {"gz", "application/gzip"},
+    {"tgz", "application/gzip"},
+    {"bz2", "application/x-bzip2"},
+    {"xz", "application/x-xz"},
+    {"7z", "application/x-7z-compressed"},
+    {"rar", "application/vnd.rar"},
+    {"tar", "application/x-tar"},
+    {"jar", "application/java-archive"},
+    {"bin", "application/octet-stream"},
+};
+
+constexpr size_t BUILTIN_COUNT = std::size(BUILTIN_ENTRIES);
+constexpr size_t BUILTIN_BUCKETS = bucketCountFor(BUILTIN_COUNT);
+constexpr size_t BUILTIN_SLOTS = slotCountFor(BUILTIN_COUNT);
+
+struct BuiltinHash
+{
+    std::array<uint32_t, BUILTIN_BUCKETS> displacements{};
+    std::array<uint16_t, BUILTIN_SLOTS> slots{};
+    bool complete = false;
+};
+
+constexpr BuiltinHash makeBuiltinHash()
+{
+    BuiltinHash hash{};
+    hash.complete = buildPerfectHash(BUILTIN_ENTRIES, BUILTIN_COUNT, hash.displacements, BUILTIN_BUCKETS, hash.slots, BUILTIN_SLOTS);
+    return hash;
+}
+
+constexpr BuiltinHash BUILTIN_HASH = makeBuiltinHash();
+static_assert(BUILTIN_HASH.complete, "built-in MIME table has a repeated extension or no perfect hash");
+static_assert(findExtension("HTML", BUILTIN_ENTRIES, BUILTIN_HASH.displacements, BUILTIN_BUCKETS, BUILTIN_HASH.slots, BUILTIN_SLOTS)->type == "text/html");
+
+/*
+ * A table read from a mime.types file. `text` holds every extension and
+ * type; the entries are views into it, so it is never modified after the
+ * build.
+ */
+struct LoadedTable
+{
+    std::string text;
+    std::vector<MimeEntry> entries;
+    std::vector<uint32_t> displacements;
+    std::vector<uint16_t> slots;
+};
+
+// Set once by loadMimeTypes() before the event loop starts
+static std::unique_ptr<const LoadedTable> loadedTable;
+
+std::string_view getMimeType(std::string_view path)
+{
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string_view::npos || (slash != std::string_view::npos && slash > dot))
+        return DEFAULT_TYPE;
+    std::string_view extension = path.substr(dot + 1);
+    if (extension.empty() || extension.size() > MAX_EXTENSION)
+        return DEFAULT_TYPE;
+
+    if (const LoadedTable *t = loadedTable.get())
+        if (const MimeEntry *e = findExtension(extension, t->entries, t->displacements, t->displacements.size(), t->slots, t->slots.size()))
+            return e->type;
+    if (const MimeEntry *e = findExtension(extension, BUILTIN_ENTRIES, BUILTIN_HASH.displacements, BUILTIN_BUCKETS, BUILTIN_HASH.slots, BUILTIN_SLOTS))
+        return e->type;
+    return DEFAULT_TYPE;
+}
+
+size_t loadMimeTypes(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw FileException("Could not open MIME types file: " + path);
+
+    // extension -> type; a later line replaces an earlier mapping
+    std::unordered_map<std::string, std::string> types;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string type, extension;
+        if (!(words >> type))
+            continue;
+        if (type.find('/') == std::string::npos)
+            throw FileParseException(path + ":" + std::to_string(lineNumber) + ": expected type/subtype, got '" + type + "'");
+        while (words >> extension)
+        {
+            if (extension.size() > MAX_EXTENSION)
+                continue;
+            for (char &c : extension)
+                c = lowerAscii(c);
+            types[extension] = type;
+        }
+    }
+    if (types.size() > UINT16_MAX - 1)
+        throw FileParseException(path + ": more than " + std::to_string(UINT16_MAX - 1) + " extensions");
+
+    // Lay the text out first: the entry views must not see it reallocate
+    auto table = std::make_unique<LoadedTable>();
+    struct Span
+    {
+        size_t extensionAt, extensionLength, typeAt, typeLength;
+    };
+    std::vector<Span> spans;
+    std::unordered_map<std::string, size_t> typeOffsets;
+    for (const auto &[extension, type] : types)
+    {
+        auto [known, added] = typeOffsets.emplace(type, table->text.size());
+        if (added)
+            table->text += type;
+        spans.push_back({table->text.size(), extension.size(), known->second, type.size()});
+        table->text += extension;
+    }
+    std::string_view text = table->text;
+    for (const Span &span : spans)
+        table->entries.push_back({text.substr(span.extensionAt, span.extensionLength), text.substr(span.typeAt, span.typeLength)});
+
+    size_t count = table->entries.size();
+    size_t slotCount = slotCountFor(count);
+    table->displacements.resize(bucketCountFor(count));
+    // A build that runs out of displacements is retried with a sparser table
+    for (int attempt = 1;; ++attempt, slotCount *= 2)
+    {
+        table->slots.resize(slotCount);
+        if (buildPerfectHash(table->entries, count, table->displacements, table->displacements.size(), table->slots, slotCount))
+            break;
+        if (attempt == 4)
+            throw FileParseException(path + ": could not build a perfect hash over its extensions");
+    }
+
+    loadedTable = std::move(table);
+    return count;
+}
+
+size_t builtinMimeTypeCount()
+{
+    return BUILTIN_COUNT;
+}
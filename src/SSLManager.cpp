@@ -1,5 +1,13 @@
 #include "SSLManager.hpp"
 #include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
 #include "../include/Exception.hpp"
 
 SSL_CTX *createServerSSLContext(const std::string &certFile, const std::string &keyFile)
@@ -23,4 +31,235 @@ SSL_CTX *createServerSSLContext(const std::string &certFile, const std::string &
     }
 
     return ctx;
-}
\ No newline at end of file
+}
+
+// Server-side session store behind the OpenSSL session callbacks
+static std::unique_ptr<TlsSessionCache> sessionCache;
+
+/*
+ * Ticket encryption keys. Only this process ever decrypts its tickets, so
+ * the keys are random, never leave memory and are replaced on a timer.
+ */
+struct TicketKey
+{
+    unsigned char name[16]; // sent in the clear to pick the key on decryption
+    unsigned char aesKey[32];
+    unsigned char hmacKey[32];
+};
+
+static std::mutex ticketKeyMutex;
+static TicketKey currentKey, previousKey;
+static bool haveCurrentKey = false, havePreviousKey = false;
+static int64_t currentKeySinceNs = 0;
+static int64_t ticketRotationNs = 0;
+
+static std::atomic<uint64_t> keysGenerated{0};
+static std::atomic<uint64_t> ticketsDecrypted{0};
+static std::atomic<uint64_t> ticketsUnknownKey{0};
+
+static int64_t nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Makes a fresh current key when the old one is due; the old key becomes
+ * the previous one unless it is too old to accept at all.
+ * Called with ticketKeyMutex held. Returns false if no key is usable.
+ */
+static bool rotateTicketKeysIfDue()
+{
+    int64_t now = nowNs();
+    int64_t age = now - currentKeySinceNs;
+    if (haveCurrentKey && age < ticketRotationNs)
+        return true;
+
+    TicketKey fresh;
+    if (RAND_bytes(fresh.name, sizeof(fresh.name)) != 1 ||
+        RAND_bytes(fresh.aesKey, sizeof(fresh.aesKey)) != 1 ||
+        RAND_bytes(fresh.hmacKey, sizeof(fresh.hmacKey)) != 1)
+        return haveCurrentKey;
+
+    havePreviousKey = haveCurrentKey && age < 2 * ticketRotationNs;
+    if (havePreviousKey)
+        previousKey = currentKey;
+    currentKey = fresh;
+    haveCurrentKey = true;
+    currentKeySinceNs = now;
+    keysGenerated.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+static bool setTicketMacKey(EVP_MAC_CTX *mac, unsigned char *hmacKey, size_t length)
+{
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, hmacKey, length),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA256"), 0),
+        OSSL_PARAM_construct_end()};
+    return EVP_MAC_CTX_set_params(mac, params) == 1;
+}
+
+/*
+ * OpenSSL ticket key callback: encrypts new tickets with the current key
+ * and decrypts tickets made with the current or previous key.
+ * Returns 1 on success, 2 to also ask for a renewed ticket, 0 for an
+ * unknown key (full handshake) and -1 on error.
+ */
+static int ticketKeyCallback(SSL *, unsigned char *keyName, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int encrypt)
+{
+    TicketKey key;
+    bool renew = false;
+    {
+        std::lock_guard<std::mutex> lock(ticketKeyMutex);
+        if (!rotateTicketKeysIfDue())
+            return -1;
+        if (encrypt)
+            key = currentKey;
+        else if (std::memcmp(keyName, currentKey.name, sizeof(key.name)) == 0)
+            key = currentKey;
+        else if (havePreviousKey && std::memcmp(keyName, previousKey.name, sizeof(key.name)) == 0)
+        {
+            key = previousKey;
+            renew = true;
+        }
+        else
+        {
+            ticketsUnknownKey.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+    }
+
+    const EVP_CIPHER *aes = EVP_aes_256_cbc();
+    if (encrypt)
+    {
+        if (RAND_bytes(iv, EVP_CIPHER_iv_length(aes)) != 1)
+            return -1;
+        std::memcpy(keyName, key.name, sizeof(key.name));
+        if (EVP_EncryptInit_ex(cipher, aes, nullptr, key.aesKey, iv) != 1)
+            return -1;
+    }
+    else if (EVP_DecryptInit_ex(cipher, aes, nullptr, key.aesKey, iv) != 1)
+        return -1;
+
+    if (!setTicketMacKey(mac, key.hmacKey, sizeof(key.hmacKey)))
+        return -1;
+    if (!encrypt)
+        ticketsDecrypted.fetch_add(1, std::memory_order_relaxed);
+    return renew ? 2 : 1;
+}
+
+static std::string_view sessionId(const unsigned char *id, unsigned int length)
+{
+    return std::string_view(reinterpret_cast<const char *>(id), length);
+}
+
+// Called for every new resumable session; stores a serialized copy
+static int newSessionCallback(SSL *, SSL_SESSION *session)
+{
+    unsigned int idLength = 0;
+    const unsigned char *id = SSL_SESSION_get_id(session, &idLength);
+    int length = i2d_SSL_SESSION(session, nullptr);
+    if (idLength == 0 || length <= 0)
+        return 0;
+
+    std::string der(static_cast<size_t>(length), '\0');
+    unsigned char *out = reinterpret_cast<unsigned char *>(der.data());
+    i2d_SSL_SESSION(session, &out);
+    sessionCache->put(sessionId(id, idLength), std::move(der));
+    return 0; // no reference to `session` is kept
+}
+
+static SSL_SESSION *getSessionCallback(SSL *, const unsigned char *id, int idLength, int *copy)
+{
+    *copy = 0; // the returned session is a fresh object owned by OpenSSL
+    std::string der;
+    if (idLength <= 0 || !sessionCache->get(sessionId(id, static_cast<unsigned int>(idLength)), der))
+        return nullptr;
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(der.data());
+    return d2i_SSL_SESSION(nullptr, &in, static_cast<long>(der.size()));
+}
+
+static void removeSessionCallback(SSL_CTX *, SSL_SESSION *session)
+{
+    unsigned int idLength = 0;
+    const unsigned char *id = SSL_SESSION_get_id(session, &idLength);
+    sessionCache->remove(sessionId(id, idLength));
+}
+
+void configureSessionResumption(SSL_CTX *ctx, size_t cacheEntries, int timeoutSeconds, int ticketRotationSeconds)
+{
+    static const unsigned char SESSION_CONTEXT[] = "cppweb";
+    SSL_CTX_set_session_id_context(ctx, SESSION_CONTEXT, sizeof(SESSION_CONTEXT) - 1);
+    SSL_CTX_set_timeout(ctx, timeoutSeconds);
+
+    sessionCache = std::make_unique<TlsSessionCache>(cacheEntries, timeoutSeconds);
+    if (cacheEntries > 0)
+    {
+        // Only the sharded store is used; OpenSSL's own cache has one lock
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+        SSL_CTX_sess_set_new_cb(ctx, newSessionCallback);
+        SSL_CTX_sess_set_get_cb(ctx, getSessionCallback);
+        SSL_CTX_sess_set_remove_cb(ctx, removeSessionCallback);
+    }
+    else
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+
+    if (ticketRotationSeconds > 0)
+    {
+        ticketRotationNs = static_cast<int64_t>(ticketRotationSeconds) * 1000000000;
+        {
+            std::lock_guard<std::mutex> lock(ticketKeyMutex);
+            if (!rotateTicketKeysIfDue())
+                throw SSLException("Unable to generate a session ticket key");
+        }
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticketKeyCallback);
+        SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+    }
+    else
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+
+    // One TLS 1.3 ticket per handshake instead of OpenSSL's default two:
+    // a client resumes with one, and each costs an encryption or cache slot
+    SSL_CTX_set_num_tickets(ctx, 1);
+}
+
+bool enableKernelTls(SSL_CTX *ctx)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    return true;
+#else
+    (void)ctx;
+    return false;
+#endif
+}
+
+// Server preference order, in ALPN wire format
+static const unsigned char ALPN_PROTOCOLS[] = "\x02h2\x08http/1.1";
+
+static int selectAlpn(SSL *, const unsigned char **out, unsigned char *outlen,
+                      const unsigned char *in, unsigned int inlen, void *)
+{
+    unsigned char *selected = nullptr;
+    if (SSL_select_next_proto(&selected, outlen, ALPN_PROTOCOLS, sizeof(ALPN_PROTOCOLS) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK; // nothing in common: carry on without ALPN, as HTTP/1.1
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+void enableHttp2(SSL_CTX *ctx)
+{
+    SSL_CTX_set_alpn_select_cb(ctx, selectAlpn, nullptr);
+}
+
+TlsResumptionStats tlsResumptionStats()
+{
+    TlsResumptionStats s{};
+    if (sessionCache)
+        s.sessionCache = sessionCache->stats();
+    s.ticketKeysGenerated = keysGenerated.load(std::memory_order_relaxed);
+    s.ticketsDecrypted = ticketsDecrypted.load(std::memory_order_relaxed);
+    s.ticketsUnknownKey = ticketsUnknownKey.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,104 @@
+#include "../include/SimdScan.hpp"
+#include <cstring> // for std::memchr
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMDSCAN_X86 1
+#endif
+
+// Portable fallback; the C library's memchr is already tuned for the platform
+static size_t scanScalar(const char *data, size_t len, char c)
+{
+    const void *hit = std::memchr(data, c, len);
+    return hit ? static_cast<size_t>(static_cast<const char *>(hit) - data) : len;
+}
+
+#ifdef SIMDSCAN_X86
+__attribute__((target("sse2"))) static size_t scanSse2(const char *data, size_t len, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + scanScalar(data + i, len - i, c);
+}
+
+__attribute__((target("avx2"))) static size_t scanAvx2(const char *data, size_t len, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return i + scanSse2(data + i, len - i, c);
+}
+#endif
+
+static ScanLevel bestLevel()
+{
+#ifdef SIMDSCAN_X86
+    // May run from a static initializer, before the CPU model is otherwise set up
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ScanLevel::AVX2;
+    return ScanLevel::SSE2;
+#else
+    return ScanLevel::Scalar;
+#endif
+}
+
+using ScanFn = size_t (*)(const char *, size_t, char);
+
+static ScanFn implFor(ScanLevel level)
+{
+#ifdef SIMDSCAN_X86
+    if (level == ScanLevel::AVX2)
+        return scanAvx2;
+    if (level == ScanLevel::SSE2)
+        return scanSse2;
+#endif
+    return scanScalar;
+}
+
+static ScanLevel currentLevel = bestLevel();
+static ScanFn currentImpl = implFor(currentLevel);
+
+size_t scanFor(const char *data, size_t len, char c)
+{
+    return currentImpl(data, len, c);
+}
+
+ScanLevel activeScanLevel()
+{
+    return currentLevel;
+}
+
+const char *scanLevelName(ScanLevel level)
+{
+    switch (level)
+    {
+    case ScanLevel::AVX2:
+        return "avx2";
+    case ScanLevel::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+void setScanLevel(ScanLevel level)
+{
+    if (static_cast<int>(level) > static_cast<int>(bestLevel()))
+        level = bestLevel();
+    currentLevel = level;
+    currentImpl = implFor(level);
+}
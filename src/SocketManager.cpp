@@ -4,11 +4,15 @@
 #include <cstdio>       // for perror
 #include <sys/socket.h> // for socket, bind, listen, accept
 #include <netinet/in.h> // for sockaddr_in, INADDR_ANY, htons
+#include <netinet/tcp.h> // for TCP_NODELAY
 #include <arpa/inet.h>  // for htonl, ntohl (if needed)
 #include <cstdlib>      // for exit, EXIT_FAILURE
 #include <string>       // for std::string
 #include <iostream>     // for std::cout
 #include <unistd.h>
+#include <fcntl.h>      // for fcntl, O_NONBLOCK
+#include <cerrno>       // for errno
+#include "../include/Exception.hpp"
 #include "../include/Config.hpp"
 
 Config cfg;
@@ -29,7 +33,9 @@ void bindSocket(int fd, uint16_t port)
 {
     // bind to port 8080 on any interface
     sockaddr_in addr{}; // Declare and zero-initialize the IPv4 address structure
+#ifdef __APPLE__
     addr.sin_len = sizeof(addr);
+#endif
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_ANY;
@@ -40,35 +46,62 @@ void bindSocket(int fd, uint16_t port)
     }
 }
 
-void startListening(int fd, int port)
+void startListening(int fd, int port, int backlog)
 {
-    if (listen(fd, BACKLOG) < 0)
+    if (listen(fd, backlog) < 0)
     {
         perror("listen");
         exit(EXIT_FAILURE);
     }
-    log("Server listening on port " + std::to_string(port) + "\n");
+    LOG_INFO("Server listening on port " + std::to_string(port));
 }
 
-int waitForClient(int server_fd)
+void setReuseOptions(int fd, bool reusePort)
 {
-    log("I am in the waitForClient function");
-    int client_fd = accept(server_fd, nullptr, nullptr);
-    if (client_fd >= 0)
-    {
-        // const char *msg = "Hello World\n";
-        // send(client_fd, msg, strlen(msg), 0);
-        //  close(client_fd);
-        std::cout << "New client connected: fd= " << client_fd << "\n";
-    }
-    else
+    int one = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0)
+        throw SocketException("setsockopt(SO_REUSEADDR) failed: " + std::string(std::strerror(errno)));
+    if (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+        throw SocketException("setsockopt(SO_REUSEPORT) failed: " + std::string(std::strerror(errno)));
+}
+
+int createListener(uint16_t port, int backlog, bool reusePort)
+{
+    int fd = createTcpSocket();
+    setReuseOptions(fd, reusePort);
+    bindSocket(fd, port);
+    startListening(fd, port, backlog);
+    return fd;
+}
+
+void setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        throw SocketException("fcntl(O_NONBLOCK) failed: " + std::string(std::strerror(errno)));
+}
+
+int acceptClient(int server_fd)
+{
+    while (true)
     {
-        perror("accept");
-        exit(EXIT_FAILURE);
-    }
+        // The accepted socket inherits O_NONBLOCK and close-on-exec atomically
+        int client_fd = accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd >= 0)
+        {
+            // Headers and body leave in separate writes; with Nagle the second
+            // one waits for the client's delayed ACK (~40 ms) on keep-alive
+            int one = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return client_fd;
+        }
 
-    // close(client_fd);
-    return client_fd;
+        if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            perror("accept4");
+        return -1;
+    }
 }
 
 void echoLoop(int client_fd)
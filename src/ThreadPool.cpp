@@ -0,0 +1,128 @@
+#include "../include/ThreadPool.hpp"
+#include "../include/Logger.hpp"
+
+namespace
+{
+    // Index of the worker running on this thread, or -1 outside the pool.
+    // (Only one pool exists per process.)
+    thread_local int currentWorker = -1;
+}
+
+ThreadPool::ThreadPool(int threadCount)
+{
+    size_t count = threadCount > 0 ? static_cast<size_t>(threadCount) : std::thread::hardware_concurrency();
+    if (count == 0)
+        count = 1;
+
+    for (size_t i = 0; i < count; ++i)
+        queues.push_back(std::make_unique<WorkerQueue>());
+    for (size_t i = 0; i < count; ++i)
+        threads.emplace_back([this, i]()
+                             { workerLoop(i); });
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &t : threads)
+        t.join();
+}
+
+void ThreadPool::submit(Job job)
+{
+    size_t index = currentWorker >= 0 ? static_cast<size_t>(currentWorker)
+                                      : nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    // Count the job before publishing it so `pending` never drops below the real depth
+    size_t depth = pending.fetch_add(1) + 1;
+    size_t seen = maxPending.load(std::memory_order_relaxed);
+    while (depth > seen && !maxPending.compare_exchange_weak(seen, depth, std::memory_order_relaxed))
+    {
+    }
+    submitted.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->jobs.push_back(std::move(job));
+    }
+
+    // Taking the mutex orders this notify after a sleeper's predicate check
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+}
+
+ThreadPool::Stats ThreadPool::stats() const
+{
+    Stats s;
+    s.threads = threads.size();
+    s.queueDepth = pending.load(std::memory_order_relaxed);
+    s.maxQueueDepth = maxPending.load(std::memory_order_relaxed);
+    s.submitted = submitted.load(std::memory_order_relaxed);
+    s.executed = executed.load(std::memory_order_relaxed);
+    s.steals = steals.load(std::memory_order_relaxed);
+    return s;
+}
+
+bool ThreadPool::popLocal(size_t index, Job &job)
+{
+    WorkerQueue &q = *queues[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.jobs.empty())
+        return false;
+    job = std::move(q.jobs.back());
+    q.jobs.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t thief, Job &job)
+{
+    for (size_t offset = 1; offset < queues.size(); ++offset)
+    {
+        WorkerQueue &q = *queues[(thief + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.jobs.empty())
+            continue;
+        job = std::move(q.jobs.front());
+        q.jobs.pop_front();
+        steals.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index)
+{
+    currentWorker = static_cast<int>(index);
+    while (true)
+    {
+        Job job;
+        if (popLocal(index, job) || steal(index, job))
+        {
+            pending.fetch_sub(1);
+            try
+            {
+                job();
+            }
+            catch (const std::exception &e)
+            {
+                LOG_ERROR(std::string("Worker job failed: ") + e.what());
+            }
+            executed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if (stopping && pending.load() == 0)
+            return;
+        wake.wait(lock, [this]()
+                  { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() == 0)
+            return;
+    }
+}
@@ -0,0 +1,105 @@
+#include "../include/TlsSessionCache.hpp"
+#include <chrono>
+#include <functional>
+
+static int64_t nowNs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+TlsSessionCache::TlsSessionCache(size_t capacityEntries, int ttlSeconds)
+    : capacity(capacityEntries),
+      shardCapacity(capacityEntries == 0 ? 0 : (capacityEntries + SHARD_COUNT - 1) / SHARD_COUNT),
+      ttlNs(static_cast<int64_t>(ttlSeconds) * 1000000000)
+{
+    for (size_t i = 0; i < SHARD_COUNT; ++i)
+        shards.push_back(std::make_unique<Shard>());
+}
+
+TlsSessionCache::Shard &TlsSessionCache::shardFor(std::string_view id)
+{
+    return *shards[std::hash<std::string_view>{}(id) % SHARD_COUNT];
+}
+
+void TlsSessionCache::put(std::string_view id, std::string session)
+{
+    if (shardCapacity == 0)
+        return;
+    int64_t now = nowNs();
+    Shard &shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto existing = shard.index.find(id);
+    if (existing != shard.index.end())
+    {
+        auto node = existing->second;
+        shard.index.erase(existing);
+        shard.lru.erase(node);
+    }
+
+    // Make room, also dropping any expired entries that reached the tail
+    while (!shard.lru.empty() && (shard.lru.size() >= shardCapacity || shard.lru.back().expiresAtNs <= now))
+    {
+        shard.index.erase(shard.lru.back().id);
+        shard.lru.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    shard.lru.push_front(Entry{std::string(id), std::move(session), now + ttlNs});
+    shard.index[shard.lru.front().id] = shard.lru.begin();
+}
+
+bool TlsSessionCache::get(std::string_view id, std::string &session)
+{
+    Shard &shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(id);
+    if (it == shard.index.end())
+    {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto node = it->second;
+    if (node->expiresAtNs <= nowNs())
+    {
+        shard.index.erase(it);
+        shard.lru.erase(node);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, node);
+    session = node->session;
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void TlsSessionCache::remove(std::string_view id)
+{
+    Shard &shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(id);
+    if (it == shard.index.end())
+        return;
+    auto node = it->second;
+    shard.index.erase(it);
+    shard.lru.erase(node);
+}
+
+TlsSessionCache::Stats TlsSessionCache::stats() const
+{
+    Stats s{};
+    s.hits = hits.load(std::memory_order_relaxed);
+    s.misses = misses.load(std::memory_order_relaxed);
+    s.evictions = evictions.load(std::memory_order_relaxed);
+    s.capacity = capacity;
+    for (const auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        s.entries += shard->lru.size();
+    }
+    return s;
+}
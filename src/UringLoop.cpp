@@ -0,0 +1,504 @@
+#include "../include/UringLoop.hpp"
+#include "../include/ConnectionManager.hpp"
+#include "../include/Exception.hpp"
+#include "../include/HttpParser.hpp"
+#include "../include/Logger.hpp"
+#include "../include/Metrics.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+constexpr unsigned RING_ENTRIES = 1024;       // submission queue slots; completions get four times as many
+constexpr unsigned RECEIVE_BUFFERS = 512;     // provided buffers shared by all connections of a loop
+constexpr size_t RECEIVE_BUFFER_LENGTH = 4096; // bytes one receive can return
+constexpr uint16_t RECEIVE_GROUP = 0;         // buffer group id of those buffers
+constexpr int PIPE_SIZE = 256 * 1024;         // asked of each connection's splice pipe
+constexpr size_t MAX_PENDING_FILLS = 64;      // asynchronous cache reads in flight per loop
+constexpr int SWEEP_INTERVAL_MS = 1000;       // how often idle connections are looked for
+
+// A partial request left in `conn.in` (at most MAX_REQ_SIZE bytes, or the
+// parser rejects it) always leaves room for one more receive
+static_assert(MAX_REQ_SIZE + RECEIVE_BUFFER_LENGTH <= RECEIVE_BUFFER_SIZE, "receive would not fit the ReceiveBuffer");
+
+/*
+ * What a completion belongs to; kept in the top byte of its user_data, the
+ * rest holds the socket (listener or client) or the FileFill.
+ */
+enum Op : unsigned
+{
+    OpAccept = 1,
+    OpReceive,
+    OpSend,
+    OpSpliceIn,  // file -> pipe
+    OpSpliceOut, // pipe -> socket
+    OpFileRead
+};
+
+constexpr int OP_SHIFT = 56;
+constexpr uint64_t VALUE_MASK = (uint64_t(1) << OP_SHIFT) - 1;
+
+static uint64_t userData(Op op, uint64_t value)
+{
+    return (static_cast<uint64_t>(op) << OP_SHIFT) | value;
+}
+
+static std::atomic<uint64_t> totalEnters{0};
+static std::atomic<uint64_t> totalSubmitted{0};
+static std::atomic<uint64_t> totalCompletions{0};
+static std::atomic<uint64_t> totalCacheFills{0};
+
+/*
+ * A client connection and the state of the operations it has in flight.
+ * The connection is only released once none is left, so no completion can
+ * arrive for a reused descriptor.
+ */
+struct UringLoop::Slot
+{
+    explicit Slot(int fd) : conn(std::make_unique<Connection>(fd)) {}
+    ~Slot()
+    {
+        if (pipe[0] >= 0)
+        {
+            close(pipe[0]);
+            close(pipe[1]);
+        }
+    }
+
+    std::unique_ptr<Connection> conn;
+    unsigned inflight = 0;   // operations submitted and not completed
+    struct msghdr msg{};     // of the pending sendmsg; must outlive it
+    struct iovec iov[MAX_GATHER];
+    int pipe[2] = {-1, -1};  // file bodies are spliced through it; made on first use
+    size_t pipeCapacity = 0;
+    size_t piped = 0;        // file bytes in the pipe that have not reached the socket
+    int64_t sendStartNs = 0; // when the current batch of responses started going out
+};
+
+/*
+ * A cache miss being read into memory. Holds the descriptor, so its
+ * number cannot be reused while the read is in flight.
+ */
+struct UringLoop::FileFill
+{
+    std::shared_ptr<FileHandle> file;
+    std::string fullPath;
+    struct stat st;
+    std::string_view mime;
+    std::string content;
+    int64_t startNs;
+};
+
+UringLoop::UringLoop(const Config &cfg) : cfg(cfg), ring(RING_ENTRIES)
+{
+    // Provided-buffer rings arrived with Linux 5.19, as did multishot accept
+    ring.addBufferRing(RECEIVE_GROUP, RECEIVE_BUFFERS, RECEIVE_BUFFER_LENGTH);
+}
+
+UringLoop::~UringLoop() = default;
+
+void UringLoop::addListener(int listenFd)
+{
+    listeners.push_back(listenFd);
+}
+
+void UringLoop::armAccept(int listenFd)
+{
+    io_uring_sqe *sqe = ring.get();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = userData(OpAccept, static_cast<uint64_t>(listenFd));
+}
+
+void UringLoop::run()
+{
+    ring.enable();
+    setCacheFiller(this);
+    for (int fd : listeners)
+        armAccept(fd);
+
+    int64_t lastSweep = monotonicMillis();
+    while (true)
+    {
+        ring.submitAndWait(1, SWEEP_INTERVAL_MS);
+        now = monotonicMillis();
+        unsigned reaped = ring.forEachCompletion([this](const io_uring_cqe &cqe)
+                                                 { handleCompletion(cqe); });
+        totalCompletions.fetch_add(reaped, std::memory_order_relaxed);
+        publishStats();
+
+        if (now - lastSweep >= SWEEP_INTERVAL_MS)
+        {
+            closeIdleConnections();
+            lastSweep = now;
+        }
+    }
+}
+
+void UringLoop::publishStats()
+{
+    totalEnters.fetch_add(ring.enterCalls() - publishedEnters, std::memory_order_relaxed);
+    totalSubmitted.fetch_add(ring.submittedEntries() - publishedSubmitted, std::memory_order_relaxed);
+    publishedEnters = ring.enterCalls();
+    publishedSubmitted = ring.submittedEntries();
+}
+
+void UringLoop::handleCompletion(const io_uring_cqe &cqe)
+{
+    unsigned op = static_cast<unsigned>(cqe.user_data >> OP_SHIFT);
+    uint64_t value = cqe.user_data & VALUE_MASK;
+
+    if (op == OpAccept)
+    {
+        onAccept(static_cast<int>(value), cqe);
+        return;
+    }
+    if (op == OpFileRead)
+    {
+        onFileRead(reinterpret_cast<FileFill *>(value), cqe.res);
+        return;
+    }
+
+    Slot &slot = *slots[value];
+    slot.inflight--;
+    onConnectionOp(slot, op, cqe);
+    if (slot.inflight == 0)
+        advance(slot);
+}
+
+void UringLoop::onAccept(int listenFd, const io_uring_cqe &cqe)
+{
+    // The kernel ends a multishot accept on errors (e.g. EMFILE); start another
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+        armAccept(listenFd);
+    if (cqe.res < 0)
+    {
+        if (cqe.res != -ECONNABORTED)
+            LOG_WARN("io_uring accept failed: " + std::string(std::strerror(-cqe.res)));
+        return;
+    }
+
+    int fd = cqe.res;
+    // Headers and body leave in separate writes; with Nagle the second
+    // one waits for the client's delayed ACK (~40 ms) on keep-alive
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (static_cast<size_t>(fd) >= slots.size())
+        slots.resize(static_cast<size_t>(fd) + 1);
+    slots[fd] = std::make_unique<Slot>(fd);
+    recordConnectionOpened();
+    // Clients speak first: this arms the first receive
+    advance(*slots[fd]);
+}
+
+void UringLoop::onConnectionOp(Slot &slot, unsigned op, const io_uring_cqe &cqe)
+{
+    Connection &conn = *slot.conn;
+    conn.lastActive.store(now, std::memory_order_relaxed);
+    int res = cqe.res;
+
+    switch (op)
+    {
+    case OpReceive:
+        if (cqe.flags & IORING_CQE_F_BUFFER)
+        {
+            uint16_t id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (res > 0)
+            {
+                std::memcpy(conn.in.space(), ring.buffer(id), static_cast<size_t>(res));
+                conn.in.commit(static_cast<size_t>(res));
+            }
+            ring.recycleBuffer(id);
+        }
+        // ENOBUFS: every buffer was taken this round; advance() simply asks again
+        if (res == 0 || (res < 0 && res != -ENOBUFS))
+            conn.state = ConnState::Closed;
+        break;
+
+    case OpSend:
+        if (res < 0)
+        {
+            conn.state = ConnState::Closed;
+            break;
+        }
+        recordBytesSent(static_cast<uint64_t>(res));
+        // A short send cancels the linked splices; the next round resends the rest
+        consumeOutput(conn, static_cast<size_t>(res));
+        break;
+
+    case OpSpliceIn:
+        if (res > 0)
+            slot.piped += static_cast<size_t>(res);
+        // 0: the file shrank under us, so the promised length can no longer be met
+        else if (res != -ECANCELED)
+            conn.state = ConnState::Closed;
+        break;
+
+    case OpSpliceOut:
+        if (res > 0)
+        {
+            OutputChunk &chunk = conn.out.front();
+            slot.piped -= static_cast<size_t>(res);
+            chunk.offset += res;
+            chunk.length -= static_cast<size_t>(res);
+            recordBytesSent(static_cast<uint64_t>(res));
+            if (chunk.length == 0)
+                conn.out.pop_front();
+        }
+        else if (res != -ECANCELED)
+            conn.state = ConnState::Closed;
+        break;
+    }
+}
+
+/*
+ * Moves a connection with nothing in flight on, mirroring driveConnection():
+ * sends what is queued, answers buffered requests once everything has gone
+ * out, and otherwise waits for more bytes.
+ */
+void UringLoop::advance(Slot &slot)
+{
+    Connection &conn = *slot.conn;
+    while (true)
+    {
+        if (conn.state == ConnState::Closed)
+        {
+            closeSlot(slot);
+            return;
+        }
+
+        if (conn.state == ConnState::Writing)
+        {
+            if (slot.piped > 0)
+            {
+                // The file -> pipe half finished short; send what it moved
+                queueSpliceOut(slot, slot.piped);
+                return;
+            }
+            if (startWrite(slot))
+                return;
+            if (conn.state == ConnState::Closed)
+                continue;
+            recordLatency(Timer::Send, monotonicNanos() - slot.sendStartNs);
+            if (conn.closeAfterWrite)
+            {
+                conn.state = ConnState::Closed;
+                continue;
+            }
+            // Keep-alive: pipelined requests may already be buffered
+            conn.state = ConnState::Reading;
+        }
+
+        processRequests(conn, cfg);
+        if (conn.state == ConnState::Writing)
+        {
+            slot.sendStartNs = monotonicNanos();
+            continue;
+        }
+        armReceive(slot);
+        return;
+    }
+}
+
+void UringLoop::armReceive(Slot &slot)
+{
+    io_uring_sqe *sqe = ring.get();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = slot.conn->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECEIVE_GROUP;
+    sqe->user_data = userData(OpReceive, static_cast<uint64_t>(slot.conn->fd));
+    slot.inflight++;
+}
+
+/*
+ * Submits the next round of output: one sendmsg() over the in-memory run
+ * at the front of the queue and, when a file chunk comes next, the first
+ * pipe-full of it, linked behind the send. Returns false if the queue
+ * held nothing to send.
+ */
+bool UringLoop::startWrite(Slot &slot)
+{
+    Connection &conn = *slot.conn;
+    while (!conn.out.empty())
+    {
+        OutputChunk &front = conn.out.front();
+        if (front.file)
+        {
+            if (front.length > 0)
+                return queueSplice(slot, front, nullptr);
+            conn.out.pop_front();
+            continue;
+        }
+
+        bool fileFollows = false;
+        size_t count = gatherOutput(conn, slot.iov, fileFollows);
+        if (count == 0)
+        {
+            // The run held only empty chunks
+            while (!conn.out.empty() && !conn.out.front().file)
+            {
+                conn.out.pop_front();
+                conn.outSent = 0;
+            }
+            continue;
+        }
+
+        slot.msg = {};
+        slot.msg.msg_iov = slot.iov;
+        slot.msg.msg_iovlen = count;
+
+        // sendmsg -> splice in -> splice out must reach the kernel in one
+        // submission, or the file bytes could overtake the head
+        ring.reserve(fileFollows ? 3 : 1);
+        io_uring_sqe *sqe = ring.get();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&slot.msg);
+        sqe->len = 1;
+        // WAITALL: the kernel retries a partial send itself, so the linked
+        // splices only run once every header byte is out
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (fileFollows ? MSG_MORE : 0);
+        sqe->user_data = userData(OpSend, static_cast<uint64_t>(conn.fd));
+        slot.inflight++;
+
+        if (fileFollows)
+        {
+            for (size_t i = 0; i < conn.out.size(); ++i)
+                if (conn.out[i].file)
+                {
+                    queueSplice(slot, conn.out[i], sqe);
+                    break;
+                }
+        }
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Queues up to a pipe-full of a file chunk as two linked splices, file ->
+ * pipe -> socket, after `linkedFrom` if given. Regular files fill the pipe
+ * completely, so the second splice never waits for bytes that will not
+ * come; if the first one is short anyway, the second is cancelled and
+ * advance() sends what arrived.
+ */
+bool UringLoop::queueSplice(Slot &slot, const OutputChunk &chunk, io_uring_sqe *linkedFrom)
+{
+    if (slot.pipe[0] < 0)
+    {
+        if (pipe2(slot.pipe, O_CLOEXEC) < 0)
+        {
+            LOG_WARN("pipe2 failed: " + std::string(std::strerror(errno)));
+            slot.pipe[0] = slot.pipe[1] = -1;
+            slot.conn->state = ConnState::Closed;
+            return false;
+        }
+        fcntl(slot.pipe[1], F_SETPIPE_SZ, PIPE_SIZE); // may be capped by fs.pipe-max-size
+        int capacity = fcntl(slot.pipe[1], F_GETPIPE_SZ);
+        slot.pipeCapacity = capacity > 0 ? static_cast<size_t>(capacity) : 65536;
+    }
+    if (linkedFrom)
+        linkedFrom->flags |= IOSQE_IO_LINK; // startWrite() reserved room for the whole chain
+    else
+        ring.reserve(2);
+
+    size_t length = std::min(chunk.length, slot.pipeCapacity);
+    io_uring_sqe *sqe = ring.get();
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = chunk.file->fd;
+    sqe->splice_off_in = static_cast<uint64_t>(chunk.offset);
+    sqe->fd = slot.pipe[1];
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->splice_flags = SPLICE_F_MOVE;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = userData(OpSpliceIn, static_cast<uint64_t>(slot.conn->fd));
+    slot.inflight++;
+
+    queueSpliceOut(slot, length);
+    return true;
+}
+
+void UringLoop::queueSpliceOut(Slot &slot, size_t length)
+{
+    io_uring_sqe *sqe = ring.get();
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_fd_in = slot.pipe[0];
+    sqe->splice_off_in = static_cast<uint64_t>(-1);
+    sqe->fd = slot.conn->fd;
+    sqe->off = static_cast<uint64_t>(-1);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->splice_flags = SPLICE_F_MOVE;
+    sqe->user_data = userData(OpSpliceOut, static_cast<uint64_t>(slot.conn->fd));
+    slot.inflight++;
+}
+
+void UringLoop::fill(std::shared_ptr<FileHandle> file, const std::string &fullPath, const struct stat &st, std::string_view mime)
+{
+    if (fills.size() >= MAX_PENDING_FILLS || fills.count(fullPath))
+        return;
+
+    auto pending = std::make_unique<FileFill>();
+    pending->file = std::move(file);
+    pending->fullPath = fullPath;
+    pending->st = st;
+    pending->mime = mime;
+    pending->content.resize(static_cast<size_t>(st.st_size));
+    pending->startNs = monotonicNanos();
+
+    io_uring_sqe *sqe = ring.get();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = pending->file->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(pending->content.data());
+    sqe->len = static_cast<uint32_t>(pending->content.size());
+    sqe->off = 0;
+    sqe->user_data = userData(OpFileRead, reinterpret_cast<uint64_t>(pending.get()));
+    fills.emplace(fullPath, std::move(pending));
+}
+
+void UringLoop::onFileRead(FileFill *fill, int result)
+{
+    auto it = fills.find(fill->fullPath);
+    recordLatency(Timer::FileRead, monotonicNanos() - fill->startNs);
+    // Anything short of the whole file means it changed meanwhile
+    if (result >= 0 && static_cast<size_t>(result) == fill->content.size())
+    {
+        storeInFileCache(fill->fullPath, fill->st, fill->mime, std::move(fill->content));
+        totalCacheFills.fetch_add(1, std::memory_order_relaxed);
+    }
+    fills.erase(it);
+}
+
+void UringLoop::closeSlot(Slot &slot)
+{
+    int fd = slot.conn->fd;
+    slots[fd].reset(); // Connection's destructor closes the socket
+    recordConnectionClosed();
+}
+
+void UringLoop::closeIdleConnections()
+{
+    int64_t deadline = now - static_cast<int64_t>(cfg.keepAliveTimeout) * 1000;
+    // The pending receive (or send) then completes and the normal path closes it
+    for (const auto &slot : slots)
+        if (slot && slot->conn->lastActive.load(std::memory_order_relaxed) < deadline)
+            shutdown(slot->conn->fd, SHUT_RDWR);
+}
+
+UringLoop::Stats uringStats()
+{
+    UringLoop::Stats s;
+    s.enterCalls = totalEnters.load(std::memory_order_relaxed);
+    s.submitted = totalSubmitted.load(std::memory_order_relaxed);
+    s.completions = totalCompletions.load(std::memory_order_relaxed);
+    s.cacheFills = totalCacheFills.load(std::memory_order_relaxed);
+    return s;
+}
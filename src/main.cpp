@@ -1,68 +1,265 @@
 #include "../include/SocketManager.hpp"
 #include "../include/Logger.hpp"
-#include "../include/ConnectionManager.hpp"
+#include "../include/EventLoop.hpp"
 #include "../include/Config.hpp"
 #include "../include/SSLManager.hpp"
+#include "../include/ThreadPool.hpp"
+#include "../include/FileServer.hpp"
+#include "../include/Compression.hpp"
+#include "../include/Metrics.hpp"
+#include "../include/Exception.hpp"
+#include "../include/MemoryPool.hpp"
+#include "../include/Connection.hpp"
+#include "../include/UringLoop.hpp"
+#include "../include/Http2.hpp"
+#include <functional>
 #include <unistd.h>
+#include <csignal>
 #include <iostream>
+#include <algorithm>
+#include <memory>
 #include <thread>
-#include <stop_token>
+#include <vector>
+
+/*
+ * Exports a buffer pool's occupancy as cppweb_<prefix>_* metrics.
+ */
+static void writeBufferPoolMetrics(std::string &out, const std::string &prefix, const BufferPool::Stats &s)
+{
+    writeMetric(out, ("cppweb_" + prefix + "_blocks").c_str(), "gauge", "Buffers carved from slabs, free or in use.", static_cast<double>(s.blocks));
+    writeMetric(out, ("cppweb_" + prefix + "_in_use").c_str(), "gauge", "Buffers held by connections.", static_cast<double>(s.inUse));
+    writeMetric(out, ("cppweb_" + prefix + "_peak_in_use").c_str(), "gauge", "Most buffers held at once since start.", static_cast<double>(s.peakInUse));
+    writeMetric(out, ("cppweb_" + prefix + "_acquired_total").c_str(), "counter", "Buffers taken from the pool.", static_cast<double>(s.acquired));
+    writeMetric(out, ("cppweb_" + prefix + "_slabs_total").c_str(), "counter", "Slabs allocated to grow the pool.", static_cast<double>(s.slabs));
+}
+
+/*
+ * Adds the thread pool, file cache, docRoot index, TLS resumption, memory
+ * pool, io_uring and logger counters to the metrics endpoint.
+ */
+static void registerMetricsCollectors(ThreadPool &pool)
+{
+    addMetricsCollector([&pool](std::string &out)
+                        {
+        ThreadPool::Stats s = pool.stats();
+        writeMetric(out, "cppweb_pool_threads", "gauge", "Worker threads in the pool.", static_cast<double>(s.threads));
+        writeMetric(out, "cppweb_pool_queue_depth", "gauge", "Jobs waiting for a worker.", static_cast<double>(s.queueDepth));
+        writeMetric(out, "cppweb_pool_queue_depth_max", "gauge", "Highest queue depth since start.", static_cast<double>(s.maxQueueDepth));
+        writeMetric(out, "cppweb_pool_jobs_executed_total", "counter", "Jobs run by the workers.", static_cast<double>(s.executed));
+        writeMetric(out, "cppweb_pool_steals_total", "counter", "Jobs taken from another worker's queue.", static_cast<double>(s.steals)); });
+
+    addMetricsCollector([](std::string &out)
+                        {
+        FileCache::Stats s = fileCacheStats();
+        uint64_t lookups = s.hits + s.misses;
+        writeMetric(out, "cppweb_file_cache_hits_total", "counter", "File cache lookups served from memory.", static_cast<double>(s.hits));
+        writeMetric(out, "cppweb_file_cache_misses_total", "counter", "File cache lookups that read the disk.", static_cast<double>(s.misses));
+        writeMetric(out, "cppweb_file_cache_hit_ratio", "gauge", "Hits divided by lookups since start.", lookups ? static_cast<double>(s.hits) / lookups : 0.0);
+        writeMetric(out, "cppweb_file_cache_evictions_total", "counter", "Entries evicted to stay within budget.", static_cast<double>(s.evictions));
+        writeMetric(out, "cppweb_file_cache_bytes", "gauge", "Bytes of file content held in the cache.", static_cast<double>(s.bytes));
+        writeMetric(out, "cppweb_file_cache_entries", "gauge", "Files held in the cache.", static_cast<double>(s.entries)); });
+
+    addMetricsCollector([](std::string &out)
+                        {
+        DocIndex::Stats s = docIndexStats();
+        writeMetric(out, "cppweb_doc_index_files", "gauge", "Regular files in the docRoot index.", static_cast<double>(s.files));
+        writeMetric(out, "cppweb_doc_index_directories", "gauge", "Directories in the docRoot index.", static_cast<double>(s.directories));
+        writeMetric(out, "cppweb_doc_index_bytes", "gauge", "Total size of the indexed files.", static_cast<double>(s.bytes));
+        writeMetric(out, "cppweb_doc_index_open_files", "gauge", "Descriptors the index keeps open for large files.", static_cast<double>(s.openHandles));
+        writeMetric(out, "cppweb_doc_index_build_seconds", "gauge", "Duration of the last full index build.", s.buildSeconds);
+        writeMetric(out, "cppweb_doc_index_updates_total", "counter", "Index entries changed by inotify events.", static_cast<double>(s.updates));
+        writeMetric(out, "cppweb_doc_index_rebuilds_total", "counter", "Full rebuilds after an inotify queue overflow.", static_cast<double>(s.rebuilds)); });
+
+    addMetricsCollector([](std::string &out)
+                        {
+        TlsResumptionStats s = tlsResumptionStats();
+        writeMetric(out, "cppweb_tls_handshakes_pending", "gauge", "TLS handshakes accepted but not finished.", static_cast<double>(pendingHandshakes()));
+        writeMetric(out, "cppweb_tls_session_cache_hits_total", "counter", "TLS sessions resumed from the session cache.", static_cast<double>(s.sessionCache.hits));
+        writeMetric(out, "cppweb_tls_session_cache_misses_total", "counter", "TLS session lookups that found nothing usable.", static_cast<double>(s.sessionCache.misses));
+        writeMetric(out, "cppweb_tls_session_cache_evictions_total", "counter", "TLS sessions dropped for space or expiry.", static_cast<double>(s.sessionCache.evictions));
+        writeMetric(out, "cppweb_tls_session_cache_entries", "gauge", "TLS sessions held in the cache.", static_cast<double>(s.sessionCache.entries));
+        writeMetric(out, "cppweb_tls_ticket_keys_generated_total", "counter", "Session ticket keys generated, the first one included.", static_cast<double>(s.ticketKeysGenerated));
+        writeMetric(out, "cppweb_tls_tickets_decrypted_total", "counter", "Stateless session tickets accepted.", static_cast<double>(s.ticketsDecrypted));
+        writeMetric(out, "cppweb_tls_tickets_unknown_key_total", "counter", "Session tickets rejected because their key was retired.", static_cast<double>(s.ticketsUnknownKey)); });
+
+    addMetricsCollector([](std::string &out)
+                        {
+        writeBufferPoolMetrics(out, "receive_buffers", receiveBufferPool().stats());
+        writeBufferPoolMetrics(out, "tls_file_buffers", fileReadBufferPool().stats());
+        RequestArena::Stats arena = requestArenaStats();
+        writeMetric(out, "cppweb_request_arena_resets_total", "counter", "Requests whose temporaries came from a request arena.", static_cast<double>(arena.resets));
+        writeMetric(out, "cppweb_request_arena_peak_bytes", "gauge", "Most arena bytes one request has used.", static_cast<double>(arena.peakBytes));
+        writeMetric(out, "cppweb_request_arena_overflows_total", "counter", "Heap chunks taken by requests that outgrew the inline arena.", static_cast<double>(arena.overflows)); });
+
+    addMetricsCollector([](std::string &out)
+                        {
+        UringLoop::Stats s = uringStats();
+        writeMetric(out, "cppweb_uring_enter_calls_total", "counter", "io_uring_enter() system calls made by the io_uring loops.", static_cast<double>(s.enterCalls));
+        writeMetric(out, "cppweb_uring_submitted_total", "counter", "Operations submitted to io_uring.", static_cast<double>(s.submitted));
+        writeMetric(out, "cppweb_uring_completions_total", "counter", "io_uring completions reaped.", static_cast<double>(s.completions));
+        writeMetric(out, "cppweb_uring_cache_fills_total", "counter", "File cache misses read asynchronously.", static_cast<double>(s.cacheFills)); });
+
+    addMetricsCollector([](std::string &out)
+                        {
+        Http2Stats s = http2Stats();
+        writeMetric(out, "cppweb_http2_connections_total", "counter", "HTTPS connections that negotiated HTTP/2.", static_cast<double>(s.connections));
+        writeMetric(out, "cppweb_http2_streams_total", "counter", "Requests answered on HTTP/2 streams.", static_cast<double>(s.streams));
+        writeMetric(out, "cppweb_http2_streams_reset_total", "counter", "HTTP/2 streams reset by the server (refused, malformed or flow-control errors).", static_cast<double>(s.streamsReset));
+        writeMetric(out, "cppweb_http2_connection_errors_total", "counter", "HTTP/2 connections closed with a GOAWAY error.", static_cast<double>(s.connectionErrors));
+        writeMetric(out, "cppweb_http2_header_bytes_total", "counter", "HPACK-encoded response header bytes sent on HTTP/2.", static_cast<double>(s.headerBytes)); });
+
+    addMetricsCollector([](std::string &out)
+                        { writeMetric(out, "cppweb_log_dropped_total", "counter", "Log messages dropped because a buffer was full.", static_cast<double>(droppedLogMessages())); });
+}
 
 int main()
 {
+    // A client that disconnects mid-response must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+
     // HTTP
     Config cfg;
     try
     {
         cfg = Config::load("../config.json");
-        log("config port: " + std::to_string(cfg.port));
-        log("config sslPort: " + std::to_string(cfg.sslPort));
-        log("config docRoot: " + cfg.docRoot);
-        log("config maxThreads: " + std::to_string(cfg.maxThreads));
+        initLogger(cfg.logFile, cfg.logLevel);
+        LOG_INFO("config port: " + std::to_string(cfg.port));
+        LOG_INFO("config sslPort: " + std::to_string(cfg.sslPort));
+        LOG_INFO("config docRoot: " + cfg.docRoot);
+        LOG_INFO("config maxThreads: " + std::to_string(cfg.maxThreads));
+        LOG_INFO("config keepAliveTimeout: " + std::to_string(cfg.keepAliveTimeout));
+        LOG_INFO("config maxKeepAliveRequests: " + std::to_string(cfg.maxKeepAliveRequests));
+        LOG_INFO("config receiveBuffers: " + std::to_string(cfg.receiveBuffers));
+        LOG_INFO("config fileCacheMB: " + std::to_string(cfg.fileCacheMB));
+        LOG_INFO("config docIndex: " + std::to_string(cfg.docIndex));
+        LOG_INFO("config maxOpenFiles: " + std::to_string(cfg.maxOpenFiles));
+        LOG_INFO("config mimeTypesFile: " + (cfg.mimeTypesFile.empty() ? std::string("built-in only") : cfg.mimeTypesFile));
+        LOG_INFO("config gzipLevel: " + std::to_string(cfg.gzipLevel));
+        LOG_INFO("config gzipMinSize: " + std::to_string(cfg.gzipMinSize));
+        LOG_INFO("config logFile: " + (cfg.logFile.empty() ? std::string("stdout") : cfg.logFile));
+        LOG_INFO("config tlsSessionCacheSize: " + std::to_string(cfg.tlsSessionCacheSize));
+        LOG_INFO("config tlsSessionTimeout: " + std::to_string(cfg.tlsSessionTimeout));
+        LOG_INFO("config tlsTicketKeyRotation: " + std::to_string(cfg.tlsTicketKeyRotation));
+        LOG_INFO("config tlsHandshakeTimeout: " + std::to_string(cfg.tlsHandshakeTimeout));
+        LOG_INFO("config maxPendingHandshakes: " + std::to_string(cfg.maxPendingHandshakes));
+        LOG_INFO("config tlsKernelOffload: " + std::to_string(cfg.tlsKernelOffload));
+        LOG_INFO("config http2: " + std::to_string(cfg.http2));
+        LOG_INFO("config http2MaxStreams: " + std::to_string(cfg.http2MaxStreams));
+        LOG_INFO("config metricsPath: " + (cfg.metricsPath.empty() ? std::string("disabled") : cfg.metricsPath));
+        for (const auto &[match, value] : cfg.cacheControl)
+            LOG_INFO("config cacheControl: " + match + " -> " + value);
     }
     catch (const std::exception &e)
     {
         std::cerr << e.what() << '\n';
     }
 
-    int http_fd = createTcpSocket();
-    bindSocket(http_fd, cfg.port);
-    startListening(http_fd, cfg.port);
+    // With more than one shard every shard gets its own SO_REUSEPORT
+    // listener per port and its own epoll loop and accept thread, so the
+    // kernel spreads new connections without a shared accept queue or lock
+    int shards = cfg.listenerShards > 0 ? cfg.listenerShards : static_cast<int>(std::thread::hardware_concurrency());
+    shards = std::max(shards, 1);
+    bool reusePort = shards > 1;
+    LOG_INFO("config listenBacklog: " + std::to_string(cfg.listenBacklog));
+    LOG_INFO("listener shards per port: " + std::to_string(shards));
+    LOG_INFO("config ioBackend: " + cfg.ioBackend);
 
-    // HTTPS
+    std::vector<int> http_fds, https_fds;
+    for (int i = 0; i < shards; ++i)
+    {
+        // HTTP
+        http_fds.push_back(createListener(cfg.port, cfg.listenBacklog, reusePort));
+        // HTTPS
+        if (cfg.sslPort > 0)
+            https_fds.push_back(createListener(cfg.sslPort, cfg.listenBacklog, reusePort));
+    }
     SSL_CTX *sslCtx = createServerSSLContext("../server.crt", "../server.key");
-    int https_fd = createTcpSocket();
-    bindSocket(https_fd, cfg.sslPort);
-    startListening(https_fd, cfg.sslPort);
+    configureSessionResumption(sslCtx, static_cast<size_t>(cfg.tlsSessionCacheSize), cfg.tlsSessionTimeout, cfg.tlsTicketKeyRotation);
+    if (cfg.tlsKernelOffload && !enableKernelTls(sslCtx))
+        LOG_WARN("tlsKernelOffload is set but this OpenSSL build has no kTLS support");
+    if (cfg.http2)
+        enableHttp2(sslCtx);
 
-    std::thread httpThread([http_fd, &cfg]()
-                           {
-            while (true)
-            {
-                log("I am in the http thread.");
-                // Wait for a new client connection
-                int client_fd = waitForClient(http_fd);
-                if(client_fd < 0) continue;
-                spawnClientThreadHTTP(client_fd, cfg.docRoot);
-            } });
-
-    std::thread httpsThread([https_fd, sslCtx, &cfg]()
-                            {
-            while (true)
+    // Before the docRoot index, which looks up every file's type as it builds
+    if (!cfg.mimeTypesFile.empty())
+    {
+        try
+        {
+            size_t loaded = loadMimeTypes(cfg.mimeTypesFile);
+            LOG_INFO("MIME types: " + std::to_string(loaded) + " extensions from " + cfg.mimeTypesFile + ", " +
+                     std::to_string(builtinMimeTypeCount()) + " built in");
+        }
+        catch (const ServerException &e)
+        {
+            LOG_WARN(std::string(e.what()) + "; using the built-in MIME types only");
+        }
+    }
+    initFileCache(static_cast<size_t>(cfg.fileCacheMB) * 1024 * 1024);
+    if (cfg.docIndex)
+        initDocIndex(cfg.docRoot, static_cast<size_t>(cfg.maxOpenFiles));
+    initCompression(cfg.gzipLevel, static_cast<size_t>(cfg.gzipMinSize));
+    initCacheControl(cfg.cacheControl);
+    initMetrics(cfg.metricsPath);
+    receiveBufferPool().reserve(static_cast<size_t>(cfg.receiveBuffers));
+
+    // With ioBackend "io_uring" each shard's HTTP socket gets a UringLoop,
+    // which answers requests on its own thread; everything else (and all of
+    // it if the kernel cannot run io_uring) goes to the epoll reactors
+    std::vector<std::unique_ptr<UringLoop>> uringLoops;
+    if (cfg.ioBackend == "io_uring")
+    {
+        try
+        {
+            for (int i = 0; i < shards; ++i)
             {
-                log("I am in the https thread.");
-                int ssl_client_fd = waitForClient(https_fd);
-                if(ssl_client_fd < 0) continue;
-                spawnClientThreadHTTPS(ssl_client_fd, sslCtx, cfg.docRoot);
-            } });
+                uringLoops.push_back(std::make_unique<UringLoop>(cfg));
+                uringLoops.back()->addListener(http_fds[i]);
+            }
+        }
+        catch (const SocketException &e)
+        {
+            LOG_WARN(std::string(e.what()) + "; falling back to epoll");
+            uringLoops.clear();
+        }
+    }
+
+    // Each epoll reactor watches its shard's remaining sockets; all of
+    // them hand ready connections to one fixed pool of cfg.maxThreads workers
+    ThreadPool pool(cfg.maxThreads);
+    registerMetricsCollectors(pool);
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    for (int i = 0; i < shards; ++i)
+    {
+        if (uringLoops.empty() || !https_fds.empty())
+            loops.push_back(std::make_unique<EventLoop>(cfg, sslCtx, pool));
+        if (uringLoops.empty())
+            loops.back()->addListener(http_fds[i], false);
+        if (!https_fds.empty())
+            loops.back()->addListener(https_fds[i], true);
+    }
+
+    std::vector<std::function<void()>> runners;
+    for (auto &loop : uringLoops)
+        runners.push_back([&loop]()
+                          { loop->run(); });
+    for (auto &loop : loops)
+        runners.push_back([&loop]()
+                          { loop->run(); });
 
-    if (httpThread.joinable())
-        httpThread.join();
-    if (httpsThread.joinable())
-        httpsThread.join();
+    // The first loop runs on the main thread
+    std::vector<std::thread> acceptThreads;
+    for (size_t i = 1; i < runners.size(); ++i)
+        acceptThreads.emplace_back(runners[i]);
+    runners[0]();
 
+    for (auto &t : acceptThreads)
+        t.join();
+    loops.clear();
+    uringLoops.clear();
     SSL_CTX_free(sslCtx);
-    close(http_fd);
-    close(https_fd);
+    for (int fd : http_fds)
+        close(fd);
+    for (int fd : https_fds)
+        close(fd);
     return 0;
-}
\ No newline at end of file
+}